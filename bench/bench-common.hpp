@@ -0,0 +1,132 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+// What mona-vtk-bench and mona-vtk-icet-bench share: the options common to
+// both, the parsing of comma separated lists and the creation of the MoNA
+// communicator of all the MPI processes.
+#ifndef BenchCommon_h
+#define BenchCommon_h
+
+#include <mona-coll.h>
+#include <mona.h>
+#include <mpi.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+
+// Options taken by every benchmark, see ParseCommonOption
+struct CommonOptions
+{
+  std::string Transport = "na+sm";
+  std::string Backends = "mona,mpi";
+  std::string CSVFile;
+};
+
+// getopt string of the common options, to prepend to the benchmark's own
+#define BENCH_COMMON_OPTSTRING "t:c:o:h"
+
+// Store opt if it is one of the common options. Returns false otherwise.
+inline bool ParseCommonOption(int opt, const char* arg, CommonOptions& options)
+{
+  switch (opt)
+  {
+    case 't':
+      options.Transport = arg;
+      return true;
+    case 'c':
+      options.Backends = arg;
+      return true;
+    case 'o':
+      options.CSVFile = arg;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Print the usage with the lines of the common options around those of the
+// benchmark.
+inline void Usage(const char* program, const char* options)
+{
+  std::cerr << "usage: " << program << " [options]\n"
+            << "  -t transport   MoNA transport (default na+sm, e.g. ofi+tcp)\n"
+            << "  -c backends    comma separated list of mona,mpi (default both)\n"
+            << options << "  -o file        also write the results as CSV to file\n";
+}
+
+inline std::vector<std::string> Split(const std::string& list, char separator)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, separator))
+  {
+    if (!item.empty())
+    {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+inline bool Contains(const std::string& list, const std::string& item)
+{
+  std::vector<std::string> items = Split(list, ',');
+  return std::find(items.begin(), items.end(), item) != items.end();
+}
+
+//----------------------------------------------------------------------------
+// Create the MoNA communicator of all the MPI processes, exchanging the
+// addresses with MPI.
+inline mona_comm_t CreateMonaComm(mona_instance_t mona)
+{
+  na_addr_t selfAddr;
+  if (mona_addr_self(mona, &selfAddr) != NA_SUCCESS)
+  {
+    throw std::runtime_error("failed to get mona self addr");
+  }
+  char selfAddrStr[128];
+  na_size_t selfAddrSize = 128;
+  if (mona_addr_to_string(mona, selfAddrStr, &selfAddrSize, selfAddr) != NA_SUCCESS)
+  {
+    throw std::runtime_error("failed to execute mona_addr_to_string");
+  }
+  mona_addr_free(mona, selfAddr);
+
+  int numProcs;
+  MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+  std::vector<char> addrStrs(128 * numProcs);
+  MPI_Allgather(selfAddrStr, 128, MPI_BYTE, addrStrs.data(), 128, MPI_BYTE, MPI_COMM_WORLD);
+
+  std::vector<na_addr_t> addrs(numProcs);
+  for (int i = 0; i < numProcs; i++)
+  {
+    if (mona_addr_lookup(mona, addrStrs.data() + 128 * i, &addrs[i]) != NA_SUCCESS)
+    {
+      throw std::runtime_error("failed to execute mona_addr_lookup");
+    }
+  }
+  mona_comm_t comm;
+  if (mona_comm_create(mona, numProcs, addrs.data(), &comm) != NA_SUCCESS)
+  {
+    throw std::runtime_error("failed to create the mona communicator");
+  }
+  for (na_addr_t addr : addrs)
+  {
+    mona_addr_free(mona, addr);
+  }
+  return comm;
+}
+
+} // END namespace Bench
+
+#endif
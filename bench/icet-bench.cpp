@@ -0,0 +1,566 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+// IceT compositing benchmark of mona-vtk. Each process draws its block of a
+// synthetic scene (the unit cube split among the processes, as in
+// example/icetExample) once, then IceT composites it for a number of frames
+// over a MoNA communicator (icetCreateMonaCommunicator) and over an MPI one.
+// The run sweeps the compositing strategy, the single image strategy, the
+// tile layout, the image size, the color/depth formats and the process
+// count, and reports the frame rate and the IceT phase timings as a table
+// and optionally as CSV. No OpenGL is involved.
+//
+// mpirun -n 8 ./mona-vtk-icet-bench -t na+sm -s reduce,vtree -S bswap,radixk -o icet.csv
+#include "bench-common.hpp"
+
+#include <icet/mona.hpp>
+
+#include <IceT.h>
+#include <IceTDevImage.h>
+#include <IceTDevMatrix.h>
+#include <IceTMPI.h>
+
+#include <mona-coll.h>
+#include <mona.h>
+#include <mpi.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Options : Bench::CommonOptions
+{
+  std::string Strategies = "reduce";
+  std::string SingleImageStrategies = "automatic,bswap,radixk,tree";
+  std::string Tiles = "1x1";
+  std::string Sizes = "1024x768";
+  std::string Formats = "ubyte/float";
+  int Frames = 20;
+  int Warmup = 2;
+};
+
+struct NamedEnum
+{
+  const char* Name;
+  IceTEnum Value;
+};
+
+const NamedEnum Strategies[] = { { "direct", ICET_STRATEGY_DIRECT },
+  { "sequential", ICET_STRATEGY_SEQUENTIAL }, { "split", ICET_STRATEGY_SPLIT },
+  { "reduce", ICET_STRATEGY_REDUCE }, { "vtree", ICET_STRATEGY_VTREE } };
+
+const NamedEnum SingleImageStrategies[] = { { "automatic",
+                                              ICET_SINGLE_IMAGE_STRATEGY_AUTOMATIC },
+  { "bswap", ICET_SINGLE_IMAGE_STRATEGY_BSWAP }, { "tree", ICET_SINGLE_IMAGE_STRATEGY_TREE },
+  { "radixk", ICET_SINGLE_IMAGE_STRATEGY_RADIXK },
+  { "radixkr", ICET_SINGLE_IMAGE_STRATEGY_RADIXKR } };
+
+const NamedEnum ColorFormats[] = { { "ubyte", ICET_IMAGE_COLOR_RGBA_UBYTE },
+  { "float", ICET_IMAGE_COLOR_RGBA_FLOAT } };
+
+const NamedEnum DepthFormats[] = { { "float", ICET_IMAGE_DEPTH_FLOAT },
+  { "none", ICET_IMAGE_DEPTH_NONE } };
+
+// IceT timings read after each frame, averaged over the frames and reported
+// for the slowest process
+const NamedEnum Phases[] = { { "buffer_read", ICET_BUFFER_READ_TIME },
+  { "buffer_write", ICET_BUFFER_WRITE_TIME }, { "compress", ICET_COMPRESS_TIME },
+  { "blend", ICET_BLEND_TIME }, { "composite", ICET_COMPOSITE_TIME },
+  { "collect", ICET_COLLECT_TIME }, { "total_draw", ICET_TOTAL_DRAW_TIME } };
+const int NumberOfPhases = sizeof(Phases) / sizeof(Phases[0]);
+// the phases shown in the table, the CSV has all of them
+const int CompositePhase = 4;
+const int CollectPhase = 5;
+
+// One point of the sweep
+struct Configuration
+{
+  std::string Strategy;
+  std::string SingleImageStrategy;
+  int TilesX;
+  int TilesY;
+  int Width;
+  int Height;
+  std::string ColorFormat;
+  std::string DepthFormat;
+};
+
+struct Result
+{
+  double FramesPerSecond = 0;
+  double Phases[NumberOfPhases] = {}; // seconds per frame
+  double BytesSent = 0;               // per frame, summed over the processes
+};
+
+double Now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+template <size_t N>
+IceTEnum Lookup(const NamedEnum (&table)[N], const std::string& name, const char* what)
+{
+  for (const NamedEnum& entry : table)
+  {
+    if (name == entry.Name)
+    {
+      return entry.Value;
+    }
+  }
+  throw std::runtime_error(std::string("unknown ") + what + " " + name);
+}
+
+// "WxH" into its two numbers
+void ParsePair(const std::string& text, int& x, int& y)
+{
+  std::vector<std::string> items = Bench::Split(text, 'x');
+  if (items.size() != 2 || (x = std::stoi(items[0])) <= 0 || (y = std::stoi(items[1])) <= 0)
+  {
+    throw std::runtime_error("expected WxH, got " + text);
+  }
+}
+
+std::vector<Configuration> Sweep(const Options& options)
+{
+  std::vector<Configuration> configurations;
+  for (const std::string& strategy : Bench::Split(options.Strategies, ','))
+  {
+    Lookup(Strategies, strategy, "strategy");
+    for (const std::string& single : Bench::Split(options.SingleImageStrategies, ','))
+    {
+      Lookup(SingleImageStrategies, single, "single image strategy");
+      for (const std::string& tiles : Bench::Split(options.Tiles, ','))
+      {
+        for (const std::string& size : Bench::Split(options.Sizes, ','))
+        {
+          for (const std::string& format : Bench::Split(options.Formats, ','))
+          {
+            Configuration c;
+            c.Strategy = strategy;
+            c.SingleImageStrategy = single;
+            ParsePair(tiles, c.TilesX, c.TilesY);
+            ParsePair(size, c.Width, c.Height);
+            std::vector<std::string> formats = Bench::Split(format, '/');
+            if (formats.size() != 2)
+            {
+              throw std::runtime_error("expected color/depth, got " + format);
+            }
+            c.ColorFormat = formats[0];
+            c.DepthFormat = formats[1];
+            Lookup(ColorFormats, c.ColorFormat, "color format");
+            Lookup(DepthFormats, c.DepthFormat, "depth format");
+            configurations.push_back(c);
+          }
+        }
+      }
+    }
+  }
+  return configurations;
+}
+
+//----------------------------------------------------------------------------
+// The scene: the unit cube centered on the origin, split evenly among the
+// processes by halving the group along x, y, z in turn. bounds is the
+// min/max corners of the block of this process.
+void FindRegion(int rank, int numProcs, double bounds[6])
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    bounds[2 * axis] = -0.5;
+    bounds[2 * axis + 1] = 0.5;
+  }
+  int axis = 0;
+  int start = 0;
+  int end = numProcs;
+  while (end - start > 1)
+  {
+    int middle = (start + end) / 2;
+    double cut = bounds[2 * axis] +
+      (bounds[2 * axis + 1] - bounds[2 * axis]) * (middle - start) / (end - start);
+    if (rank < middle)
+    {
+      bounds[2 * axis + 1] = cut;
+      end = middle;
+    }
+    else
+    {
+      bounds[2 * axis] = cut;
+      start = middle;
+    }
+    axis = (axis + 1) % 3;
+  }
+}
+
+// Draw the block into image, seen along -z with an orthographic projection
+// of the unit square onto the whole image: the pixels it covers get the
+// color of the process and the depth of its front face. Without depth the
+// color is half transparent (premultiplied) for the blending mode.
+void Draw(int rank, const double bounds[6], IceTImage image)
+{
+  IceTSizeType width = icetImageGetWidth(image);
+  IceTSizeType height = icetImageGetHeight(image);
+  bool blend = icetImageGetDepthFormat(image) == ICET_IMAGE_DEPTH_NONE;
+  bool ubyte = icetImageGetColorFormat(image) == ICET_IMAGE_COLOR_RGBA_UBYTE;
+  float alpha = blend ? 0.5f : 1.0f;
+  int bits = rank % 7 + 1;
+  float color[4] = { alpha * (bits % 2), alpha * ((bits / 2) % 2), alpha * ((bits / 4) % 2),
+    alpha };
+  float depth = static_cast<float>(0.5 - 0.5 * bounds[5]);
+
+  IceTSizeType x0 = static_cast<IceTSizeType>((bounds[0] + 0.5) * width);
+  IceTSizeType x1 = static_cast<IceTSizeType>((bounds[1] + 0.5) * width);
+  IceTSizeType y0 = static_cast<IceTSizeType>((bounds[2] + 0.5) * height);
+  IceTSizeType y1 = static_cast<IceTSizeType>((bounds[3] + 0.5) * height);
+  for (IceTSizeType y = 0; y < height; y++)
+  {
+    for (IceTSizeType x = 0; x < width; x++)
+    {
+      bool inside = x >= x0 && x < x1 && y >= y0 && y < y1;
+      IceTSizeType pixel = y * width + x;
+      if (ubyte)
+      {
+        IceTUByte* dest = icetImageGetColorub(image) + 4 * pixel;
+        for (int c = 0; c < 4; c++)
+        {
+          dest[c] = inside ? static_cast<IceTUByte>(color[c] * 255) : 0;
+        }
+      }
+      else
+      {
+        IceTFloat* dest = icetImageGetColorf(image) + 4 * pixel;
+        for (int c = 0; c < 4; c++)
+        {
+          dest[c] = inside ? color[c] : 0.0f;
+        }
+      }
+      if (!blend)
+      {
+        icetImageGetDepthf(image)[pixel] = inside ? depth : 1.0f;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Composite the frames of one configuration on comm, the processes of
+// MPI_COMM_WORLD outside of it pass ICET_COMM_NULL and only take part in
+// the reduction of the results.
+Result Composite(IceTCommunicator comm, const Configuration& c, const Options& options)
+{
+  Result result;
+  double local[NumberOfPhases + 2] = {};
+  if (comm != ICET_COMM_NULL)
+  {
+    IceTContext context = icetCreateContext(comm);
+    int rank = comm->Comm_rank(comm);
+    int numProcs = comm->Comm_size(comm);
+
+    bool blend = c.DepthFormat == "none";
+    icetCompositeMode(blend ? ICET_COMPOSITE_MODE_BLEND : ICET_COMPOSITE_MODE_Z_BUFFER);
+    icetSetColorFormat(Lookup(ColorFormats, c.ColorFormat, "color format"));
+    icetSetDepthFormat(Lookup(DepthFormats, c.DepthFormat, "depth format"));
+    icetStrategy(Lookup(Strategies, c.Strategy, "strategy"));
+    icetSingleImageStrategy(
+      Lookup(SingleImageStrategies, c.SingleImageStrategy, "single image strategy"));
+    icetEnable(ICET_INTERLACE_IMAGES);
+    icetEnable(ICET_COLLECT_IMAGES);
+
+    icetResetTiles();
+    for (int y = 0; y < c.TilesY; y++)
+    {
+      for (int x = 0; x < c.TilesX; x++)
+      {
+        icetAddTile(x * c.Width, y * c.Height, c.Width, c.Height, y * c.TilesX + x);
+      }
+    }
+
+    double bounds[6];
+    FindRegion(rank, numProcs, bounds);
+    icetBoundingBoxd(bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5]);
+    IceTDouble projection[16];
+    IceTDouble modelview[16];
+    icetMatrixOrtho(-0.5, 0.5, -0.5, 0.5, -1.0, 1.0, projection);
+    icetMatrixIdentity(modelview);
+    IceTFloat background[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    IceTInt viewport[4];
+    icetGetIntegerv(ICET_GLOBAL_VIEWPORT, viewport);
+    std::vector<char> buffer(icetImageBufferSize(viewport[2], viewport[3]));
+    IceTImage image = icetImageAssignBuffer(buffer.data(), viewport[2], viewport[3]);
+    Draw(rank, bounds, image);
+    const IceTVoid* colors = icetImageGetColorConstVoid(image, NULL);
+    const IceTVoid* depths = blend ? NULL : icetImageGetDepthConstVoid(image, NULL);
+
+    double start = 0;
+    for (int frame = 0; frame < options.Warmup + options.Frames; frame++)
+    {
+      if (frame == options.Warmup)
+      {
+        icetCommBarrier();
+        start = Now();
+      }
+      icetCompositeImage(colors, depths, NULL, projection, modelview, background);
+      if (frame >= options.Warmup)
+      {
+        for (int p = 0; p < NumberOfPhases; p++)
+        {
+          IceTDouble seconds;
+          icetGetDoublev(Phases[p].Value, &seconds);
+          local[p] += seconds / options.Frames;
+        }
+        IceTInt bytes;
+        icetGetIntegerv(ICET_BYTES_SENT, &bytes);
+        local[NumberOfPhases + 1] += static_cast<double>(bytes) / options.Frames;
+      }
+    }
+    icetCommBarrier();
+    local[NumberOfPhases] = Now() - start;
+    icetDestroyContext(context);
+  }
+
+  double slowest[NumberOfPhases + 1];
+  double bytes = 0;
+  MPI_Reduce(local, slowest, NumberOfPhases + 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&local[NumberOfPhases + 1], &bytes, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  std::copy(slowest, slowest + NumberOfPhases, result.Phases);
+  double elapsed = slowest[NumberOfPhases];
+  result.FramesPerSecond = elapsed > 0 ? options.Frames / elapsed : 0;
+  result.BytesSent = bytes;
+  return result;
+}
+
+// IceT communicator of the first numProcs processes, ICET_COMM_NULL on the
+// others. Destroying it frees the MoNA or MPI communicator underneath.
+IceTCommunicator CreateCommunicator(
+  const std::string& backend, mona_instance_t mona, mona_comm_t world, int numProcs)
+{
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (backend == "mona")
+  {
+    if (rank >= numProcs)
+    {
+      return ICET_COMM_NULL;
+    }
+    std::vector<int> ranks(numProcs);
+    for (int i = 0; i < numProcs; i++)
+    {
+      ranks[i] = i;
+    }
+    mona_comm_t comm;
+    if (mona_comm_subset(world, ranks.data(), numProcs, &comm) != NA_SUCCESS)
+    {
+      throw std::runtime_error("failed to create a mona sub-communicator");
+    }
+    return icetCreateMonaCommunicator(comm, mona);
+  }
+  MPI_Comm comm;
+  MPI_Comm_split(MPI_COMM_WORLD, rank < numProcs ? 0 : MPI_UNDEFINED, rank, &comm);
+  if (comm == MPI_COMM_NULL)
+  {
+    return ICET_COMM_NULL;
+  }
+  IceTCommunicator icetComm = icetCreateMPICommunicator(comm);
+  MPI_Comm_free(&comm);
+  return icetComm;
+}
+
+void DestroyCommunicator(const std::string& backend, IceTCommunicator comm)
+{
+  if (comm == ICET_COMM_NULL)
+  {
+    return;
+  }
+  if (backend == "mona")
+  {
+    icetDestroyMonaCommunicator(comm);
+  }
+  else
+  {
+    icetDestroyMPICommunicator(comm);
+  }
+}
+
+//----------------------------------------------------------------------------
+void Run(const std::string& backend, mona_instance_t mona, mona_comm_t monaWorld,
+  const Options& options, std::ostream* csv)
+{
+  int worldSize, worldRank;
+  MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+  MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+  // like mona-vtk-bench, on the first 2, 4, ... processes and on all of them
+  std::vector<int> processCounts;
+  for (int n = 2; n < worldSize; n *= 2)
+  {
+    processCounts.push_back(n);
+  }
+  processCounts.push_back(worldSize);
+
+  std::vector<Configuration> configurations = Sweep(options);
+  for (int numProcs : processCounts)
+  {
+    IceTCommunicator comm = CreateCommunicator(backend, mona, monaWorld, numProcs);
+    if (worldRank == 0)
+    {
+      std::cout << "\n# mona-vtk-icet-bench (" << backend << ", " << numProcs
+                << " processes)\n"
+                << std::left << std::setw(12) << "# Strategy" << std::setw(12) << "Single"
+                << std::setw(8) << "Tiles" << std::setw(12) << "Size" << std::setw(14)
+                << "Format" << std::setw(10) << "FPS" << std::setw(16) << "Composite(ms)"
+                << std::setw(14) << "Collect(ms)" << "\n";
+    }
+    for (const Configuration& c : configurations)
+    {
+      if (c.TilesX * c.TilesY > numProcs)
+      {
+        continue;
+      }
+      Result result = Composite(comm, c, options);
+      if (worldRank != 0)
+      {
+        continue;
+      }
+      std::string tiles = std::to_string(c.TilesX) + "x" + std::to_string(c.TilesY);
+      std::string size = std::to_string(c.Width) + "x" + std::to_string(c.Height);
+      std::string format = c.ColorFormat + "/" + c.DepthFormat;
+      std::cout << std::left << std::setw(12) << c.Strategy << std::setw(12)
+                << c.SingleImageStrategy << std::setw(8) << tiles << std::setw(12) << size
+                << std::setw(14) << format << std::fixed << std::setprecision(2)
+                << std::setw(10) << result.FramesPerSecond << std::setw(16)
+                << result.Phases[CompositePhase] * 1e3 << std::setw(14)
+                << result.Phases[CollectPhase] * 1e3 << "\n";
+      std::cout.unsetf(std::ios::fixed);
+      if (csv)
+      {
+        *csv << backend << "," << numProcs << "," << c.Strategy << "," << c.SingleImageStrategy
+             << "," << tiles << "," << size << "," << c.ColorFormat << "," << c.DepthFormat
+             << "," << options.Frames << "," << result.FramesPerSecond;
+        for (double seconds : result.Phases)
+        {
+          *csv << "," << seconds * 1e3;
+        }
+        *csv << "," << result.BytesSent << "\n";
+      }
+    }
+    DestroyCommunicator(backend, comm);
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+}
+
+void Usage(const char* program)
+{
+  Bench::Usage(program,
+    "  -s strategies  comma separated list of direct,sequential,split,reduce,vtree\n"
+    "                 (default reduce)\n"
+    "  -S strategies  single image strategies among automatic,bswap,tree,radixk,\n"
+    "                 radixkr (default automatic,bswap,radixk,tree)\n"
+    "  -T layouts     tile layouts, e.g. 1x1,2x2 (default 1x1)\n"
+    "  -r sizes       tile sizes, e.g. 1024x768,1920x1080 (default 1024x768)\n"
+    "  -f formats     color/depth formats, color among ubyte,float and depth\n"
+    "                 among float,none (blending) (default ubyte/float)\n"
+    "  -n frames      timed frames per configuration (default 20)\n"
+    "  -w frames      warmup frames per configuration (default 2)\n");
+}
+
+} // END namespace
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, BENCH_COMMON_OPTSTRING "s:S:T:r:f:n:w:")) != -1)
+  {
+    if (Bench::ParseCommonOption(opt, optarg, options))
+    {
+      continue;
+    }
+    switch (opt)
+    {
+      case 's':
+        options.Strategies = optarg;
+        break;
+      case 'S':
+        options.SingleImageStrategies = optarg;
+        break;
+      case 'T':
+        options.Tiles = optarg;
+        break;
+      case 'r':
+        options.Sizes = optarg;
+        break;
+      case 'f':
+        options.Formats = optarg;
+        break;
+      case 'n':
+        options.Frames = std::max(std::stoi(optarg), 1);
+        break;
+      case 'w':
+        options.Warmup = std::max(std::stoi(optarg), 0);
+        break;
+      default:
+        if (rank == 0)
+        {
+          Usage(argv[0]);
+        }
+        MPI_Finalize();
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  std::ofstream csvFile;
+  std::ostream* csv = nullptr;
+  if (rank == 0 && !options.CSVFile.empty())
+  {
+    csvFile.open(options.CSVFile);
+    csvFile << "backend,processes,strategy,single_image_strategy,tiles,size,color_format,"
+               "depth_format,frames,fps";
+    for (const NamedEnum& phase : Phases)
+    {
+      csvFile << "," << phase.Name << "_ms";
+    }
+    csvFile << ",bytes_sent\n";
+    csv = &csvFile;
+  }
+
+  if (Bench::Contains(options.Backends, "mona"))
+  {
+    ABT_init(0, NULL);
+    mona_instance_t mona = mona_init(options.Transport.c_str(), NA_TRUE, NULL);
+    if (!mona)
+    {
+      throw std::runtime_error("failed to initialize mona with " + options.Transport);
+    }
+    mona_comm_t monaComm = Bench::CreateMonaComm(mona);
+    Run("mona", mona, monaComm, options, csv);
+    mona_comm_free(monaComm);
+    mona_finalize(mona);
+    ABT_finalize();
+  }
+
+  if (Bench::Contains(options.Backends, "mpi"))
+  {
+    Run("mpi", nullptr, nullptr, options, csv);
+  }
+
+  MPI_Finalize();
+  return 0;
+}
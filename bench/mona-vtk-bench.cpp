@@ -0,0 +1,504 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+// Communication microbenchmarks of mona-vtk. The same benchmarks (in the
+// spirit of the OSU micro-benchmarks) are run on a MonaController and on a
+// vtkMPIController, for a sweep of message sizes and of process counts, and
+// printed as OSU-style tables and optionally as CSV.
+//
+// mpirun -n 4 ./mona-vtk-bench -t na+sm -o results.csv
+#include "bench-common.hpp"
+
+#include <MonaController.hpp>
+
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
+#include <vtkMPICommunicator.h>
+#include <vtkMPIController.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkProcessGroup.h>
+
+#include <mona-coll.h>
+#include <mona.h>
+#include <mpi.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define BENCH_TAG 4217
+// messages above this size run a tenth of the iterations, like the OSU
+// benchmarks do
+#define BENCH_LARGE_MESSAGE (64 * 1024)
+#define BENCH_WINDOW_SIZE 64
+
+namespace
+{
+
+struct Options : Bench::CommonOptions
+{
+  std::string Benchmarks =
+    "latency,bandwidth,broadcast,gather,allgather,reduce,allreduce,dataobject";
+  size_t MinSize = 1;
+  size_t MaxSize = 4 * 1024 * 1024;
+  int Iterations = 1000;
+  int Warmup = 10;
+};
+
+struct Result
+{
+  double Average = 0; // microseconds per iteration
+  double Min = 0;
+  double Max = 0;
+  double Bandwidth = 0; // MB/s, for the bandwidth benchmark only
+};
+
+// Request types of the two controllers, for the non-blocking sends
+template <typename ControllerT>
+struct RequestOf;
+
+template <>
+struct RequestOf<MonaController>
+{
+  typedef MonaCommunicator::Request Type;
+};
+
+template <>
+struct RequestOf<vtkMPIController>
+{
+  typedef vtkMPICommunicator::Request Type;
+};
+
+double Now()
+{
+  return std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+int IterationsFor(const Options& options, size_t size)
+{
+  return size > BENCH_LARGE_MESSAGE ? std::max(options.Iterations / 10, 1) : options.Iterations;
+}
+
+// Average, min and max over the processes of the per-iteration time of
+// each process.
+template <typename ControllerT>
+Result Summarize(ControllerT* controller, double elapsed, int iterations)
+{
+  double local = elapsed / iterations;
+  double sum = 0, min = 0, max = 0;
+  controller->Reduce(&local, &sum, 1, vtkCommunicator::SUM_OP, 0);
+  controller->Reduce(&local, &min, 1, vtkCommunicator::MIN_OP, 0);
+  controller->Reduce(&local, &max, 1, vtkCommunicator::MAX_OP, 0);
+  Result result;
+  result.Average = sum / controller->GetNumberOfProcesses();
+  result.Min = min;
+  result.Max = max;
+  return result;
+}
+
+//----------------------------------------------------------------------------
+// Ping-pong between processes 0 and 1, half the round trip.
+template <typename ControllerT>
+Result Latency(ControllerT* controller, size_t size, const Options& options)
+{
+  std::vector<char> buffer(size, 'a');
+  int rank = controller->GetLocalProcessId();
+  int iterations = IterationsFor(options, size);
+  double start = 0;
+  for (int i = 0; i < options.Warmup + iterations; i++)
+  {
+    if (i == options.Warmup)
+    {
+      controller->Barrier();
+      start = Now();
+    }
+    if (rank == 0)
+    {
+      controller->Send(buffer.data(), size, 1, BENCH_TAG);
+      controller->Receive(buffer.data(), size, 1, BENCH_TAG);
+    }
+    else if (rank == 1)
+    {
+      controller->Receive(buffer.data(), size, 0, BENCH_TAG);
+      controller->Send(buffer.data(), size, 0, BENCH_TAG);
+    }
+  }
+  Result result;
+  result.Average = result.Min = result.Max = (Now() - start) / (2.0 * iterations);
+  return result;
+}
+
+//----------------------------------------------------------------------------
+// Process 0 streams windows of non-blocking sends to process 1, which
+// acknowledges each window.
+template <typename ControllerT>
+Result Bandwidth(ControllerT* controller, size_t size, const Options& options)
+{
+  typedef typename RequestOf<ControllerT>::Type RequestT;
+  // like in the OSU benchmark, the messages of a window share one buffer
+  std::vector<char> buffer(size, 'a');
+  std::vector<RequestT> requests(BENCH_WINDOW_SIZE);
+  int rank = controller->GetLocalProcessId();
+  int iterations = std::max(IterationsFor(options, size) / 10, 1);
+  int ack = 0;
+  double start = 0;
+  for (int i = 0; i < options.Warmup + iterations; i++)
+  {
+    if (i == options.Warmup)
+    {
+      controller->Barrier();
+      start = Now();
+    }
+    if (rank == 0)
+    {
+      for (int w = 0; w < BENCH_WINDOW_SIZE; w++)
+      {
+        controller->NoBlockSend(
+          buffer.data(), static_cast<int>(size), 1, BENCH_TAG, requests[w]);
+      }
+      controller->WaitAll(BENCH_WINDOW_SIZE, requests.data());
+      controller->Receive(&ack, 1, 1, BENCH_TAG);
+    }
+    else if (rank == 1)
+    {
+      for (int w = 0; w < BENCH_WINDOW_SIZE; w++)
+      {
+        controller->NoBlockReceive(
+          buffer.data(), static_cast<int>(size), 0, BENCH_TAG, requests[w]);
+      }
+      controller->WaitAll(BENCH_WINDOW_SIZE, requests.data());
+      controller->Send(&ack, 1, 0, BENCH_TAG);
+    }
+  }
+  double elapsed = Now() - start;
+  Result result;
+  result.Average = result.Min = result.Max = elapsed / (iterations * BENCH_WINDOW_SIZE);
+  result.Bandwidth = static_cast<double>(size) * iterations * BENCH_WINDOW_SIZE / elapsed;
+  return result;
+}
+
+//----------------------------------------------------------------------------
+// The collectives, timed on every process.
+template <typename ControllerT, typename Operation>
+Result Collective(ControllerT* controller, size_t size, const Options& options, Operation op)
+{
+  int iterations = IterationsFor(options, size);
+  double start = 0;
+  for (int i = 0; i < options.Warmup + iterations; i++)
+  {
+    if (i == options.Warmup)
+    {
+      controller->Barrier();
+      start = Now();
+    }
+    op();
+  }
+  return Summarize(controller, Now() - start, iterations);
+}
+
+template <typename ControllerT>
+Result Broadcast(ControllerT* controller, size_t size, const Options& options)
+{
+  std::vector<char> buffer(size, 'a');
+  return Collective(controller, size, options,
+    [&]() { controller->Broadcast(buffer.data(), static_cast<vtkIdType>(size), 0); });
+}
+
+template <typename ControllerT>
+Result Gather(ControllerT* controller, size_t size, const Options& options)
+{
+  std::vector<char> send(size, 'a');
+  std::vector<char> recv(
+    controller->GetLocalProcessId() == 0 ? size * controller->GetNumberOfProcesses() : 1);
+  return Collective(controller, size, options, [&]() {
+    controller->Gather(send.data(), recv.data(), static_cast<vtkIdType>(size), 0);
+  });
+}
+
+template <typename ControllerT>
+Result AllGather(ControllerT* controller, size_t size, const Options& options)
+{
+  std::vector<char> send(size, 'a');
+  std::vector<char> recv(size * controller->GetNumberOfProcesses());
+  return Collective(controller, size, options, [&]() {
+    controller->AllGather(send.data(), recv.data(), static_cast<vtkIdType>(size));
+  });
+}
+
+// the reductions work on doubles, size is rounded down to a multiple of 8
+template <typename ControllerT>
+Result Reduce(ControllerT* controller, size_t size, const Options& options)
+{
+  vtkIdType count = std::max<vtkIdType>(size / sizeof(double), 1);
+  std::vector<double> send(count, 1.0);
+  std::vector<double> recv(count);
+  return Collective(controller, size, options, [&]() {
+    controller->Reduce(send.data(), recv.data(), count, vtkCommunicator::SUM_OP, 0);
+  });
+}
+
+template <typename ControllerT>
+Result AllReduce(ControllerT* controller, size_t size, const Options& options)
+{
+  vtkIdType count = std::max<vtkIdType>(size / sizeof(double), 1);
+  std::vector<double> send(count, 1.0);
+  std::vector<double> recv(count);
+  return Collective(controller, size, options, [&]() {
+    controller->AllReduce(send.data(), recv.data(), count, vtkCommunicator::SUM_OP);
+  });
+}
+
+//----------------------------------------------------------------------------
+// Ping-pong of a vtkImageData carrying one double point array of the given
+// size, half the round trip.
+template <typename ControllerT>
+Result DataObject(ControllerT* controller, size_t size, const Options& options)
+{
+  vtkIdType count = std::max<vtkIdType>(size / sizeof(double), 1);
+  vtkNew<vtkImageData> image;
+  image->SetDimensions(static_cast<int>(count), 1, 1);
+  vtkNew<vtkDoubleArray> array;
+  array->SetName("values");
+  array->SetNumberOfTuples(count);
+  array->FillValue(1.0);
+  image->GetPointData()->AddArray(array);
+  vtkNew<vtkImageData> received;
+
+  int rank = controller->GetLocalProcessId();
+  int iterations = IterationsFor(options, size);
+  double start = 0;
+  for (int i = 0; i < options.Warmup + iterations; i++)
+  {
+    if (i == options.Warmup)
+    {
+      controller->Barrier();
+      start = Now();
+    }
+    if (rank == 0)
+    {
+      controller->Send(image, 1, BENCH_TAG);
+      controller->Receive(received, 1, BENCH_TAG);
+    }
+    else if (rank == 1)
+    {
+      controller->Receive(received, 0, BENCH_TAG);
+      controller->Send(received, 0, BENCH_TAG);
+    }
+  }
+  Result result;
+  result.Average = result.Min = result.Max = (Now() - start) / (2.0 * iterations);
+  return result;
+}
+
+//----------------------------------------------------------------------------
+template <typename ControllerT>
+void Run(ControllerT* world, const char* backend, const Options& options, std::ostream* csv)
+{
+  typedef Result (*Benchmark)(ControllerT*, size_t, const Options&);
+  struct Entry
+  {
+    const char* Name;
+    Benchmark Function;
+    bool PointToPoint;
+  };
+  const Entry entries[] = { { "latency", &Latency<ControllerT>, true },
+    { "bandwidth", &Bandwidth<ControllerT>, true },
+    { "broadcast", &Broadcast<ControllerT>, false }, { "gather", &Gather<ControllerT>, false },
+    { "allgather", &AllGather<ControllerT>, false }, { "reduce", &Reduce<ControllerT>, false },
+    { "allreduce", &AllReduce<ControllerT>, false },
+    { "dataobject", &DataObject<ControllerT>, true } };
+
+  int worldSize = world->GetNumberOfProcesses();
+  int worldRank = world->GetLocalProcessId();
+
+  // the point-to-point benchmarks only involve 2 processes, the collectives
+  // run on the first 2, 4, ... processes and on all of them
+  std::vector<int> processCounts;
+  for (int n = 2; n < worldSize; n *= 2)
+  {
+    processCounts.push_back(n);
+  }
+  processCounts.push_back(worldSize);
+
+  for (const Entry& entry : entries)
+  {
+    if (!Bench::Contains(options.Benchmarks, entry.Name))
+    {
+      continue;
+    }
+    for (int numProcs : processCounts)
+    {
+      if (entry.PointToPoint && numProcs != std::min(2, worldSize))
+      {
+        continue;
+      }
+      if (entry.PointToPoint && worldSize < 2)
+      {
+        continue;
+      }
+      vtkNew<vtkProcessGroup> group;
+      group->Initialize(world);
+      group->RemoveAllProcessIds();
+      for (int i = 0; i < numProcs; i++)
+      {
+        group->AddProcessId(i);
+      }
+      ControllerT* controller = world->CreateSubController(group);
+      if (controller)
+      {
+        if (worldRank == 0)
+        {
+          std::cout << "\n# mona-vtk-bench " << entry.Name << " (" << backend << ", "
+                    << numProcs << " processes)\n";
+          if (std::string(entry.Name) == "bandwidth")
+          {
+            std::cout << std::left << std::setw(12) << "# Size" << std::setw(20)
+                      << "Bandwidth (MB/s)" << "\n";
+          }
+          else
+          {
+            std::cout << std::left << std::setw(12) << "# Size" << std::setw(20)
+                      << "Avg Latency(us)" << std::setw(20) << "Min Latency(us)"
+                      << std::setw(20) << "Max Latency(us)" << "\n";
+          }
+        }
+        for (size_t size = options.MinSize; size <= options.MaxSize; size *= 2)
+        {
+          Result result = entry.Function(controller, size, options);
+          if (worldRank == 0)
+          {
+            std::cout << std::left << std::setw(12) << size << std::fixed
+                      << std::setprecision(2);
+            if (std::string(entry.Name) == "bandwidth")
+            {
+              std::cout << std::setw(20) << result.Bandwidth << "\n";
+            }
+            else
+            {
+              std::cout << std::setw(20) << result.Average << std::setw(20) << result.Min
+                        << std::setw(20) << result.Max << "\n";
+            }
+            std::cout.unsetf(std::ios::fixed);
+            if (csv)
+            {
+              *csv << backend << "," << entry.Name << "," << numProcs << "," << size << ","
+                   << result.Average << "," << result.Min << "," << result.Max << ","
+                   << result.Bandwidth << "," << IterationsFor(options, size) << "\n";
+            }
+          }
+        }
+        controller->Delete();
+      }
+      world->Barrier();
+    }
+  }
+}
+
+void Usage(const char* program)
+{
+  Bench::Usage(program,
+    "  -b benchmarks  comma separated list of latency,bandwidth,broadcast,gather,\n"
+    "                 allgather,reduce,allreduce,dataobject (default all)\n"
+    "  -m bytes       smallest message size (default 1)\n"
+    "  -M bytes       largest message size (default 4194304)\n"
+    "  -i iterations  iterations per size, a tenth above 64 KiB (default 1000)\n"
+    "  -w iterations  warmup iterations per size (default 10)\n");
+}
+
+} // END namespace
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, BENCH_COMMON_OPTSTRING "b:m:M:i:w:")) != -1)
+  {
+    if (Bench::ParseCommonOption(opt, optarg, options))
+    {
+      continue;
+    }
+    switch (opt)
+    {
+      case 'b':
+        options.Benchmarks = optarg;
+        break;
+      case 'm':
+        options.MinSize = std::max(std::stoul(optarg), 1ul);
+        break;
+      case 'M':
+        options.MaxSize = std::stoul(optarg);
+        break;
+      case 'i':
+        options.Iterations = std::max(std::stoi(optarg), 1);
+        break;
+      case 'w':
+        options.Warmup = std::max(std::stoi(optarg), 0);
+        break;
+      default:
+        if (rank == 0)
+        {
+          Usage(argv[0]);
+        }
+        MPI_Finalize();
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  std::ofstream csvFile;
+  std::ostream* csv = nullptr;
+  if (rank == 0 && !options.CSVFile.empty())
+  {
+    csvFile.open(options.CSVFile);
+    csvFile << "backend,benchmark,processes,bytes,avg_us,min_us,max_us,bandwidth_mb_s,"
+               "iterations\n";
+    csv = &csvFile;
+  }
+
+  if (Bench::Contains(options.Backends, "mona"))
+  {
+    ABT_init(0, NULL);
+    mona_instance_t mona = mona_init(options.Transport.c_str(), NA_TRUE, NULL);
+    if (!mona)
+    {
+      throw std::runtime_error("failed to initialize mona with " + options.Transport);
+    }
+    mona_comm_t monaComm = Bench::CreateMonaComm(mona);
+    MonaController* controller = MonaController::New();
+    controller->Initialize(monaComm);
+    Run(controller, "mona", options, csv);
+    controller->Finalize();
+    controller->Delete();
+    mona_comm_free(monaComm);
+    mona_finalize(mona);
+    ABT_finalize();
+  }
+
+  if (Bench::Contains(options.Backends, "mpi"))
+  {
+    vtkMPIController* controller = vtkMPIController::New();
+    controller->Initialize(&argc, &argv, 1);
+    Run(controller, "mpi", options, csv);
+    controller->Finalize(1);
+    controller->Delete();
+  }
+
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,15 @@
+#!/bin/bash
+# Run mona-vtk-bench on the local node for a few process counts, to catch
+# performance regressions before going to a cluster.
+#
+# usage: run-local.sh [path/to/mona-vtk-bench] [transport] [max processes]
+BENCH=${1:-./bench/mona-vtk-bench}
+TRANSPORT=${2:-na+sm}
+MAXPROCS=${3:-8}
+MPIRUN=${MPIRUN:-mpirun}
+
+NPROCS=2
+while [ $NPROCS -le $MAXPROCS ]; do
+  $MPIRUN -n $NPROCS $BENCH -t $TRANSPORT -o bench_${TRANSPORT}_${NPROCS}.csv
+  NPROCS=$((NPROCS * 2))
+done
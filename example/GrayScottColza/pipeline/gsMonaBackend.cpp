@@ -5,6 +5,7 @@
  */
 #include "gsMonaBackend.hpp"
 #include "gsMonaInSituAdaptor.hpp"
+#include <MonaTrace.hpp>
 #include <iostream>
 #include <memory> // We need to include this for shared_ptr
 
@@ -55,6 +56,8 @@ void MonaBackendPipeline::abort(uint64_t iteration)
 colza::RequestResult<int32_t> MonaBackendPipeline::execute(uint64_t iteration)
 {
   std::cout << " gs pipeline execute iteration " << iteration << std::endl;
+  static const int traceEvent = MonaTrace::RegisterEvent("execute", "colza");
+  MonaTrace::Scope trace(traceEvent);
 
   // when the mona is updated, init and reset
   // otherwise, do not reset
@@ -145,6 +148,8 @@ colza::RequestResult<int32_t> MonaBackendPipeline::stage(const std::string& send
   const std::vector<size_t>& dimensions, const std::vector<int64_t>& offsets,
   const colza::Type& type, const thallium::bulk& data)
 {
+  static const int traceEvent = MonaTrace::RegisterEvent("stage", "colza");
+  MonaTrace::Scope trace(traceEvent);
   colza::RequestResult<int32_t> result;
   result.value() = 0;
   {
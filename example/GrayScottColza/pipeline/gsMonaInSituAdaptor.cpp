@@ -35,6 +35,9 @@
 #include <vtkWindowToImageFilter.h>
 
 #include <MonaController.hpp>
+#include <MonaEventLog.hpp>
+#include <MonaTrace.hpp>
+#include <cstdlib>
 #include <iostream>
 
 #ifdef DEBUG_BUILD
@@ -236,6 +239,12 @@ void MonaUpdateController(mona_comm_t mona_comm)
           MonaController::SafeDownCast(vtkMultiProcessController::GetGlobalController()))
     {
       controller->SetCommunicator(monaCommunicator);
+      // the processes changed, align the clocks of the trace again
+      const char* traceFile = getenv("MONA_VTK_TRACE");
+      if (traceFile && *traceFile)
+      {
+        MonaEventLog::InitializeLogging(controller);
+      }
     }
     else
     {
@@ -261,6 +270,9 @@ void MonaCoProcessList(
     vtkCPInputDataDescription* idd = dataDescription->GetInputDescriptionByName("input");
     BuildVTKDataStructuresList(dataBlockList, idd);
     idd->SetGrid(VTKGrid);
+    // the python pipeline renders here
+    static const int traceEvent = MonaTrace::RegisterEvent("coprocess", "catalyst");
+    MonaTrace::Scope trace(traceEvent);
     Processor->CoProcess(dataDescription.GetPointer());
   }
 }
@@ -6,6 +6,7 @@
 #include "MonaBackend.hpp"
 #include "../MonaInSituAdaptor.hpp"
 #include "../mb.hpp"
+#include "MonaTags.hpp"
 #include <cstdlib>
 #include <iostream>
 #include <spdlog/spdlog.h>
@@ -13,8 +14,9 @@
 
 COLZA_REGISTER_BACKEND(monabackend, MonaBackendPipeline);
 
-#define MONA_BACKEND_BARRIER_TAG 2051
-#define MONA_BACKEND_ALLREDUCE_TAG 2052
+// collectives on m_mona_comm take their tags from the application space of
+// the communicator's tag sequence
+#define MONA_BACKEND_COLLECTIVE_TAG(comm) MonaTags::NextCollectiveTag(comm, MonaTags::Application)
 
 // this function is called by colza framework when the pipeline is created
 // this function is also called when there is join or leave of the processes
@@ -63,6 +65,9 @@ colza::RequestResult<int32_t> MonaBackendPipeline::start(uint64_t iteration)
     spdlog::trace("{}: Need to create a MoNA communicator", __FUNCTION__);
     if (m_mona_comm)
     {
+      // the tag sequences are keyed by handle, a new communicator may get
+      // the same address on some ranks only
+      MonaTags::Release(m_mona_comm);
       mona_comm_free(m_mona_comm);
     }
     na_return_t ret =
@@ -89,7 +94,11 @@ void MonaBackendPipeline::abort(uint64_t iteration)
   // free the communicator
   {
     std::lock_guard<tl::mutex> g_comm(m_mona_comm_mtx);
-    mona_comm_free(m_mona_comm);
+    if (m_mona_comm)
+    {
+      MonaTags::Release(m_mona_comm);
+      mona_comm_free(m_mona_comm);
+    }
     m_mona_comm = nullptr;
     m_need_reset = true;
   }
@@ -117,9 +126,27 @@ colza::RequestResult<int32_t> MonaBackendPipeline::execute(uint64_t iteration)
     throw std::runtime_error("Empty script name");
   }
 
+  // start reducing the total block number, it completes in the background
+  // while the controller is (re)initialized
+  int localBlocks = m_datasets[iteration]["mydata"].size();
+  mona_request_t blockReq = MONA_REQUEST_NULL;
+  na_return_t ret = mona_comm_iallreduce(
+    m_mona_comm, &localBlocks, &totalBlock, sizeof(int), 1,
+    [](const void* in, void* out, na_size_t, na_size_t, void*) {
+      const int* a = static_cast<const int*>(in);
+      int* b = static_cast<int*>(out);
+      *b += *a;
+    },
+    nullptr, MONA_BACKEND_COLLECTIVE_TAG(m_mona_comm), &blockReq);
+  if (ret != NA_SUCCESS)
+  {
+    spdlog::critical("{}: mona_comm_iallreduce returned {}", __FUNCTION__, ret);
+    throw std::runtime_error("mona_comm_iallreduce failed");
+  }
+
   // this may takes long time for first step
   // make sure all servers do same things
-  mona_comm_barrier(m_mona_comm, MONA_BACKEND_BARRIER_TAG);
+  mona_comm_barrier(m_mona_comm, MONA_BACKEND_COLLECTIVE_TAG(m_mona_comm));
   spdlog::trace("{}: After barrier", __FUNCTION__);
 
   if (m_first_init)
@@ -153,16 +180,13 @@ colza::RequestResult<int32_t> MonaBackendPipeline::execute(uint64_t iteration)
   size_t maxID = 0;
   std::vector<Mandelbulb> MandelbulbList;
 
-  int localBlocks = m_datasets[iteration]["mydata"].size();
   // std::cout << "local blocks is " << localBlocks << std::endl;
-  mona_comm_allreduce(
-    m_mona_comm, &localBlocks, &totalBlock, sizeof(int), 1,
-    [](const void* in, void* out, na_size_t, na_size_t, void*) {
-      const int* a = static_cast<const int*>(in);
-      int* b = static_cast<int*>(out);
-      *b += *a;
-    },
-    nullptr, MONA_BACKEND_ALLREDUCE_TAG);
+  ret = mona_wait(blockReq);
+  if (ret != NA_SUCCESS)
+  {
+    spdlog::critical("{}: mona_wait on the block count returned {}", __FUNCTION__, ret);
+    throw std::runtime_error("mona_comm_iallreduce failed");
+  }
   spdlog::trace(
     "{}: After AllReduce, localBlocks={}, totalBlocks={}", __FUNCTION__, localBlocks, totalBlock);
 
@@ -188,7 +212,7 @@ colza::RequestResult<int32_t> MonaBackendPipeline::execute(uint64_t iteration)
     "{}: About to call InSitu::MonaCoProcessDynamic with iteration={}", __FUNCTION__, iteration);
   // process the insitu function for the MandelbulbList
   // the controller is updated in the MonaUpdateController
-  mona_comm_barrier(m_mona_comm, MONA_BACKEND_BARRIER_TAG);
+  mona_comm_barrier(m_mona_comm, MONA_BACKEND_COLLECTIVE_TAG(m_mona_comm));
   InSitu::MonaCoProcessDynamic(MandelbulbList, totalBlock, iteration, iteration);
 
   spdlog::trace("{}: Done with InSitu::MonaCoProcessDynamic", __FUNCTION__);
@@ -0,0 +1,215 @@
+// Check the collective algorithms of mona-vtk against the plain MoNA
+// collectives on the same communicator: the recursive doubling and ring
+// allreduce and the pipelined broadcast of MonaCommunicator, and the
+// recursive doubling/ring allgather and Bruck/pairwise alltoall of the IceT
+// bridge. Each one is run with sizes on both sides of the thresholds that
+// select the algorithm; the CMake tests run it on odd, even and power of two
+// numbers of ranks (the alltoall algorithms need at least 8 of them).
+#include <MonaController.hpp>
+#include <MonaTags.hpp>
+#include <icet/mona.hpp>
+
+#include "mpi.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+// as in src/icet/mona.cpp
+#ifndef ICET_IN_PLACE_COLLECT
+#define ICET_IN_PLACE_COLLECT ((void*)(-1))
+#endif
+
+// defaults of src/icet/mona.cpp, where they are compile time settings
+static const size_t AllgatherRingThreshold = 64 * 1024;
+static const size_t AlltoallBruckThreshold = 1024;
+
+// set on the communicator, small enough to test without large messages
+static const vtkIdType AllReduceRingThreshold = 4096;
+static const vtkIdType BroadcastPipelineThreshold = 16 * 1024;
+static const vtkIdType BroadcastSegmentSize = 4096;
+
+static int Failures = 0;
+
+static void Check(bool ok, int rank, const char* what, size_t size)
+{
+  if (!ok)
+  {
+    std::cerr << "rank " << rank << ": " << what << " failed for " << size << " bytes"
+              << std::endl;
+    Failures++;
+  }
+}
+
+// distinct bytes for each rank, block and size
+static void Fill(char* buffer, size_t size, int rank, int salt)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    buffer[i] = static_cast<char>(rank * 131 + i * 7 + salt);
+  }
+}
+
+static void SumInts(const void* in, void* inout, na_size_t, na_size_t count, void*)
+{
+  const int* a = static_cast<const int*>(in);
+  int* b = static_cast<int*>(inout);
+  for (na_size_t i = 0; i < count; i++)
+  {
+    b[i] += a[i];
+  }
+}
+
+static na_tag_t ReferenceTag(mona_comm_t comm)
+{
+  return MonaTags::NextCollectiveTag(comm, MonaTags::Application);
+}
+
+static void TestAllReduce(MonaCommunicator* comm, mona_comm_t monaComm, int rank, int size)
+{
+  vtkIdType ringLength = AllReduceRingThreshold / sizeof(int);
+  vtkIdType lengths[] = { 1, ringLength - 1, ringLength, ringLength + 1,
+    ringLength * size + 3 };
+  for (vtkIdType length : lengths)
+  {
+    std::vector<int> send(length), result(length), expected(length);
+    for (vtkIdType i = 0; i < length; i++)
+    {
+      send[i] = rank * 1000 + static_cast<int>(i);
+    }
+    int ok = comm->AllReduceVoidArray(
+      send.data(), result.data(), length, VTK_INT, vtkCommunicator::SUM_OP);
+    na_return_t ret = mona_comm_allreduce(monaComm, send.data(), expected.data(), sizeof(int),
+      length, SumInts, NULL, ReferenceTag(monaComm));
+    Check(ok && ret == NA_SUCCESS && result == expected, rank, "AllReduce",
+      length * sizeof(int));
+  }
+}
+
+static void TestBroadcast(MonaCommunicator* comm, mona_comm_t monaComm, int rank, int size)
+{
+  vtkIdType lengths[] = { 1, 1000, BroadcastPipelineThreshold - 1, BroadcastPipelineThreshold,
+    BroadcastPipelineThreshold + 3 * BroadcastSegmentSize + 7 };
+  for (vtkIdType length : lengths)
+  {
+    for (int root : { 0, size - 1 })
+    {
+      std::vector<char> result(length), expected(length);
+      if (rank == root)
+      {
+        Fill(result.data(), length, root, 1);
+        expected = result;
+      }
+      int ok = comm->BroadcastVoidArray(result.data(), length, VTK_CHAR, root);
+      na_return_t ret =
+        mona_comm_bcast(monaComm, expected.data(), length, root, ReferenceTag(monaComm));
+      Check(ok && ret == NA_SUCCESS && result == expected, rank, "Broadcast", length);
+    }
+  }
+}
+
+static void TestAllgather(IceTCommunicator icetComm, mona_comm_t monaComm, int rank, int size)
+{
+  size_t blocksizes[] = { 1, 1000, AllgatherRingThreshold - 1, AllgatherRingThreshold,
+    AllgatherRingThreshold + 17 };
+  for (size_t blocksize : blocksizes)
+  {
+    std::vector<char> send(blocksize), expected(blocksize * size);
+    Fill(send.data(), blocksize, rank, 2);
+    na_return_t ret = mona_comm_allgather(
+      monaComm, send.data(), blocksize, expected.data(), ReferenceTag(monaComm));
+    Check(ret == NA_SUCCESS, rank, "mona_comm_allgather", blocksize);
+
+    std::vector<char> result(blocksize * size);
+    icetComm->Allgather(icetComm, send.data(), blocksize, ICET_BYTE, result.data());
+    Check(result == expected, rank, "Allgather", blocksize);
+
+    std::vector<char> inPlace(blocksize * size);
+    memcpy(inPlace.data() + rank * blocksize, send.data(), blocksize);
+    icetComm->Allgather(icetComm, ICET_IN_PLACE_COLLECT, blocksize, ICET_BYTE, inPlace.data());
+    Check(inPlace == expected, rank, "Allgather in place", blocksize);
+  }
+}
+
+static void TestAlltoall(IceTCommunicator icetComm, mona_comm_t monaComm, int rank, int size)
+{
+  size_t blocksizes[] = { 1, 100, AlltoallBruckThreshold - 1, AlltoallBruckThreshold,
+    AlltoallBruckThreshold + 5 };
+  for (size_t blocksize : blocksizes)
+  {
+    std::vector<char> send(blocksize * size), result(blocksize * size),
+      expected(blocksize * size);
+    for (int dest = 0; dest < size; dest++)
+    {
+      Fill(send.data() + dest * blocksize, blocksize, rank, 3 + dest);
+    }
+    icetComm->Alltoall(icetComm, send.data(), blocksize, ICET_BYTE, result.data());
+    na_return_t ret = mona_comm_alltoall(
+      monaComm, send.data(), blocksize, expected.data(), ReferenceTag(monaComm));
+    Check(ret == NA_SUCCESS && result == expected, rank, "Alltoall", blocksize);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  MPI_Init(&argc, &argv);
+
+  // the MoNA communicator is made from the addresses of all the ranks
+  ABT_init(0, NULL);
+  mona_instance_t mona = mona_init("ofi+tcp", NA_TRUE, NULL);
+  na_addr_t selfAddr;
+  char selfAddrStr[128];
+  na_size_t selfAddrSize = 128;
+  if (mona_addr_self(mona, &selfAddr) != NA_SUCCESS ||
+    mona_addr_to_string(mona, selfAddrStr, &selfAddrSize, selfAddr) != NA_SUCCESS)
+  {
+    throw std::runtime_error("failed to get the mona self address");
+  }
+  int procNum;
+  MPI_Comm_size(MPI_COMM_WORLD, &procNum);
+  std::vector<char> addrStrs(128 * procNum);
+  MPI_Allgather(selfAddrStr, 128, MPI_BYTE, addrStrs.data(), 128, MPI_BYTE, MPI_COMM_WORLD);
+  std::vector<na_addr_t> addrs(procNum);
+  for (int i = 0; i < procNum; i++)
+  {
+    if (mona_addr_lookup(mona, addrStrs.data() + 128 * i, &addrs[i]) != NA_SUCCESS)
+    {
+      throw std::runtime_error("failed to look up a mona address");
+    }
+  }
+  mona_comm_t monaComm;
+  if (mona_comm_create(mona, procNum, addrs.data(), &monaComm) != NA_SUCCESS)
+  {
+    throw std::runtime_error("failed to create the mona communicator");
+  }
+
+  MonaController* controller = MonaController::New();
+  controller->Initialize(monaComm);
+  MonaCommunicator* comm = static_cast<MonaCommunicator*>(controller->GetCommunicator());
+  comm->HierarchicalCollectivesOff();
+  comm->SetAllReduceRingThreshold(AllReduceRingThreshold);
+  comm->SetBroadcastPipelineThreshold(BroadcastPipelineThreshold);
+  comm->SetBroadcastSegmentSize(BroadcastSegmentSize);
+  int rank = controller->GetLocalProcessId();
+  int size = controller->GetNumberOfProcesses();
+
+  IceTCommunicator icetComm = icetCreateMonaCommunicator(monaComm);
+
+  TestAllReduce(comm, monaComm, rank, size);
+  TestBroadcast(comm, monaComm, rank, size);
+  TestAllgather(icetComm, monaComm, rank, size);
+  TestAlltoall(icetComm, monaComm, rank, size);
+
+  int failures = 0;
+  MPI_Allreduce(&Failures, &failures, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0)
+  {
+    std::cout << size << " ranks: " << failures << " failed checks" << std::endl;
+  }
+
+  icetDestroyMonaCommunicator(icetComm);
+  controller->Delete();
+  MPI_Finalize();
+  return failures ? 1 : 0;
+}
@@ -194,7 +194,7 @@ int main(int argc, char** argv)
   //-------------------
 
   // set the icet envs
-  icetComm = icetCreateMonaCommunicator(mona_comm);
+  icetComm = icetCreateMonaCommunicator(mona_comm, mona);
   icetContext = icetCreateContext(icetComm);
   // Attention! the rank assigned by colza might different with the id assigned by the mpi
   if (rank == 0)
@@ -16,6 +16,12 @@
 
 #include "vtkSystemIncludes.h"
 
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class MonaCommunicator;
+
 
 
 class /* VTKPARALLELMPI_EXPORT */ MPICommunicatorOpaqueComm
@@ -47,13 +53,103 @@ protected:
   mona_comm_t Handle;
 };
 
+//-----------------------------------------------------------------------------
+// Payloads of at most this many bytes travel inside their envelope, so that
+// a small point-to-point message is a single MoNA message.
+#define MONA_COMM_EAGER_LIMIT 1024
+
+//-----------------------------------------------------------------------------
+// Header sent ahead of every point-to-point payload, it gives the receiver
+// the size of the payload that follows and, for payloads split into chunks,
+// the sender's chunk size and number of chunks in flight (0 when the payload
+// is a single message). Segments is the size of the piece table of a
+// multi-segment message (0 for the others), see MonaCommunicator::SendSegments.
+// A payload of at most MONA_COMM_EAGER_LIMIT bytes that is neither chunked
+// nor segmented is the Eager part of its envelope instead, only its Length
+// bytes are sent.
+struct MonaCommunicatorEnvelope
+{
+  uint64_t Magic;
+  uint64_t Length;
+  uint64_t ChunkSize;
+  uint64_t ChunksInFlight;
+  uint64_t Segments;
+  char Eager[MONA_COMM_EAGER_LIMIT];
+};
+
 //-----------------------------------------------------------------------------
 class MonaCommunicatorOpaqueRequest
 {
 public:
+  MonaCommunicatorOpaqueRequest()
+    : ReferenceCount(1)
+  {
+    this->Reset();
+  }
+
+  void Reset()
+  {
+    this->Handle = MONA_REQUEST_NULL;
+    this->EnvelopeHandle = MONA_REQUEST_NULL;
+    this->Envelope.Magic = 0;
+    this->Envelope.Length = 0;
+    this->Envelope.ChunkSize = 0;
+    this->Envelope.ChunksInFlight = 0;
+    this->Envelope.Segments = 0;
+    this->Communicator = 0;
+    this->Buffer = 0;
+    this->Capacity = 0;
+    this->Offset = 0;
+    this->Chunk = 0;
+    this->Run = 0;
+    this->RunPiece = 0;
+    this->Source = -1;
+    this->Sender = -1;
+    this->Tag = 0;
+    this->IsReceive = 0;
+    this->Persistent = 0;
+    this->State = 0;
+    this->MetricsOperation = -1;
+    this->MetricsStart = 0;
+    this->MetricsBytes = 0;
+  }
+
+  // copies of a MonaCommunicator::Request share the same opaque request
+  int ReferenceCount;
+
+  // payload transfer
   mona_request_t Handle;
+  // envelope transfer (with the payload itself when it is eager), MoNA reads
+  // or writes Envelope and Sender while it is in flight
+  mona_request_t EnvelopeHandle;
+  MonaCommunicatorEnvelope Envelope;
+
+  // message parameters, used when the payload receive can only be posted
+  // once the envelope arrived and when a persistent request is started again
+  MonaCommunicator* Communicator;
+  void* Buffer;
+  na_size_t Capacity;
+  // chunked payloads: bytes already posted and index of the next chunk
+  na_size_t Offset;
+  na_size_t Chunk;
+  // multi-segment payloads: the piece table (runs of (size, count)), the
+  // run of the next piece and how many of that run were posted
+  std::vector<std::pair<uint64_t, uint64_t> > Pieces;
+  size_t Run;
+  uint64_t RunPiece;
+  int Source;
+  int Sender;
+  int Tag;
+  int IsReceive;
+  // set up by SendInit/ReceiveInit, Start posts it again once it is done
+  int Persistent;
+  int State;
+  // MonaMetrics operation recorded when the request completes (-1 for none),
+  // when it was started and the bytes it sends
+  int MetricsOperation;
+  uint64_t MetricsStart;
+  uint64_t MetricsBytes;
 };
 
-
 #endif
 #endif // Mona_h
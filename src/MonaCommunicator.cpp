@@ -17,19 +17,45 @@
 
 #include "Mona.hpp"
 #include "MonaController.hpp"
+#include "MonaMetrics.hpp"
+#include "MonaTrace.hpp"
+#include "MonaTags.hpp"
+#include "vtkCellArray.h"
+#include "vtkCellData.h"
+#include "vtkDataArray.h"
+#include "vtkFieldData.h"
 #include "vtkImageData.h"
+#include "vtkMatrix3x3.h"
+#include "vtkNew.h"
 #include "vtkObjectFactory.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
 #include "vtkProcessGroup.h"
 #include "vtkRectilinearGrid.h"
 #include "vtkSmartPointer.h"
 #include "vtkStructuredGrid.h"
 #include "vtkToolkits.h"
 
+#include <abt.h>
 #include <spdlog/spdlog.h>
+#include <unistd.h>
 
 #define VTK_CREATE(type, name) vtkSmartPointer<type> name = vtkSmartPointer<type>::New()
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <type_traits>
 #include <vector>
 
 #ifdef DEBUG_BUILD
@@ -45,11 +71,12 @@ vtkStandardNewMacro(MonaCommunicator);
 
 MonaCommunicator* MonaCommunicator::WorldCommunicator = 0;
 
-#define MONA_COMM_BARRIER_TAG 1000
-#define MONA_COMM_BCAST_TAG 1001
-#define MONA_COMM_GATHER_TAG 1002
-#define MONA_COMM_REDUCE_TAG 1003
-#define MONA_COMM_ALLREDUCE_TAG 1004
+// Tags of the collective operations come from a per-communicator sequence so
+// that collectives in flight on the same communicator cannot cross-match.
+inline na_tag_t MonaCommunicatorCollectiveTag(mona_comm_t comm)
+{
+  return MonaTags::NextCollectiveTag(comm, MonaTags::Communicator);
+}
 
 MonaCommunicatorOpaqueComm::MonaCommunicatorOpaqueComm(mona_comm_t handle)
 {
@@ -208,987 +235,4695 @@ inline int MonaCommunicatorCheckSize(vtkIdType length)
 }
 
 
-template <class T>
-int MonaCommunicatorSendData(const T* data, int length, int sizeoftype, int remoteProcessId,
-  int tag, mona_comm_t monacomm, int useCopy, int useSsend)
+//----------------------------------------------------------------------------
+// Node layout of a communicator, used by the hierarchical collectives. Ranks
+// running on the same node form a node subset whose lowest rank, the node
+// leader, comes first. Leaders is the subset of the leaders in node order
+// (so the leader of node i has rank i in it) and is null on other ranks.
+class MonaCommunicatorNodeLayout
 {
-  DEBUG("{}: length={}, typeSize={}, dest={}, tag={}, comm={}", __FUNCTION__,
-          length, sizeoftype, remoteProcessId, tag, (void*)monacomm);
-  int retStatus;
-  if (useCopy)
+public:
+  mona_comm_t Node = nullptr;
+  mona_comm_t Leaders = nullptr;
+  int NodeIndex = 0;
+  std::vector<int> NodeOf;
+  std::vector<int> NodeRankOf;
+  std::vector<std::vector<int> > Members;
+
+  // nothing to gain when all ranks share a node or each one has its own
+  bool IsFlat() const
   {
-    char* tmpData = MonaCommunicator::Allocate(length * sizeoftype);
-    memcpy(tmpData, data, length * sizeoftype);
-    // execute mona comm send
-    mona_comm_send(monacomm, tmpData, length * sizeoftype, remoteProcessId, tag);
-    MonaCommunicator::Free(tmpData);
-    return retStatus;
+    return this->Members.size() <= 1 || this->Members.size() == this->NodeOf.size();
   }
-  else
+};
+
+//----------------------------------------------------------------------------
+// Node layouts are computed once per handle and kept until the handle is
+// released, together with the node and leader subsets (which live in the
+// subset cache).
+class MonaCommunicatorNodeCache
+{
+public:
+  // Collective over comm the first time it is called for comm.
+  static const MonaCommunicatorNodeLayout* Get(mona_comm_t comm)
   {
-    retStatus =
-      mona_comm_send(monacomm, const_cast<T*>(data), length * sizeoftype, remoteProcessId, tag);
-    return retStatus;
+    {
+      std::lock_guard<std::mutex> lock(Mutex);
+      auto it = Entries.find(comm);
+      if (it != Entries.end())
+      {
+        return it->second.get();
+      }
+    }
+    std::unique_ptr<MonaCommunicatorNodeLayout> layout(new MonaCommunicatorNodeLayout);
+    if (!MonaCommunicatorNodeCache::Build(comm, *layout))
+    {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto inserted = Entries.insert(std::make_pair(comm, std::move(layout)));
+    return inserted.first->second.get();
   }
-}
 
-int MonaCommunicator::ReceiveDataInternal(char* data, int length, int sizeoftype,
-  int remoteProcessId, int tag, mona_comm_t monacomm, int useCopy, int& senderId)
+  static void Release(mona_comm_t comm)
+  {
+    std::lock_guard<std::mutex> lock(Mutex);
+    Entries.erase(comm);
+  }
+
+private:
+  static bool Build(mona_comm_t comm, MonaCommunicatorNodeLayout& layout);
+
+  static std::mutex Mutex;
+  static std::map<mona_comm_t, std::unique_ptr<MonaCommunicatorNodeLayout> > Entries;
+};
+
+std::mutex MonaCommunicatorNodeCache::Mutex;
+std::map<mona_comm_t, std::unique_ptr<MonaCommunicatorNodeLayout> >
+  MonaCommunicatorNodeCache::Entries;
+
+//----------------------------------------------------------------------------
+// Subset communicators are cached by parent handle and membership (parent
+// ranks in new rank order), so splitting the same way again, e.g. at every
+// time step, does not build the subset again. The cached handles are shared
+// (by the node layouts among others), a communicator made from one gets its
+// own mona_comm_dup of it. Cached handles are freed when the communicator
+// owning the parent handle goes away.
+class MonaCommunicatorSubsetCache
 {
-  DEBUG("{}: length={}, typeSize={}, src={}, tag={}, comm={}",
-          __FUNCTION__, length, sizeoftype, remoteProcessId, tag, (void*)monacomm);
+public:
+  static mona_comm_t Get(mona_comm_t parent, const std::vector<int>& ranks)
+  {
+    Key key(parent, ranks);
+    {
+      std::lock_guard<std::mutex> lock(Mutex);
+      auto it = Entries.find(key);
+      if (it != Entries.end())
+      {
+        return it->second;
+      }
+    }
 
-  if (remoteProcessId == vtkMultiProcessController::ANY_SOURCE)
+    // mona_comm_subset is local to the calling process, no need to hold the
+    // lock across it.
+    mona_comm_t handle = nullptr;
+    na_return_t ret = mona_comm_subset(parent, ranks.data(), ranks.size(), &handle);
+    if (ret != NA_SUCCESS)
+    {
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    auto inserted = Entries.insert(std::make_pair(key, handle));
+    if (!inserted.second)
+    {
+      mona_comm_free(handle);
+    }
+    return inserted.first->second;
+  }
+
+  // Free the subsets cached for parent, and recursively theirs.
+  static void Release(mona_comm_t parent)
   {
-    // the -1 represent the any source in colza
-    remoteProcessId = -1;
+    MonaCommunicatorNodeCache::Release(parent);
+    std::vector<mona_comm_t> released;
+    {
+      std::lock_guard<std::mutex> lock(Mutex);
+      for (auto it = Entries.begin(); it != Entries.end();)
+      {
+        if (it->first.first == parent)
+        {
+          released.push_back(it->second);
+          it = Entries.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    }
+    for (mona_comm_t handle : released)
+    {
+      MonaCommunicatorSubsetCache::Release(handle);
+      MonaTags::Release(handle);
+      mona_comm_free(handle);
+    }
   }
 
-  int retVal;
+private:
+  typedef std::pair<mona_comm_t, std::vector<int> > Key;
+  static std::mutex Mutex;
+  static std::map<Key, mona_comm_t> Entries;
+};
 
-  if (useCopy)
+std::mutex MonaCommunicatorSubsetCache::Mutex;
+std::map<MonaCommunicatorSubsetCache::Key, mona_comm_t> MonaCommunicatorSubsetCache::Entries;
+
+//----------------------------------------------------------------------------
+// Ranks are placed by host name. MoNA addresses cannot be used for this as
+// shared-memory addresses carry no host. MONA_VTK_NODE_NAME, when set,
+// replaces the host name, e.g. to split the processes of one machine into
+// several nodes.
+//
+// Every rank must end up with the same answer, or they would run different
+// algorithms: a rank that cannot tell its node, or make its subsets, makes
+// all of them fall back to a flat layout.
+#define MONA_COMM_NODE_NAME_LENGTH 256
+
+bool MonaCommunicatorNodeCache::Build(mona_comm_t comm, MonaCommunicatorNodeLayout& layout)
+{
+  int size, rank;
+  if (mona_comm_size(comm, &size) != NA_SUCCESS || mona_comm_rank(comm, &rank) != NA_SUCCESS)
   {
-    char* tmpData = MonaCommunicator::Allocate(length * sizeoftype);
-    na_size_t recv_size;
-    retVal = mona_comm_recv(
-      monacomm, tmpData, length * sizeoftype, remoteProcessId, tag, &recv_size, NULL, NULL);
-    memcpy(data, tmpData, length * sizeoftype);
-    MonaCommunicator::Free(tmpData);
+    return false;
   }
-  else
+  // an empty name tells the others that this rank does not know its node
+  char name[MONA_COMM_NODE_NAME_LENGTH] = { 0 };
+  const char* nodeName = getenv("MONA_VTK_NODE_NAME");
+  if (nodeName)
+  {
+    strncpy(name, nodeName, MONA_COMM_NODE_NAME_LENGTH - 1);
+  }
+  else if (gethostname(name, MONA_COMM_NODE_NAME_LENGTH - 1) != 0)
+  {
+    name[0] = 0;
+  }
+  std::vector<char> names(static_cast<size_t>(size) * MONA_COMM_NODE_NAME_LENGTH);
+  if (mona_comm_allgather(comm, name, MONA_COMM_NODE_NAME_LENGTH, names.data(),
+        MonaCommunicatorCollectiveTag(comm)) != NA_SUCCESS)
+  {
+    return false;
+  }
+
+  // nodes are numbered in the order of their lowest rank
+  std::map<std::string, int> nodes;
+  layout.NodeOf.resize(size);
+  layout.NodeRankOf.resize(size);
+  for (int r = 0; r < size; r++)
+  {
+    std::string key(&names[static_cast<size_t>(r) * MONA_COMM_NODE_NAME_LENGTH]);
+    if (key.empty())
+    {
+      vtkGenericWarningMacro("Rank " << r << " could not determine its node, using flat "
+                                     << "collectives");
+      layout.Members.clear();
+      return true;
+    }
+    auto it = nodes.insert(std::make_pair(key, static_cast<int>(layout.Members.size())));
+    if (it.second)
+    {
+      layout.Members.emplace_back();
+    }
+    int node = it.first->second;
+    layout.NodeOf[r] = node;
+    layout.NodeRankOf[r] = static_cast<int>(layout.Members[node].size());
+    layout.Members[node].push_back(r);
+  }
+  layout.NodeIndex = layout.NodeOf[rank];
+  if (layout.IsFlat())
   {
-    na_size_t recv_size;
-    retVal = mona_comm_recv(
-      monacomm, data, length * sizeoftype, remoteProcessId, tag, &recv_size, NULL, NULL);
+    return true;
   }
 
-  if (retVal == 0)
+  // making the subsets is local, whether it worked everywhere is agreed on
+  layout.Node = MonaCommunicatorSubsetCache::Get(comm, layout.Members[layout.NodeIndex]);
+  int failed = layout.Node ? 0 : 1;
+  if (!failed && layout.NodeRankOf[rank] == 0)
   {
-    senderId = remoteProcessId;
+    std::vector<int> leaders;
+    for (const std::vector<int>& members : layout.Members)
+    {
+      leaders.push_back(members[0]);
+    }
+    layout.Leaders = MonaCommunicatorSubsetCache::Get(comm, leaders);
+    failed = layout.Leaders ? 0 : 1;
   }
-  return retVal;
+  int anyFailed = 0;
+  if (mona_comm_allreduce(comm, &failed, &anyFailed, sizeof(int), 1, mona_op_max_i32, nullptr,
+        MonaCommunicatorCollectiveTag(comm)) != NA_SUCCESS)
+  {
+    return false;
+  }
+  if (anyFailed)
+  {
+    // the subsets that were made stay in the cache until comm is released
+    vtkGenericWarningMacro("Could not create the node communicators, using flat collectives");
+    layout.Node = nullptr;
+    layout.Leaders = nullptr;
+    layout.Members.clear();
+  }
+  return true;
 }
 
-//-----------------------------------------------------------------------------
-// Method for converting an MPI operation to a
-// vtkMultiProcessController::Operation.
-// MPIAPI is defined in the microsoft mpi.h which decorates
-// with the __stdcall decoration.
-static vtkCommunicator::Operation* CurrentOperation;
-extern "C" void MonaCommunicatorUserFunction(
-  void* invec, void* inoutvec, int* len, MPI_Datatype* datatype)
+//----------------------------------------------------------------------------
+// Hierarchical versions of the collectives: the ranks of a node meet on
+// their leader, only the leaders talk across nodes.
+static na_return_t MonaCommunicatorNodeBarrier(const MonaCommunicatorNodeLayout* layout)
 {
-  DEBUG("{}", __FUNCTION__);
-  int vtkType = MonaCommunicatorGetVTKType(*datatype);
-  CurrentOperation->Function(invec, inoutvec, *len, vtkType);
+  na_return_t ret =
+    mona_comm_barrier(layout->Node, MonaCommunicatorCollectiveTag(layout->Node));
+  if (ret == NA_SUCCESS && layout->Leaders)
+  {
+    ret = mona_comm_barrier(layout->Leaders, MonaCommunicatorCollectiveTag(layout->Leaders));
+  }
+  if (ret == NA_SUCCESS)
+  {
+    ret = mona_comm_barrier(layout->Node, MonaCommunicatorCollectiveTag(layout->Node));
+  }
+  return ret;
 }
 
 //----------------------------------------------------------------------------
-// Return the world communicator (i.e. MPI_COMM_WORLD).
-// Create one if necessary (singleton).
-MonaCommunicator* MonaCommunicator::GetWorldCommunicatorByMona(mona_comm_t mona_comm)
+static na_return_t MonaCommunicatorNodeBcast(
+  const MonaCommunicatorNodeLayout* layout, void* data, na_size_t size, int root)
 {
-  DEBUG("{}: comm={}", __FUNCTION__, (void*)mona_comm);
-
-  if (MonaCommunicator::WorldCommunicator == 0)
+  int rootNode = layout->NodeOf[root];
+  na_return_t ret = NA_SUCCESS;
+  // the node of the root first, which hands the data to its leader
+  if (layout->NodeIndex == rootNode && layout->NodeRankOf[root] != 0)
   {
-    MonaCommunicator* comm = MonaCommunicator::New();
-    comm->MonaComm->Handle = mona_comm;
-    comm->InitializeNumberOfProcesses();
-    comm->Initialized = 1;
-    comm->KeepHandleOn();
-    MonaCommunicator::WorldCommunicator = comm;
+    ret = mona_comm_bcast(layout->Node, data, size, layout->NodeRankOf[root],
+      MonaCommunicatorCollectiveTag(layout->Node));
   }
-  return MonaCommunicator::WorldCommunicator;
+  if (ret == NA_SUCCESS && layout->Leaders)
+  {
+    ret = mona_comm_bcast(
+      layout->Leaders, data, size, rootNode, MonaCommunicatorCollectiveTag(layout->Leaders));
+  }
+  if (ret == NA_SUCCESS && layout->NodeIndex != rootNode)
+  {
+    ret = mona_comm_bcast(layout->Node, data, size, 0, MonaCommunicatorCollectiveTag(layout->Node));
+  }
+  return ret;
 }
 
-MonaCommunicator* MonaCommunicator::GetWorldCommunicator()
+//----------------------------------------------------------------------------
+static na_return_t MonaCommunicatorNodeAllReduce(const MonaCommunicatorNodeLayout* layout,
+  const void* sendBuffer, void* recvBuffer, na_size_t typesize, na_size_t count, mona_op_t op)
 {
-  DEBUG("{}", __FUNCTION__);
-  int err, size;
-
-  if (MonaCommunicator::WorldCommunicator == 0)
+  na_size_t size = typesize * count;
+  std::vector<char> partial(layout->Leaders ? size : 0);
+  na_return_t ret = mona_comm_reduce(layout->Node, sendBuffer, partial.data(), typesize, count,
+    op, NULL, 0, MonaCommunicatorCollectiveTag(layout->Node));
+  if (ret == NA_SUCCESS && layout->Leaders)
   {
-      throw std::runtime_error("MonaCommunicator::GetWorldCommunicator: WorldCommunicator not set "
-              "(use MonaCommunicator::GetWorldCommunicatorByMona instead)");
+    ret = mona_comm_allreduce(layout->Leaders, partial.data(), recvBuffer, typesize, count, op,
+      NULL, MonaCommunicatorCollectiveTag(layout->Leaders));
   }
-  return MonaCommunicator::WorldCommunicator;
+  if (ret == NA_SUCCESS)
+  {
+    ret = mona_comm_bcast(
+      layout->Node, recvBuffer, size, 0, MonaCommunicatorCollectiveTag(layout->Node));
+  }
+  return ret;
 }
 
 //----------------------------------------------------------------------------
-void MonaCommunicator::PrintSelf(ostream& os, vtkIndent indent)
+// When the root is not a leader, the leader of its node forwards the result
+// to it over comm.
+static na_return_t MonaCommunicatorNodeReduce(mona_comm_t comm,
+  const MonaCommunicatorNodeLayout* layout, const void* sendBuffer, void* recvBuffer,
+  na_size_t typesize, na_size_t count, mona_op_t op, int root, int rank)
 {
-  DEBUG("{}", __FUNCTION__);
-  this->Superclass::PrintSelf(os, indent);
-  os << indent << "MPI Communicator handler: ";
-  if (this->MonaComm->Handle)
+  na_tag_t forwardTag = MonaCommunicatorCollectiveTag(comm);
+  int rootNode = layout->NodeOf[root];
+  int rootLeader = layout->Members[rootNode][0];
+  na_size_t size = typesize * count;
+  std::vector<char> partial(layout->Leaders ? size : 0);
+  na_return_t ret = mona_comm_reduce(layout->Node, sendBuffer, partial.data(), typesize, count,
+    op, NULL, 0, MonaCommunicatorCollectiveTag(layout->Node));
+  if (ret != NA_SUCCESS)
   {
-    os << this->MonaComm->Handle << endl;
+    return ret;
   }
-  else
+  if (layout->Leaders)
   {
-    os << "(none)\n";
+    std::vector<char> result((rank == rootLeader && rank != root) ? size : 0);
+    void* target = (rank == root) ? recvBuffer : result.data();
+    ret = mona_comm_reduce(layout->Leaders, partial.data(), target, typesize, count, op, NULL,
+      rootNode, MonaCommunicatorCollectiveTag(layout->Leaders));
+    if (ret == NA_SUCCESS && rank == rootLeader && rank != root)
+    {
+      ret = mona_comm_send(comm, target, size, root, forwardTag);
+    }
   }
-  os << indent << "UseSsend: " << (this->UseSsend ? "On" : " Off") << endl;
-  os << indent << "Initialized: " << (this->Initialized ? "On\n" : "Off\n");
-  os << indent << "Keep handle: " << (this->KeepHandle ? "On\n" : "Off\n");
-  if (this != MonaCommunicator::WorldCommunicator)
+  else if (rank == root)
   {
-    os << indent << "World communicator: ";
-    if (MonaCommunicator::WorldCommunicator)
+    ret = mona_comm_recv(comm, recvBuffer, size, rootLeader, forwardTag, NULL, NULL, NULL);
+  }
+  return ret;
+}
+
+//----------------------------------------------------------------------------
+// The leaders gather whole nodes, the leader of the root's node then puts
+// the pieces back in rank order.
+static na_return_t MonaCommunicatorNodeGather(mona_comm_t comm,
+  const MonaCommunicatorNodeLayout* layout, const void* sendBuffer, void* recvBuffer,
+  na_size_t size, int root, int rank)
+{
+  na_tag_t forwardTag = MonaCommunicatorCollectiveTag(comm);
+  int rootNode = layout->NodeOf[root];
+  int rootLeader = layout->Members[rootNode][0];
+  na_size_t total = size * layout->NodeOf.size();
+  const std::vector<int>& members = layout->Members[layout->NodeIndex];
+  std::vector<char> nodeData(layout->Leaders ? size * members.size() : 0);
+  na_return_t ret = mona_comm_gather(layout->Node, sendBuffer, size, nodeData.data(), 0,
+    MonaCommunicatorCollectiveTag(layout->Node));
+  if (ret != NA_SUCCESS)
+  {
+    return ret;
+  }
+  if (!layout->Leaders)
+  {
+    if (rank == root)
     {
-      os << endl;
-      MonaCommunicator::WorldCommunicator->PrintSelf(os, indent.GetNextIndent());
+      ret = mona_comm_recv(comm, recvBuffer, total, rootLeader, forwardTag, NULL, NULL, NULL);
     }
-    else
+    return ret;
+  }
+
+  size_t numberOfNodes = layout->Members.size();
+  std::vector<na_size_t> sizes(numberOfNodes), offsets(numberOfNodes);
+  na_size_t offset = 0;
+  for (size_t i = 0; i < numberOfNodes; i++)
+  {
+    sizes[i] = size * layout->Members[i].size();
+    offsets[i] = offset;
+    offset += sizes[i];
+  }
+  std::vector<char> byNode(rank == rootLeader ? total : 0);
+  ret = mona_comm_gatherv(layout->Leaders, nodeData.data(), nodeData.size(), byNode.data(),
+    sizes.data(), offsets.data(), rootNode, MonaCommunicatorCollectiveTag(layout->Leaders));
+  if (ret != NA_SUCCESS || rank != rootLeader)
+  {
+    return ret;
+  }
+
+  std::vector<char> ordered(rank != root ? total : 0);
+  char* target = (rank == root) ? static_cast<char*>(recvBuffer) : ordered.data();
+  for (size_t i = 0; i < numberOfNodes; i++)
+  {
+    for (size_t j = 0; j < layout->Members[i].size(); j++)
     {
-      os << "(none)";
+      memcpy(target + size * layout->Members[i][j], byNode.data() + offsets[i] + size * j, size);
     }
-    os << endl;
   }
-  return;
+  if (rank != root)
+  {
+    ret = mona_comm_send(comm, target, total, root, forwardTag);
+  }
+  return ret;
 }
 
 //----------------------------------------------------------------------------
-MonaCommunicator::MonaCommunicator()
-{
-  DEBUG("{} constructor", __FUNCTION__);
-  this->MonaComm = new MonaCommunicatorOpaqueComm;
-  this->Initialized = 0;
-  this->KeepHandle = 0;
-  this->LastSenderId = -1;
-  this->UseSsend = 0;
-}
+// Flat collective algorithms on top of point-to-point messages, selected by
+// message size (see AllReduceRingThreshold and BroadcastPipelineThreshold).
+// All the messages of one collective share a single collective tag.
 
-//----------------------------------------------------------------------------
-MonaCommunicator::~MonaCommunicator()
+// Recursive doubling allreduce: log2(p) exchanges of the whole buffer, the
+// best choice for small messages. When p is not a power of two the first
+// 2 * (p - pof2) ranks pair up first so that pof2 ranks do the doubling.
+static na_return_t MonaCommunicatorRecursiveDoublingAllReduce(mona_comm_t comm,
+  const void* sendBuffer, void* recvBuffer, na_size_t typesize, na_size_t count, mona_op_t op)
 {
-  DEBUG("{} destructor", __FUNCTION__);
-  // Free the handle if required and asked for.
-  if (this->MonaComm)
+  int size, rank;
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  na_tag_t tag = MonaCommunicatorCollectiveTag(comm);
+  na_size_t bytes = typesize * count;
+  if (recvBuffer != sendBuffer)
   {
-    if (this->MonaComm->Handle && !this->KeepHandle)
+    memcpy(recvBuffer, sendBuffer, bytes);
+  }
+  std::vector<char> incoming(bytes);
+
+  int pof2 = 1;
+  while (pof2 * 2 <= size)
+  {
+    pof2 *= 2;
+  }
+  int rem = size - pof2;
+  int newRank = rank - rem;
+  na_return_t ret = NA_SUCCESS;
+  if (rank < 2 * rem)
+  {
+    if (rank % 2 == 0)
     {
-      if (this->MonaComm->Handle != NULL)
+      ret = mona_comm_send(comm, recvBuffer, bytes, rank + 1, tag);
+      newRank = -1;
+    }
+    else
+    {
+      ret = mona_comm_recv(comm, incoming.data(), bytes, rank - 1, tag, NULL, NULL, NULL);
+      if (ret == NA_SUCCESS)
       {
-        mona_comm_free(this->MonaComm->Handle);
+        op(incoming.data(), recvBuffer, typesize, count, NULL);
       }
+      newRank = rank / 2;
     }
-    delete this->MonaComm;
   }
-}
 
-//-----------------------------------------------------------------------------
-int MonaCommunicator::Initialize(vtkProcessGroup* group)
-{
-    throw std::runtime_error("MonaCommunicator::Initialize(vtkProcessGroup* group) not implemented");
-    return 1;
-}
+  for (int mask = 1; ret == NA_SUCCESS && newRank >= 0 && mask < pof2; mask <<= 1)
+  {
+    int newPartner = newRank ^ mask;
+    int partner = (newPartner < rem) ? newPartner * 2 + 1 : newPartner + rem;
+    ret = mona_comm_sendrecv(comm, recvBuffer, bytes, partner, tag, incoming.data(), bytes,
+      partner, tag, NULL, NULL, NULL);
+    if (ret == NA_SUCCESS)
+    {
+      op(incoming.data(), recvBuffer, typesize, count, NULL);
+    }
+  }
 
-//-----------------------------------------------------------------------------
-int MonaCommunicator::SplitInitialize(vtkCommunicator* oldcomm, int color, int key)
-{
-    throw std::runtime_error("MonaCommunicator::SplitInitialize not implemented");
-    return 1;
+  if (ret == NA_SUCCESS && rank < 2 * rem)
+  {
+    if (rank % 2 == 0)
+    {
+      ret = mona_comm_recv(comm, recvBuffer, bytes, rank + 1, tag, NULL, NULL, NULL);
+    }
+    else
+    {
+      ret = mona_comm_send(comm, recvBuffer, bytes, rank - 1, tag);
+    }
+  }
+  return ret;
 }
 
-int MonaCommunicator::InitializeExternal(MonaCommunicatorOpaqueComm* comm)
+//----------------------------------------------------------------------------
+// Ring allreduce: a reduce-scatter followed by an allgather around the ring,
+// each rank sends and receives 2 * (p - 1) / p of the buffer, the best
+// choice for large messages. Needs at least one element per rank.
+static na_return_t MonaCommunicatorRingAllReduce(mona_comm_t comm, const void* sendBuffer,
+  void* recvBuffer, na_size_t typesize, na_size_t count, mona_op_t op)
 {
-  DEBUG("{}: comm={}, mona_comm={}", __FUNCTION__, (void*)comm, (void*)comm->GetHandle());
-  this->KeepHandleOn();
-  free(this->MonaComm->Handle); // XXX ??
-  this->MonaComm->Handle = comm->GetHandle();
-  this->InitializeNumberOfProcesses();
-  this->Initialized = 1;
-
-  this->Modified();
+  int size, rank;
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  na_tag_t tag = MonaCommunicatorCollectiveTag(comm);
+  char* data = static_cast<char*>(recvBuffer);
+  if (recvBuffer != sendBuffer)
+  {
+    memcpy(data, sendBuffer, typesize * count);
+  }
 
-  return 1;
-}
+  // block i is made of elements [first[i], first[i + 1])
+  std::vector<na_size_t> first(size + 1);
+  for (int i = 0; i <= size; i++)
+  {
+    first[i] = count * i / size;
+  }
+  std::vector<char> incoming((count / size + 1) * typesize);
+  int right = (rank + 1) % size;
+  int left = (rank + size - 1) % size;
+  na_return_t ret = NA_SUCCESS;
 
-//----------------------------------------------------------------------------
-// Start the copying process
+  // reduce-scatter: afterwards block rank + 1 holds the complete result
+  for (int step = 0; ret == NA_SUCCESS && step < size - 1; step++)
+  {
+    int sendBlock = (rank - step + size) % size;
+    int recvBlock = (rank - step - 1 + 2 * size) % size;
+    na_size_t recvCount = first[recvBlock + 1] - first[recvBlock];
+    ret = mona_comm_sendrecv(comm, data + first[sendBlock] * typesize,
+      (first[sendBlock + 1] - first[sendBlock]) * typesize, right, tag, incoming.data(),
+      recvCount * typesize, left, tag, NULL, NULL, NULL);
+    if (ret == NA_SUCCESS)
+    {
+      op(incoming.data(), data + first[recvBlock] * typesize, typesize, recvCount, NULL);
+    }
+  }
 
-void MonaCommunicator::InitializeCopy(MonaCommunicator* source)
-{
-    throw std::runtime_error("MonaCommunicator::InitializeCopy it not implemented");
+  // allgather of the complete blocks
+  for (int step = 0; ret == NA_SUCCESS && step < size - 1; step++)
+  {
+    int sendBlock = (rank + 1 - step + size) % size;
+    int recvBlock = (rank - step + size) % size;
+    ret = mona_comm_sendrecv(comm, data + first[sendBlock] * typesize,
+      (first[sendBlock + 1] - first[sendBlock]) * typesize, right, tag,
+      data + first[recvBlock] * typesize, (first[recvBlock + 1] - first[recvBlock]) * typesize,
+      left, tag, NULL, NULL, NULL);
+  }
+  return ret;
 }
 
-//-----------------------------------------------------------------------------
-// Set the number of processes and maximum number of processes
-// to the size obtained from Mona.
-int MonaCommunicator::InitializeNumberOfProcesses()
+//----------------------------------------------------------------------------
+// Pipelined binomial broadcast: the buffer goes down the binomial tree in
+// segments, so inner ranks forward a segment while the next one is on its
+// way. Children of the largest subtrees are served first. Segment i goes on
+// the collective tag of its slot (i modulo window), and each child has at
+// most window segments in flight, so segments in flight to a child never
+// share a tag.
+static na_return_t MonaCommunicatorPipelinedBcast(
+  mona_comm_t comm, void* data, na_size_t bytes, int root, na_size_t segmentSize, int window)
 {
-  DEBUG("{}",__FUNCTION__);
-  int ret;
-  this->Modified();
-  mona_comm_t mona_comm = this->MonaComm->Handle;
-  // get size and rank
   int size, rank;
-  ret = mona_comm_size(mona_comm, &size);
-  //std::cout << "debug size " << size << std::endl;
-  if (ret != 0)
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  std::vector<na_tag_t> tags(window);
+  for (int i = 0; i < window; i++)
   {
-    throw std::runtime_error("failed to get mona size");
-    return -1;
+    tags[i] = MonaCommunicatorCollectiveTag(comm);
   }
+  int vrank = (rank - root + size) % size;
 
-  ret = mona_comm_rank(mona_comm, &rank);
-  //std::cout << "debug rank " << rank << std::endl;
-
-  if (ret != 0)
+  // the parent clears the lowest bit set in vrank, the children set a lower one
+  int parent = -1;
+  int lowest = 1;
+  while (lowest < size)
   {
-    throw std::runtime_error("failed to get mona rank");
-    return -1;
+    lowest <<= 1;
   }
-
-  this->MaximumNumberOfProcesses = size;
-  this->NumberOfProcesses = this->MaximumNumberOfProcesses;
-  // get the rank id
-  // TODO check error
-  this->LocalProcessId = rank;
-  return 1;
+  if (vrank != 0)
+  {
+    lowest = vrank & -vrank;
+    parent = (vrank - lowest + root) % size;
+  }
+  std::vector<int> children;
+  for (int mask = lowest >> 1; mask > 0; mask >>= 1)
+  {
+    if (vrank + mask < size)
+    {
+      children.push_back((vrank + mask + root) % size);
+    }
+  }
+
+  char* buffer = static_cast<char*>(data);
+  // slot (segment % window) of each child
+  std::vector<mona_request_t> slots(children.size() * window, MONA_REQUEST_NULL);
+  na_return_t ret = NA_SUCCESS;
+  na_size_t segment = 0;
+  for (na_size_t offset = 0; ret == NA_SUCCESS && offset < bytes;
+       offset += segmentSize, segment++)
+  {
+    na_size_t n = std::min(segmentSize, bytes - offset);
+    na_tag_t segmentTag = tags[segment % window];
+    if (parent >= 0)
+    {
+      ret = mona_comm_recv(comm, buffer + offset, n, parent, segmentTag, NULL, NULL, NULL);
+    }
+    for (size_t i = 0; ret == NA_SUCCESS && i < children.size(); i++)
+    {
+      mona_request_t& slot = slots[i * window + segment % window];
+      if (slot != MONA_REQUEST_NULL)
+      {
+        ret = mona_wait(slot);
+        slot = MONA_REQUEST_NULL;
+      }
+      if (ret == NA_SUCCESS)
+      {
+        ret = mona_comm_isend(comm, buffer + offset, n, children[i], segmentTag, &slot);
+      }
+      if (ret != NA_SUCCESS)
+      {
+        slot = MONA_REQUEST_NULL;
+      }
+    }
+  }
+  for (mona_request_t slot : slots)
+  {
+    if (slot == MONA_REQUEST_NULL)
+    {
+      continue;
+    }
+    na_return_t waited = mona_wait(slot);
+    if (ret == NA_SUCCESS)
+    {
+      ret = waited;
+    }
+  }
+  return ret;
 }
 
 //----------------------------------------------------------------------------
-// Copy the MPI handle
-void MonaCommunicator::CopyFrom(MonaCommunicator* source)
+// Buffers handed out by MonaCommunicator::Allocate (the UseCopy staging
+// buffers) come from a pool of power-of-two size classes, so sending pieces
+// of the same size at every time step stops allocating after the first one.
+// Each buffer is preceded by a small header recording its class, which lets
+// Free() find its way back without being given the size. Requests beyond the
+// largest class are plain allocations, and at most MaximumCachedBytes are
+// kept around.
+class MonaCommunicatorBufferPool
 {
-    throw std::runtime_error("MonaCommunicator::CopyFrom not implemented");
-}
+public:
+  static char* Allocate(size_t size)
+  {
+    int sizeClass = MonaCommunicatorBufferPool::GetSizeClass(size);
+    char* block = nullptr;
+    if (sizeClass >= 0)
+    {
+      std::lock_guard<std::mutex> lock(Mutex);
+      std::vector<char*>& freeList = FreeLists[sizeClass];
+      if (!freeList.empty())
+      {
+        block = freeList.back();
+        freeList.pop_back();
+        CachedBytes -= MonaCommunicatorBufferPool::GetClassSize(sizeClass);
+      }
+    }
+    if (!block)
+    {
+      size_t blockSize =
+        (sizeClass >= 0) ? MonaCommunicatorBufferPool::GetClassSize(sizeClass) : size;
+      block = new char[HeaderSize + blockSize];
+      *reinterpret_cast<int*>(block) = sizeClass;
+    }
+    return block + HeaderSize;
+  }
+
+  static void Free(char* ptr)
+  {
+    if (!ptr)
+    {
+      return;
+    }
+    char* block = ptr - HeaderSize;
+    int sizeClass = *reinterpret_cast<int*>(block);
+    if (sizeClass >= 0)
+    {
+      size_t classSize = MonaCommunicatorBufferPool::GetClassSize(sizeClass);
+      std::lock_guard<std::mutex> lock(Mutex);
+      if (CachedBytes + classSize <= MaximumCachedBytes)
+      {
+        FreeLists[sizeClass].push_back(block);
+        CachedBytes += classSize;
+        return;
+      }
+    }
+    delete[] block;
+  }
+
+private:
+  // keeps the user part of the buffer aligned for any element type
+  static const size_t HeaderSize = 64;
+  static const int MinimumClassShift = 12;  // 4 KiB
+  static const int NumberOfClasses = 15;    // up to 64 MiB
+  static const size_t MaximumCachedBytes = size_t(256) << 20;
+
+  static size_t GetClassSize(int sizeClass) { return size_t(1) << (MinimumClassShift + sizeClass); }
+
+  static int GetSizeClass(size_t size)
+  {
+    for (int c = 0; c < NumberOfClasses; c++)
+    {
+      if (size <= MonaCommunicatorBufferPool::GetClassSize(c))
+      {
+        return c;
+      }
+    }
+    return -1;
+  }
+
+  static std::mutex Mutex;
+  static std::vector<char*> FreeLists[NumberOfClasses];
+  static size_t CachedBytes;
+};
+
+std::mutex MonaCommunicatorBufferPool::Mutex;
+std::vector<char*>
+  MonaCommunicatorBufferPool::FreeLists[MonaCommunicatorBufferPool::NumberOfClasses];
+size_t MonaCommunicatorBufferPool::CachedBytes = 0;
 
 //----------------------------------------------------------------------------
-// Duplicate the MPI handle
+// Point-to-point messages are made of two parts: a small envelope sent on the
+// user tag, followed by the payload sent on the same tag with
+// MONA_COMM_PAYLOAD_TAG_FLAG set. MoNA has no probe of its own, the envelope
+// is what lets receivers (and Iprobe) learn the sender and the actual size of
+// a message before receiving it. Payloads of at most MONA_COMM_EAGER_LIMIT
+// bytes are eager: they travel at the end of the envelope and nothing is
+// sent on the payload tag.
+#define MONA_COMM_PAYLOAD_TAG_FLAG 0x80000000u
+#define MONA_COMM_ENVELOPE_MAGIC 0x4d6f4e41456e7632ull
 
-void MonaCommunicator::Duplicate(MonaCommunicator* source)
+// Chunk i of a pipelined payload goes on the payload tag with the slot
+// (i modulo the number of chunks in flight) xor-ed in above this shift.
+// Chunks in flight at the same time thus never share a tag and cannot be
+// matched out of order. Chunk 0 uses the plain payload tag.
+#define MONA_COMM_CHUNK_TAG_SHIFT 24
+
+// Bits a point-to-point user tag may use. The rest of the MoNA tag is ours:
+// bits 24..29 hold the chunk slot, bit 30 marks the collective tags (see
+// MonaTags.hpp) and bit 31 the payload.
+#define MONA_COMM_USER_TAG_MASK 0x00ffffffu
+
+// States of a MonaCommunicatorOpaqueRequest
+#define MONA_COMM_REQUEST_DONE 0
+#define MONA_COMM_REQUEST_PENDING_ENVELOPE 1 // envelope receive not posted yet
+#define MONA_COMM_REQUEST_ENVELOPE 2         // envelope receive in flight
+#define MONA_COMM_REQUEST_HAVE_ENVELOPE 3    // payload receive not posted yet
+#define MONA_COMM_REQUEST_PAYLOAD 4          // payload (and envelope) in flight
+#define MONA_COMM_REQUEST_CHUNKS 5           // remaining chunks of the payload
+#define MONA_COMM_REQUEST_SEGMENTS 6         // piece table and pieces of the payload
+
+inline na_tag_t MonaCommunicatorPayloadTag(int tag)
 {
-    throw std::runtime_error("MonaCommunicator::Duplicate not implemented");
+  return static_cast<na_tag_t>(tag) | MONA_COMM_PAYLOAD_TAG_FLAG;
 }
 
-//----------------------------------------------------------------------------
-char* MonaCommunicator::Allocate(size_t size)
+inline bool MonaCommunicatorIsEager(const MonaCommunicatorEnvelope& envelope)
 {
-  DEBUG("{}: size={}", __FUNCTION__, size);
-  return new char[size];
+  return envelope.Length <= MONA_COMM_EAGER_LIMIT && envelope.ChunkSize == 0 &&
+    envelope.Segments == 0;
 }
 
-//----------------------------------------------------------------------------
-void MonaCommunicator::Free(char* ptr)
+// Bytes of envelope on the wire: the header, and the payload when eager.
+inline na_size_t MonaCommunicatorEnvelopeSize(const MonaCommunicatorEnvelope& envelope)
 {
-  DEBUG("{}", __FUNCTION__);
-  delete[] ptr;
+  return offsetof(MonaCommunicatorEnvelope, Eager) +
+    (MonaCommunicatorIsEager(envelope) ? envelope.Length : 0);
 }
 
-//----------------------------------------------------------------------------
-int MonaCommunicator::CheckForMPIError(int err)
+inline na_tag_t MonaCommunicatorChunkTag(int tag, na_size_t chunk, uint64_t window)
 {
-  DEBUG("{}: err={}", __FUNCTION__, err);
+  return MonaCommunicatorPayloadTag(tag) ^
+    (static_cast<na_tag_t>(chunk % window) << MONA_COMM_CHUNK_TAG_SHIFT);
+}
 
-  if (err == MPI_SUCCESS)
+inline int MonaCommunicatorGetSource(int remoteProcessId)
+{
+  if (remoteProcessId == vtkMultiProcessController::ANY_SOURCE)
+  {
+    // the -1 represent the any source in colza
+    return -1;
+  }
+  return remoteProcessId;
+}
+
+//----------------------------------------------------------------------------
+// Test (or wait for) a MoNA request. mona_wait releases the request, so the
+// handle is reset to MONA_REQUEST_NULL once it completed.
+static int MonaCommunicatorProgressHandle(mona_request_t& handle, int blocking, int& flag)
+{
+  flag = 1;
+  if (handle == MONA_REQUEST_NULL)
   {
     return 1;
   }
-  else
+  if (!blocking)
   {
-    char* msg = MonaController::ErrorString(err);
-    vtkGenericWarningMacro("MPI error occurred: " << msg);
-    delete[] msg;
+    flag = 0;
+    int err = mona_test(handle, &flag);
+    if (err != 0)
+    {
+      vtkGenericWarningMacro("MoNA error occurred in mona_test: " << err);
+      return 0;
+    }
+    if (!flag)
+    {
+      return 1;
+    }
+  }
+  na_return_t ret = mona_wait(handle);
+  handle = MONA_REQUEST_NULL;
+  if (ret != NA_SUCCESS)
+  {
+    vtkGenericWarningMacro("MoNA error occurred in mona_wait: " << ret);
     return 0;
   }
+  return 1;
 }
 
-//-----------------------------------------------------------------------------
-int MonaCommunicator::SendVoidArray(
-  const void* data, vtkIdType length, int type, int remoteProcessId, int tag)
+//----------------------------------------------------------------------------
+// Envelopes pulled off the wire by Iprobe before the matching receive was
+// posted. Receives look here first so that the message order is preserved.
+class MonaCommunicatorProbeState
 {
-  DEBUG("{}: length={}, type={}, dest={}, tag={}",
-          __FUNCTION__, length, type, remoteProcessId, tag);
-  const char* byteData = static_cast<const char*>(data);
-  // MPI_Datatype mpiType = MonaCommunicatorGetMPIType(type);
-  int sizeOfType;
-  switch (type)
+public:
+  struct Probe
   {
-    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
-    default:
-      vtkWarningMacro(<< "Invalid data type " << type);
-      sizeOfType = 1;
-      break;
+    int Source;
+    int Tag;
+    int ActualSource;
+    mona_request_t Handle;
+    MonaCommunicatorEnvelope Envelope;
+  };
+
+  // Envelope receives posted by Iprobe that did not complete yet. std::list
+  // keeps the receive buffers in place while MoNA writes into them.
+  std::list<Probe> Posted;
+  // Envelopes whose payload has not been received yet, in arrival order.
+  std::list<Probe> Received;
+  // A posted probe may swallow a message meant for (source, tag).
+  bool Competes(const Probe& probe, int source, int tag) const
+  {
+    return probe.Tag == tag && (probe.Source == -1 || source == -1 || probe.Source == source);
+  }
+
+  bool HasCompeting(int source, int tag) const
+  {
+    for (const Probe& probe : this->Posted)
+    {
+      if (this->Competes(probe, source, tag))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Look for a received envelope matching (source, tag), removing it from
+  // the list when consume is set.
+  bool Find(int source, int tag, int consume, MonaCommunicatorEnvelope* envelope, int& sender)
+  {
+    for (auto it = this->Received.begin(); it != this->Received.end(); ++it)
+    {
+      if (it->Tag == tag && (source == -1 || it->ActualSource == source))
+      {
+        if (envelope)
+        {
+          *envelope = it->Envelope;
+        }
+        sender = it->ActualSource;
+        if (consume)
+        {
+          this->Received.erase(it);
+        }
+        return true;
+      }
+    }
+    return false;
   }
 
-  int maxSend = VTK_INT_MAX;
-  int status;
-  while (length >= maxSend)
+  // Post an envelope receive for (source, tag) unless one is already pending.
+  int Post(mona_comm_t comm, int source, int tag)
   {
-    status = MonaCommunicatorSendData(byteData, maxSend, sizeOfType, remoteProcessId, tag,
-      this->MonaComm->Handle, vtkCommunicator::UseCopy, this->UseSsend);
-    if (status != 0)
+    for (const Probe& probe : this->Posted)
+    {
+      if (probe.Source == source && probe.Tag == tag)
+      {
+        return 1;
+      }
+    }
+    this->Posted.push_back(Probe());
+    Probe& probe = this->Posted.back();
+    probe.Source = source;
+    probe.Tag = tag;
+    probe.ActualSource = source;
+    probe.Handle = MONA_REQUEST_NULL;
+    na_return_t ret = mona_comm_irecv(comm, &probe.Envelope, sizeof(probe.Envelope), source, tag,
+      NULL, &probe.ActualSource, NULL, &probe.Handle);
+    if (ret != NA_SUCCESS)
     {
-      // Failed to send.
-      std::cerr << "failed to send void array" << std::endl;
+      vtkGenericWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+      this->Posted.pop_back();
       return 0;
     }
-    byteData += maxSend * sizeOfType;
-    length -= maxSend;
+    return 1;
   }
-  status = MonaCommunicatorSendData(byteData, length, sizeOfType, remoteProcessId, tag,
-    this->MonaComm->Handle, vtkCommunicator::UseCopy, this->UseSsend);
-  if (status == 0)
+
+  // Move the completed probes competing with (source, tag) to Received. When
+  // blocking, wait on the probes that the awaited message is sure to match,
+  // and stop as soon as an envelope for (source, tag) is available.
+  int Progress(int source, int tag, int blocking)
   {
-    return true;
+    auto it = this->Posted.begin();
+    while (it != this->Posted.end())
+    {
+      if (!this->Competes(*it, source, tag))
+      {
+        ++it;
+        continue;
+      }
+      int wait = blocking && (it->Source == -1 || it->Source == source);
+      int flag = 0;
+      if (!MonaCommunicatorProgressHandle(it->Handle, wait, flag))
+      {
+        return 0;
+      }
+      if (!flag)
+      {
+        ++it;
+        continue;
+      }
+      auto next = std::next(it);
+      this->Received.splice(this->Received.end(), this->Posted, it);
+      it = next;
+      int sender;
+      if (blocking && this->Find(source, tag, 0, nullptr, sender))
+      {
+        return 1;
+      }
+    }
+    return 1;
+  }
+};
+
+//----------------------------------------------------------------------------
+int MonaCommunicatorSendData(const char* data, na_size_t size, int remoteProcessId, int tag,
+  mona_comm_t monacomm, int useCopy, int useSsend)
+{
+  DEBUG("{}: size={}, dest={}, tag={}, comm={}", __FUNCTION__,
+          size, remoteProcessId, tag, (void*)monacomm);
+  na_tag_t payloadTag = MonaCommunicatorPayloadTag(tag);
+  int retStatus;
+  if (useCopy)
+  {
+    char* tmpData = MonaCommunicator::Allocate(size);
+    memcpy(tmpData, data, size);
+    // execute mona comm send
+    retStatus = mona_comm_send(monacomm, tmpData, size, remoteProcessId, payloadTag);
+    MonaCommunicator::Free(tmpData);
+    return retStatus;
   }
   else
   {
-    return false;
+    retStatus = mona_comm_send(monacomm, data, size, remoteProcessId, payloadTag);
+    return retStatus;
   }
 }
 
-//-----------------------------------------------------------------------------
-inline vtkIdType MonaCommunicatorMin(vtkIdType a, vtkIdType b)
+int MonaCommunicator::ReceiveDataInternal(char* data, na_size_t dataSize,
+  int remoteProcessId, int tag, mona_comm_t monacomm, int useCopy, int& senderId)
 {
-  return (a > b) ? b : a;
+  DEBUG("{}: size={}, src={}, tag={}, comm={}",
+          __FUNCTION__, dataSize, remoteProcessId, tag, (void*)monacomm);
+
+  remoteProcessId = MonaCommunicatorGetSource(remoteProcessId);
+  na_tag_t payloadTag = MonaCommunicatorPayloadTag(tag);
+
+  int retVal;
+  int actualSource = remoteProcessId;
+  na_size_t recv_size = 0;
+
+  if (useCopy)
+  {
+    char* tmpData = MonaCommunicator::Allocate(dataSize);
+    retVal = mona_comm_recv(monacomm, tmpData, dataSize, remoteProcessId, payloadTag, &recv_size,
+      &actualSource, NULL);
+    if (retVal == 0)
+    {
+      memcpy(data, tmpData, recv_size);
+    }
+    MonaCommunicator::Free(tmpData);
+  }
+  else
+  {
+    retVal = mona_comm_recv(monacomm, data, dataSize, remoteProcessId, payloadTag, &recv_size,
+      &actualSource, NULL);
+  }
+
+  if (retVal == 0)
+  {
+    if (recv_size != dataSize)
+    {
+      vtkGenericWarningMacro(
+        "Received " << recv_size << " bytes from " << actualSource << ", expected " << dataSize);
+      return -1;
+    }
+    senderId = actualSource;
+  }
+  return retVal;
 }
 
-//-----------------------------------------------------------------------------
-int MonaCommunicator::ReceiveVoidArray(
-  void* data, vtkIdType maxlength, int type, int remoteProcessId, int tag)
+//----------------------------------------------------------------------------
+// Send size bytes as a pipeline of chunkSize chunks, keeping up to window of
+// them in flight. With UseCopy each slot of the window stages its chunk in a
+// pooled buffer.
+int MonaCommunicator::SendChunks(const char* data, na_size_t size, na_size_t chunkSize,
+  int window, int remoteProcessId, int tag)
 {
-  DEBUG("{}: maxlength={}, type={}, src={}, tag={}",
-          __FUNCTION__, maxlength, type, remoteProcessId, tag);
-  this->Count = 0;
-  char* byteData = static_cast<char*>(data);
+  DEBUG("{}: size={}, chunkSize={}, window={}, dest={}, tag={}", __FUNCTION__, size, chunkSize,
+          window, remoteProcessId, tag);
+  mona_comm_t monacomm = this->MonaComm->Handle;
+  int useCopy = vtkCommunicator::UseCopy;
+  std::vector<mona_request_t> slots(window, MONA_REQUEST_NULL);
+  std::vector<char*> staging(useCopy ? window : 0, nullptr);
 
-  int sizeOfType;
-  switch (type)
+  int retVal = 1;
+  na_size_t offset = 0;
+  for (na_size_t chunk = 0; offset < size; chunk++)
   {
-    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
-    default:
-      vtkWarningMacro(<< "Invalid data type " << type);
-      sizeOfType = 1;
+    int slot = static_cast<int>(chunk % window);
+    if (slots[slot] != MONA_REQUEST_NULL)
+    {
+      na_return_t ret = mona_wait(slots[slot]);
+      slots[slot] = MONA_REQUEST_NULL;
+      if (ret != NA_SUCCESS)
+      {
+        vtkWarningMacro("MoNA error occurred in mona_wait: " << ret);
+        retVal = 0;
+        break;
+      }
+    }
+
+    na_size_t n = std::min(chunkSize, size - offset);
+    const char* buffer = data + offset;
+    if (useCopy)
+    {
+      if (!staging[slot])
+      {
+        staging[slot] = MonaCommunicator::Allocate(chunkSize);
+      }
+      memcpy(staging[slot], buffer, n);
+      buffer = staging[slot];
+    }
+    na_return_t ret = mona_comm_isend(monacomm, buffer, n, remoteProcessId,
+      MonaCommunicatorChunkTag(tag, chunk, window), &slots[slot]);
+    if (ret != NA_SUCCESS)
+    {
+      vtkWarningMacro("MoNA error occurred in mona_comm_isend: " << ret);
+      slots[slot] = MONA_REQUEST_NULL;
+      retVal = 0;
       break;
+    }
+    offset += n;
   }
 
-  // maxReceive is the maximum size of data that can be fetched in a one atomic
-  // receive. If when sending the data-length >= maxReceive, then the sender
-  // splits it into multiple packets of at most maxReceive size each.  (Note
-  // that when the sending exactly maxReceive length message, it is split into 2
-  // packets of sizes maxReceive and 0 respectively).
-  int maxReceive = VTK_INT_MAX;
-
-  // TODO, use the communicator info when it is necessary
-  // there are not enough type and status information in mona currently
-  // MonaCommunicatorReceiveDataInfo info;
-
-  while (this->ReceiveDataInternal(byteData, MonaCommunicatorMin(maxlength, maxReceive), sizeOfType,
-           remoteProcessId, tag, this->MonaComm->Handle, vtkCommunicator::UseCopy,
-           this->LastSenderId) == 0)
-  {
-    remoteProcessId = this->LastSenderId;
-    // TODO, add check, assume all words are recieved
-    int words_received = MonaCommunicatorMin(maxlength, maxReceive);
-    // if (CheckForMPIError(
-    //        MPI_Get_count(&info.Status, mpiType, &words_received)) == 0)
-    //{
-    // Failed.
-    //  return 0;
-    //}
-    this->Count += words_received;
-    byteData += words_received * sizeOfType;
-    maxlength -= words_received;
-    if (words_received < maxReceive)
-    {
-      // words_received in this packet is exactly equal to maxReceive, then it
-      // means that the sender is sending at least one more packet for this
-      // message. Otherwise, we have received all the packets for this message
-      // and we no longer need to iterate.
-      return 1;
+  for (int i = 0; i < window; i++)
+  {
+    if (slots[i] != MONA_REQUEST_NULL && mona_wait(slots[i]) != NA_SUCCESS)
+    {
+      retVal = 0;
     }
   }
-  return 0;
+  for (char* buffer : staging)
+  {
+    MonaCommunicator::Free(buffer);
+  }
+  return retVal;
 }
 
 //----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockSend(
-  const int* data, int length, int remoteProcessId, int tag, Request& req)
+// Receive counterpart of SendChunks, chunkSize and window are the sender's.
+int MonaCommunicator::ReceiveChunks(char* data, na_size_t size, na_size_t chunkSize,
+  int window, int remoteProcessId, int tag)
 {
-    throw std::runtime_error("MonaCommunicator::NoBlockSend not implemented");
-    return 0;
+  DEBUG("{}: size={}, chunkSize={}, window={}, src={}, tag={}", __FUNCTION__, size, chunkSize,
+          window, remoteProcessId, tag);
+  mona_comm_t monacomm = this->MonaComm->Handle;
+  int useCopy = vtkCommunicator::UseCopy;
+  std::vector<mona_request_t> slots(window, MONA_REQUEST_NULL);
+  std::vector<char*> staging(useCopy ? window : 0, nullptr);
+  std::vector<na_size_t> slotOffsets(window, 0);
+  std::vector<na_size_t> slotSizes(window, 0);
+
+  // wait for the chunk held by a slot and copy it out of its staging buffer
+  auto complete = [&](int slot) {
+    na_return_t ret = mona_wait(slots[slot]);
+    slots[slot] = MONA_REQUEST_NULL;
+    if (ret != NA_SUCCESS)
+    {
+      vtkWarningMacro("MoNA error occurred in mona_wait: " << ret);
+      return 0;
+    }
+    if (useCopy)
+    {
+      memcpy(data + slotOffsets[slot], staging[slot], slotSizes[slot]);
+    }
+    return 1;
+  };
+
+  int retVal = 1;
+  na_size_t offset = 0;
+  for (na_size_t chunk = 0; offset < size; chunk++)
+  {
+    int slot = static_cast<int>(chunk % window);
+    if (slots[slot] != MONA_REQUEST_NULL && !complete(slot))
+    {
+      retVal = 0;
+      break;
+    }
+
+    na_size_t n = std::min(chunkSize, size - offset);
+    char* buffer = data + offset;
+    if (useCopy)
+    {
+      if (!staging[slot])
+      {
+        staging[slot] = MonaCommunicator::Allocate(chunkSize);
+      }
+      buffer = staging[slot];
+    }
+    slotOffsets[slot] = offset;
+    slotSizes[slot] = n;
+    na_return_t ret = mona_comm_irecv(monacomm, buffer, n, remoteProcessId,
+      MonaCommunicatorChunkTag(tag, chunk, window), NULL, NULL, NULL, &slots[slot]);
+    if (ret != NA_SUCCESS)
+    {
+      vtkWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+      slots[slot] = MONA_REQUEST_NULL;
+      retVal = 0;
+      break;
+    }
+    offset += n;
+  }
+
+  for (int i = 0; i < window; i++)
+  {
+    if (slots[i] != MONA_REQUEST_NULL && !complete(i))
+    {
+      retVal = 0;
+    }
+  }
+  for (char* buffer : staging)
+  {
+    MonaCommunicator::Free(buffer);
+  }
+  return retVal;
 }
+
 //----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockSend(
-  const unsigned long* data, int length, int remoteProcessId, int tag, Request& req)
+// Multi-segment messages. A list of memory segments goes out as one message
+// without being packed into a contiguous buffer: the envelope (with Segments
+// set) is followed by a table of the piece sizes, run-length encoded as
+// (size, count) pairs, on the payload tag, then by each piece as a message of
+// its own on the chunk tags (the table being chunk 0), with up to
+// ChunksInFlight pieces in flight. The pieces are the segments with the
+// adjacent ones merged and the ones larger than ChunkSize split. A piece is
+// received straight into its destination when it falls within one of the
+// receiver's segments, through a staging buffer otherwise, so both ends
+// describing the same layout (e.g. a halo exchange) involve no copy at all.
+struct MonaCommunicatorSegment
 {
-    throw std::runtime_error("MonaCommunicator::NoBlockSend not implemented");
-    return 0;
-}
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockSend(
-  const char* data, int length, int remoteProcessId, int tag, Request& req)
-{
-    throw std::runtime_error("MonaCommunicator::NoBlockSend not implemented");
-    return 0;
-}
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockSend(
-  const unsigned char* data, int length, int remoteProcessId, int tag, Request& req)
-{
-    throw std::runtime_error("MonaCommunicator::NoBlockSend not implemented");
-    return 0;
-}
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockSend(
-  const float* data, int length, int remoteProcessId, int tag, Request& req)
-{
-    throw std::runtime_error("MonaCommunicator::NoBlockSend not implemented");
-    return 0;
-}
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockSend(
-  const double* data, int length, int remoteProcessId, int tag, Request& req)
-{
-    throw std::runtime_error("MonaCommunicator::NoBlockSend not implemented");
-    return 0;
-}
-#ifdef VTK_USE_64BIT_IDS
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockSend(
-  const vtkIdType* data, int length, int remoteProcessId, int tag, Request& req)
+  char* Data;
+  na_size_t Length;
+};
+
+typedef std::vector<std::pair<uint64_t, uint64_t> > MonaCommunicatorPieceTable;
+
+// Drop the empty segments and merge the ones that follow each other in memory
+static void MonaCommunicatorMergeSegments(std::vector<MonaCommunicatorSegment>& segments)
 {
-    throw std::runtime_error("MonaCommunicator::NoBlockSend not implemented");
-    return 0;
+  size_t count = 0;
+  for (const MonaCommunicatorSegment& segment : segments)
+  {
+    if (segment.Length == 0)
+    {
+      continue;
+    }
+    if (count > 0 && segments[count - 1].Data + segments[count - 1].Length == segment.Data)
+    {
+      segments[count - 1].Length += segment.Length;
+      continue;
+    }
+    segments[count++] = segment;
+  }
+  segments.resize(count);
 }
-#endif
 
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockReceive(
-  int* data, int length, int remoteProcessId, int tag, Request& req)
+// Copy size bytes from source to the segments, starting at offset within
+// segment index, and move the position past them.
+static void MonaCommunicatorScatter(const char* source, na_size_t size,
+  const std::vector<MonaCommunicatorSegment>& segments, size_t& index, na_size_t& offset)
 {
-    throw std::runtime_error("MonaCommunicator::NoBlockReceive not implemented");
-    return 0;
+  while (size > 0 && index < segments.size())
+  {
+    na_size_t n = std::min(size, segments[index].Length - offset);
+    memcpy(segments[index].Data + offset, source, n);
+    source += n;
+    size -= n;
+    offset += n;
+    if (offset == segments[index].Length)
+    {
+      index++;
+      offset = 0;
+    }
+  }
 }
+
 //----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockReceive(
-  unsigned long* data, int length, int remoteProcessId, int tag, Request& req)
+static int MonaCommunicatorSendSegments(mona_comm_t comm,
+  const std::vector<MonaCommunicatorSegment>& segments, na_size_t chunkSize, int window,
+  int remoteProcessId, int tag)
 {
-    throw std::runtime_error("MonaCommunicator::NoBlockReceive not implemented");
+  std::vector<MonaCommunicatorSegment> pieces;
+  MonaCommunicatorPieceTable table;
+  na_size_t total = 0;
+  for (const MonaCommunicatorSegment& segment : segments)
+  {
+    for (na_size_t offset = 0; offset < segment.Length; offset += chunkSize)
+    {
+      na_size_t n = std::min(chunkSize, segment.Length - offset);
+      pieces.push_back({ segment.Data + offset, n });
+      if (!table.empty() && table.back().first == n)
+      {
+        table.back().second++;
+      }
+      else
+      {
+        table.push_back(std::make_pair(static_cast<uint64_t>(n), uint64_t(1)));
+      }
+    }
+    total += segment.Length;
+  }
+
+  MonaCommunicatorEnvelope envelope;
+  envelope.Magic = MONA_COMM_ENVELOPE_MAGIC;
+  envelope.Length = total;
+  envelope.ChunkSize = 0;
+  envelope.ChunksInFlight = window;
+  envelope.Segments = table.size();
+  na_return_t ret = mona_comm_send(
+    comm, &envelope, MonaCommunicatorEnvelopeSize(envelope), remoteProcessId, tag);
+  if (ret == NA_SUCCESS)
+  {
+    ret = mona_comm_send(comm, table.data(), table.size() * sizeof(table[0]), remoteProcessId,
+      MonaCommunicatorPayloadTag(tag));
+  }
+  if (ret != NA_SUCCESS)
+  {
+    vtkGenericWarningMacro("MoNA error occurred in mona_comm_send: " << ret);
     return 0;
+  }
+
+  std::vector<mona_request_t> slots(window, MONA_REQUEST_NULL);
+  int retVal = 1;
+  for (size_t i = 0; i < pieces.size() && retVal; i++)
+  {
+    na_size_t chunk = i + 1;
+    int slot = static_cast<int>(chunk % window);
+    if (slots[slot] != MONA_REQUEST_NULL)
+    {
+      ret = mona_wait(slots[slot]);
+      slots[slot] = MONA_REQUEST_NULL;
+      if (ret != NA_SUCCESS)
+      {
+        vtkGenericWarningMacro("MoNA error occurred in mona_wait: " << ret);
+        retVal = 0;
+        break;
+      }
+    }
+    ret = mona_comm_isend(comm, pieces[i].Data, pieces[i].Length, remoteProcessId,
+      MonaCommunicatorChunkTag(tag, chunk, window), &slots[slot]);
+    if (ret != NA_SUCCESS)
+    {
+      vtkGenericWarningMacro("MoNA error occurred in mona_comm_isend: " << ret);
+      slots[slot] = MONA_REQUEST_NULL;
+      retVal = 0;
+    }
+  }
+  for (mona_request_t slot : slots)
+  {
+    if (slot != MONA_REQUEST_NULL && mona_wait(slot) != NA_SUCCESS)
+    {
+      retVal = 0;
+    }
+  }
+  return retVal;
 }
+
 //----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockReceive(
-  char* data, int length, int remoteProcessId, int tag, Request& req)
+// Receive the pieces of a multi-segment message announced by envelope into
+// segments, which can hold at least envelope.Length bytes.
+static int MonaCommunicatorReceiveSegments(mona_comm_t comm,
+  const MonaCommunicatorEnvelope& envelope,
+  const std::vector<MonaCommunicatorSegment>& segments, int remoteProcessId, int tag)
 {
-    throw std::runtime_error("MonaCommunicator::NoBlockReceive not implemented");
+  int window = static_cast<int>(envelope.ChunksInFlight);
+  if (window == 0 || window > 64 || envelope.Segments > envelope.Length)
+  {
+    vtkGenericWarningMacro("Invalid envelope from " << remoteProcessId);
     return 0;
-}
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockReceive(
-  unsigned char* data, int length, int remoteProcessId, int tag, Request& req)
-{
-    throw std::runtime_error("MonaCommunicator::NoBlockReceive not implemented");
+  }
+  MonaCommunicatorPieceTable table(envelope.Segments);
+  na_size_t tableSize = 0;
+  na_return_t ret = mona_comm_recv(comm, table.data(), table.size() * sizeof(table[0]),
+    remoteProcessId, MonaCommunicatorPayloadTag(tag), &tableSize, NULL, NULL);
+  if (ret != NA_SUCCESS)
+  {
+    vtkGenericWarningMacro("MoNA error occurred in mona_comm_recv: " << ret);
     return 0;
-}
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockReceive(
-  float* data, int length, int remoteProcessId, int tag, Request& req)
-{
-    throw std::runtime_error("MonaCommunicator::NoBlockReceive not implemented");
+  }
+  na_size_t total = 0;
+  for (const auto& run : table)
+  {
+    total += run.first * run.second;
+  }
+  if (tableSize != table.size() * sizeof(table[0]) || total != envelope.Length)
+  {
+    vtkGenericWarningMacro("Invalid segment table from " << remoteProcessId);
     return 0;
+  }
+
+  struct Slot
+  {
+    mona_request_t Handle = MONA_REQUEST_NULL;
+    char* Staging = nullptr;
+    na_size_t Length = 0;
+    size_t Index = 0;
+    na_size_t Offset = 0;
+  };
+  std::vector<Slot> slots(window);
+
+  // wait for the piece held by a slot and scatter it if it was staged
+  auto complete = [&](Slot& slot) {
+    na_return_t waited = mona_wait(slot.Handle);
+    slot.Handle = MONA_REQUEST_NULL;
+    if (slot.Staging)
+    {
+      MonaCommunicatorScatter(slot.Staging, slot.Length, segments, slot.Index, slot.Offset);
+      MonaCommunicator::Free(slot.Staging);
+      slot.Staging = nullptr;
+    }
+    if (waited != NA_SUCCESS)
+    {
+      vtkGenericWarningMacro("MoNA error occurred in mona_wait: " << waited);
+      return 0;
+    }
+    return 1;
+  };
+
+  int retVal = 1;
+  na_size_t chunk = 1;
+  size_t index = 0;
+  na_size_t offset = 0;
+  for (size_t run = 0; run < table.size() && retVal; run++)
+  {
+    for (uint64_t i = 0; i < table[run].second && retVal; i++, chunk++)
+    {
+      Slot& slot = slots[chunk % window];
+      if (slot.Handle != MONA_REQUEST_NULL && !complete(slot))
+      {
+        retVal = 0;
+        break;
+      }
+      na_size_t n = table[run].first;
+      char* buffer;
+      if (segments[index].Length - offset >= n)
+      {
+        buffer = segments[index].Data + offset;
+      }
+      else
+      {
+        slot.Staging = MonaCommunicator::Allocate(n);
+        slot.Length = n;
+        slot.Index = index;
+        slot.Offset = offset;
+        buffer = slot.Staging;
+      }
+      ret = mona_comm_irecv(comm, buffer, n, remoteProcessId,
+        MonaCommunicatorChunkTag(tag, chunk, window), NULL, NULL, NULL, &slot.Handle);
+      if (ret != NA_SUCCESS)
+      {
+        vtkGenericWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+        slot.Handle = MONA_REQUEST_NULL;
+        MonaCommunicator::Free(slot.Staging);
+        slot.Staging = nullptr;
+        retVal = 0;
+        break;
+      }
+      // move the position past the piece
+      while (n > 0)
+      {
+        na_size_t m = std::min(n, segments[index].Length - offset);
+        n -= m;
+        offset += m;
+        if (offset == segments[index].Length)
+        {
+          index++;
+          offset = 0;
+        }
+      }
+    }
+  }
+  for (Slot& slot : slots)
+  {
+    if (slot.Handle != MONA_REQUEST_NULL && !complete(slot))
+    {
+      retVal = 0;
+    }
+  }
+  return retVal;
 }
+
 //----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockReceive(
-  double* data, int length, int remoteProcessId, int tag, Request& req)
+int MonaCommunicator::ReceiveEnvelope(
+  int remoteProcessId, int tag, MonaCommunicatorEnvelope* envelope, int& senderId)
 {
-    throw std::runtime_error("MonaCommunicator::NoBlockReceive not implemented");
+  DEBUG("{}: src={}, tag={}", __FUNCTION__, remoteProcessId, tag);
+  int source = MonaCommunicatorGetSource(remoteProcessId);
+
+  // envelopes already pulled in by Iprobe come first
+  if (this->ProbeState->Find(source, tag, 1, envelope, senderId))
+  {
+    return 1;
+  }
+  if (this->ProbeState->HasCompeting(source, tag))
+  {
+    if (!this->ProbeState->Progress(source, tag, 1))
+    {
+      return 0;
+    }
+    if (this->ProbeState->Find(source, tag, 1, envelope, senderId))
+    {
+      return 1;
+    }
+  }
+
+  senderId = source;
+  na_return_t ret = mona_comm_recv(this->MonaComm->Handle, envelope, sizeof(*envelope), source,
+    tag, NULL, &senderId, NULL);
+  if (ret != NA_SUCCESS)
+  {
+    vtkWarningMacro("MoNA error occurred in mona_comm_recv: " << ret);
     return 0;
-}
-#ifdef VTK_USE_64BIT_IDS
-//----------------------------------------------------------------------------
-int MonaCommunicator::NoBlockReceive(
-  vtkIdType* data, int length, int remoteProcessId, int tag, Request& req)
-{
-    throw std::runtime_error("MonaCommunicator::NoBlockReceive not implemented");
+  }
+  if (envelope->Magic != MONA_COMM_ENVELOPE_MAGIC)
+  {
+    vtkWarningMacro("Received a message without envelope from " << senderId << " on tag " << tag);
     return 0;
+  }
+  return 1;
 }
-#endif
 
 //----------------------------------------------------------------------------
-MonaCommunicator::Request::Request()
+// Nonblocking operations are timed from the call that starts them to the
+// AdvanceRequest that completes them.
+static void MonaCommunicatorStartMetrics(
+  MonaCommunicatorOpaqueRequest* r, MonaMetrics::Operation op, uint64_t bytes)
 {
-  DEBUG("{}", __FUNCTION__);
-  this->Req = new MonaCommunicatorOpaqueRequest;
+  if (MonaMetrics::GetEnabled())
+  {
+    r->MetricsOperation = op;
+    r->MetricsStart = MonaMetrics::Now();
+    r->MetricsBytes = bytes;
+  }
 }
 
-//----------------------------------------------------------------------------
-MonaCommunicator::Request::Request(const MonaCommunicator::Request& src)
+// Records the request when the AdvanceRequest it lives in completes it.
+class MonaCommunicatorRequestMetrics
 {
-  DEBUG("{}", __FUNCTION__);
-  this->Req = new MonaCommunicatorOpaqueRequest;
-  this->Req->Handle = src.Req->Handle;
-}
+public:
+  MonaCommunicatorRequestMetrics(MonaCommunicatorOpaqueRequest* r)
+    : Req(r)
+    , Pending(r->State != MONA_COMM_REQUEST_DONE)
+  {
+  }
 
-//----------------------------------------------------------------------------
-MonaCommunicator::Request& MonaCommunicator::Request::operator=(
-  const MonaCommunicator::Request& src)
-{
-  DEBUG("{}", __FUNCTION__);
-  if (this == &src)
+  ~MonaCommunicatorRequestMetrics()
   {
-    return *this;
+    MonaCommunicatorOpaqueRequest* r = this->Req;
+    if (!this->Pending || r->MetricsOperation < 0 || r->State != MONA_COMM_REQUEST_DONE)
+    {
+      return;
+    }
+    auto op = static_cast<MonaMetrics::Operation>(r->MetricsOperation);
+    int p2p = op == MonaMetrics::SEND || op == MonaMetrics::RECEIVE;
+    uint64_t bytes = r->IsReceive ? r->Envelope.Length : r->MetricsBytes;
+    MonaMetrics::Record(op, p2p ? r->Tag : -1, bytes, MonaMetrics::Now() - r->MetricsStart);
+    r->MetricsOperation = -1;
   }
-  this->Req->Handle = src.Req->Handle;
-  return *this;
-}
+
+private:
+  MonaCommunicatorRequestMetrics(const MonaCommunicatorRequestMetrics&) = delete;
+  void operator=(const MonaCommunicatorRequestMetrics&) = delete;
+
+  MonaCommunicatorOpaqueRequest* Req;
+  int Pending;
+};
 
 //----------------------------------------------------------------------------
-MonaCommunicator::Request::~Request()
+int MonaCommunicator::NoBlockSendInternal(
+  const void* data, na_size_t size, int remoteProcessId, int tag, Request& req)
 {
-  DEBUG("{}", __FUNCTION__);
-  delete this->Req;
+  DEBUG("{}: size={}, dest={}, tag={}", __FUNCTION__, size, remoteProcessId, tag);
+  if (!this->CheckTag(tag))
+  {
+    return 0;
+  }
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  r->Reset();
+  r->Communicator = this;
+  r->Buffer = const_cast<void*>(data);
+  r->Capacity = size;
+  r->Source = remoteProcessId;
+  r->Tag = tag;
+  r->Envelope.Magic = MONA_COMM_ENVELOPE_MAGIC;
+  r->Envelope.Length = size;
+  r->Envelope.ChunkSize = 0;
+  r->Envelope.ChunksInFlight = 0;
+  r->Envelope.Segments = 0;
+  return this->StartSendInternal(r);
 }
 
 //----------------------------------------------------------------------------
-int MonaCommunicator::Request::Test()
+// Post the envelope and the payload of a send set up in r. An eager payload
+// is copied into the envelope at this point, for persistent requests too.
+int MonaCommunicator::StartSendInternal(MonaCommunicatorOpaqueRequest* r)
 {
-  DEBUG("{}", __FUNCTION__);
-  int retVal;
-  int err = mona_test(this->Req->Handle, &retVal);
-
-  if (err == NA_SUCCESS)
+  MonaCommunicatorStartMetrics(r, MonaMetrics::SEND, r->Capacity);
+  mona_comm_t monacomm = this->MonaComm->Handle;
+  int eager = MonaCommunicatorIsEager(r->Envelope);
+  if (eager && r->Capacity > 0)
   {
-    return retVal;
+    memcpy(r->Envelope.Eager, r->Buffer, r->Capacity);
   }
-  else
+  na_return_t ret = mona_comm_isend(monacomm, &r->Envelope,
+    MonaCommunicatorEnvelopeSize(r->Envelope), r->Source, r->Tag, &r->EnvelopeHandle);
+  if (ret != NA_SUCCESS)
+  {
+    vtkWarningMacro("MoNA error occurred in mona_comm_isend: " << ret);
+    r->EnvelopeHandle = MONA_REQUEST_NULL;
+    return 0;
+  }
+  if (eager)
   {
-    vtkGenericWarningMacro("MoNA error occurred in mona_test: " << err);
+    r->State = MONA_COMM_REQUEST_PAYLOAD;
+    return 1;
+  }
+  ret = mona_comm_isend(monacomm, r->Buffer, r->Capacity, r->Source,
+    MonaCommunicatorPayloadTag(r->Tag), &r->Handle);
+  if (ret != NA_SUCCESS)
+  {
+    vtkWarningMacro("MoNA error occurred in mona_comm_isend: " << ret);
+    r->Handle = MONA_REQUEST_NULL;
+    int flag;
+    MonaCommunicatorProgressHandle(r->EnvelopeHandle, 1, flag);
     return 0;
   }
+  r->State = MONA_COMM_REQUEST_PAYLOAD;
+  return 1;
 }
 
 //----------------------------------------------------------------------------
-void MonaCommunicator::Request::Wait()
+int MonaCommunicator::NoBlockReceiveInternal(
+  void* data, na_size_t size, int remoteProcessId, int tag, Request& req)
 {
-  DEBUG("{}", __FUNCTION__);
-
-  int err = mona_wait(this->Req->Handle);
-
-  if (err != NA_SUCCESS)
+  DEBUG("{}: size={}, src={}, tag={}", __FUNCTION__, size, remoteProcessId, tag);
+  if (!this->CheckTag(tag))
   {
-    vtkGenericWarningMacro("MoNA error occurred in mona_wait: " << err);
+    return 0;
   }
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  int source = MonaCommunicatorGetSource(remoteProcessId);
+  r->Reset();
+  r->Communicator = this;
+  r->IsReceive = 1;
+  r->Buffer = data;
+  r->Capacity = size;
+  r->Source = source;
+  r->Tag = tag;
+  r->Sender = source;
+  return this->StartReceiveInternal(r);
 }
 
 //----------------------------------------------------------------------------
-void MonaCommunicator::Request::Cancel()
+// Post a receive set up in r. Only the envelope receive is posted here, the
+// payload (unless it came in the envelope) is received by AdvanceRequest
+// once the envelope told where it comes from and how it is sent. It cannot
+// be pre-posted: a small message would leave it behind, waiting for the
+// payload of the next message.
+int MonaCommunicator::StartReceiveInternal(MonaCommunicatorOpaqueRequest* r)
 {
-  DEBUG("{}", __FUNCTION__);
-    vtkGenericWarningMacro("Cancelling a MoNA request is not supported");
+  MonaCommunicatorStartMetrics(r, MonaMetrics::RECEIVE, 0);
+  mona_comm_t monacomm = this->MonaComm->Handle;
+  int source = r->Source;
+  int tag = r->Tag;
+  if (!this->ProbeState->Posted.empty() && !this->ProbeState->Progress(source, tag, 0))
+  {
+    return 0;
+  }
+  if (this->ProbeState->Find(source, tag, 1, &r->Envelope, r->Sender))
+  {
+    r->State = MONA_COMM_REQUEST_HAVE_ENVELOPE;
+    return MonaCommunicator::AdvanceRequest(r, 0);
+  }
+  if (this->ProbeState->HasCompeting(source, tag))
+  {
+    // an Iprobe receive may still catch our envelope, wait for it to resolve
+    r->State = MONA_COMM_REQUEST_PENDING_ENVELOPE;
+    return 1;
+  }
+
+  na_return_t ret = mona_comm_irecv(monacomm, &r->Envelope, sizeof(r->Envelope), source, tag,
+    NULL, &r->Sender, NULL, &r->EnvelopeHandle);
+  if (ret != NA_SUCCESS)
+  {
+    vtkWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+    r->EnvelopeHandle = MONA_REQUEST_NULL;
+    return 0;
+  }
+  r->State = MONA_COMM_REQUEST_ENVELOPE;
+  return 1;
 }
 
-//-----------------------------------------------------------------------------
-void MonaCommunicator::Barrier()
+//----------------------------------------------------------------------------
+// Check the envelope of a multi-segment message before its piece table is
+// received into a request.
+static int MonaCommunicatorCheckSegmentsEnvelope(const MonaCommunicatorOpaqueRequest* req)
 {
-  DEBUG("{}", __FUNCTION__);
-  mona_comm_barrier(this->MonaComm->Handle, 0);
+  if (req->Envelope.ChunksInFlight == 0 || req->Envelope.ChunksInFlight > 64 ||
+    req->Envelope.Segments > req->Envelope.Length || req->Envelope.Length > req->Capacity)
+  {
+    vtkGenericWarningMacro("Invalid envelope or message too long (" << req->Envelope.Length
+                                                                     << " bytes) from "
+                                                                     << req->Sender);
+    return 0;
+  }
+  return 1;
 }
 
 //----------------------------------------------------------------------------
-int MonaCommunicator::BroadcastVoidArray(void* data, vtkIdType length, int type, int root)
+// Move a request through its states as far as possible. Returns 0 on error,
+// the request is complete once its State is MONA_COMM_REQUEST_DONE.
+int MonaCommunicator::AdvanceRequest(MonaCommunicatorOpaqueRequest* req, int blocking)
 {
-  DEBUG("{}: length={}, type={}, root={}",
-          __FUNCTION__, length, type, root);
-  if (!MonaCommunicatorCheckSize(length))
-    return 0;
+  MonaCommunicatorRequestMetrics metrics(req);
+  int flag = 0;
+  if (req->State == MONA_COMM_REQUEST_PENDING_ENVELOPE)
+  {
+    MonaCommunicatorProbeState* probes = req->Communicator->ProbeState;
+    if (blocking)
+    {
+      if (!req->Communicator->ReceiveEnvelope(req->Source, req->Tag, &req->Envelope, req->Sender))
+      {
+        req->State = MONA_COMM_REQUEST_DONE;
+        return 0;
+      }
+      req->State = MONA_COMM_REQUEST_HAVE_ENVELOPE;
+    }
+    else
+    {
+      if (!probes->Progress(req->Source, req->Tag, 0))
+      {
+        return 0;
+      }
+      if (probes->Find(req->Source, req->Tag, 1, &req->Envelope, req->Sender))
+      {
+        req->State = MONA_COMM_REQUEST_HAVE_ENVELOPE;
+      }
+      else if (!probes->HasCompeting(req->Source, req->Tag))
+      {
+        na_return_t ret = mona_comm_irecv(req->Communicator->MonaComm->Handle, &req->Envelope,
+          sizeof(req->Envelope), req->Source, req->Tag, NULL, &req->Sender, NULL,
+          &req->EnvelopeHandle);
+        if (ret != NA_SUCCESS)
+        {
+          vtkGenericWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+          req->EnvelopeHandle = MONA_REQUEST_NULL;
+          req->State = MONA_COMM_REQUEST_DONE;
+          return 0;
+        }
+        req->State = MONA_COMM_REQUEST_ENVELOPE;
+      }
+      else
+      {
+        return 1;
+      }
+    }
+  }
 
-  // check the type length
-  int sizeOfType;
-  switch (type)
+  if (req->State == MONA_COMM_REQUEST_ENVELOPE)
   {
-    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
-    default:
-      vtkWarningMacro(<< "Invalid data type " << type);
-      sizeOfType = 1;
-      break;
+    if (!MonaCommunicatorProgressHandle(req->EnvelopeHandle, blocking, flag))
+    {
+      req->State = MONA_COMM_REQUEST_DONE;
+      return 0;
+    }
+    if (!flag)
+    {
+      return 1;
+    }
+    req->State = MONA_COMM_REQUEST_HAVE_ENVELOPE;
+  }
+
+  if (req->State == MONA_COMM_REQUEST_HAVE_ENVELOPE)
+  {
+    if (req->Envelope.Magic != MONA_COMM_ENVELOPE_MAGIC || req->Envelope.Length > req->Capacity)
+    {
+      vtkGenericWarningMacro("Invalid envelope or message too long (" << req->Envelope.Length
+                                                                       << " bytes) from "
+                                                                       << req->Sender);
+      req->State = MONA_COMM_REQUEST_DONE;
+      return 0;
+    }
+    if (MonaCommunicatorIsEager(req->Envelope))
+    {
+      if (req->Envelope.Length > 0)
+      {
+        memcpy(req->Buffer, req->Envelope.Eager, req->Envelope.Length);
+      }
+      req->State = MONA_COMM_REQUEST_DONE;
+      return 1;
+    }
+    // the piece table of a multi-segment message comes first
+    if (req->Envelope.Segments != 0)
+    {
+      if (!MonaCommunicatorCheckSegmentsEnvelope(req))
+      {
+        req->State = MONA_COMM_REQUEST_DONE;
+        return 0;
+      }
+      req->Pieces.resize(req->Envelope.Segments);
+      na_return_t ret = mona_comm_irecv(req->Communicator->MonaComm->Handle,
+        req->Pieces.data(), req->Pieces.size() * sizeof(req->Pieces[0]), req->Sender,
+        MonaCommunicatorPayloadTag(req->Tag), NULL, NULL, NULL, &req->Handle);
+      if (ret != NA_SUCCESS)
+      {
+        vtkGenericWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+        req->Handle = MONA_REQUEST_NULL;
+        req->State = MONA_COMM_REQUEST_DONE;
+        return 0;
+      }
+      req->Chunk = 0;
+      req->State = MONA_COMM_REQUEST_SEGMENTS;
+    }
+    else
+    {
+      na_return_t ret = mona_comm_irecv(req->Communicator->MonaComm->Handle, req->Buffer,
+        req->Envelope.Length, req->Sender, MonaCommunicatorPayloadTag(req->Tag), NULL, NULL,
+        NULL, &req->Handle);
+      if (ret != NA_SUCCESS)
+      {
+        vtkGenericWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+        req->Handle = MONA_REQUEST_NULL;
+        req->State = MONA_COMM_REQUEST_DONE;
+        return 0;
+      }
+      req->State = MONA_COMM_REQUEST_PAYLOAD;
+    }
+  }
+
+  if (req->State == MONA_COMM_REQUEST_PAYLOAD)
+  {
+    int retVal = MonaCommunicatorProgressHandle(req->EnvelopeHandle, blocking, flag);
+    if (retVal && flag)
+    {
+      retVal = MonaCommunicatorProgressHandle(req->Handle, blocking, flag);
+    }
+    if (!retVal)
+    {
+      req->State = MONA_COMM_REQUEST_DONE;
+      return 0;
+    }
+    if (!flag)
+    {
+      return 1;
+    }
+    req->State = MONA_COMM_REQUEST_DONE;
+
+    // a blocking SendVoidArray may have split the payload, what arrived so
+    // far is its first chunk
+    if (req->IsReceive && req->Envelope.ChunkSize != 0)
+    {
+      if (req->Envelope.Length > req->Capacity || req->Envelope.ChunksInFlight == 0)
+      {
+        vtkGenericWarningMacro("Invalid envelope or message too long (" << req->Envelope.Length
+                                                                         << " bytes) from "
+                                                                         << req->Sender);
+        return 0;
+      }
+      req->Offset = std::min<na_size_t>(req->Envelope.ChunkSize, req->Envelope.Length);
+      req->Chunk = 1;
+      req->State = MONA_COMM_REQUEST_CHUNKS;
+    }
+  }
+
+  // the remaining chunks are received one at a time
+  while (req->State == MONA_COMM_REQUEST_CHUNKS)
+  {
+    if (req->Handle == MONA_REQUEST_NULL)
+    {
+      if (req->Offset >= req->Envelope.Length)
+      {
+        req->State = MONA_COMM_REQUEST_DONE;
+        break;
+      }
+      na_size_t n = std::min<na_size_t>(req->Envelope.ChunkSize,
+        req->Envelope.Length - req->Offset);
+      na_return_t ret = mona_comm_irecv(req->Communicator->MonaComm->Handle,
+        static_cast<char*>(req->Buffer) + req->Offset, n, req->Sender,
+        MonaCommunicatorChunkTag(req->Tag, req->Chunk, req->Envelope.ChunksInFlight), NULL,
+        NULL, NULL, &req->Handle);
+      if (ret != NA_SUCCESS)
+      {
+        vtkGenericWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+        req->Handle = MONA_REQUEST_NULL;
+        req->State = MONA_COMM_REQUEST_DONE;
+        return 0;
+      }
+      req->Offset += n;
+      req->Chunk++;
+    }
+    if (!MonaCommunicatorProgressHandle(req->Handle, blocking, flag))
+    {
+      req->State = MONA_COMM_REQUEST_DONE;
+      return 0;
+    }
+    if (!flag)
+    {
+      return 1;
+    }
+  }
+
+  // the pieces of a multi-segment message are received one at a time too,
+  // straight into place since the buffer is contiguous. Chunk is 0 until
+  // the piece table is in.
+  while (req->State == MONA_COMM_REQUEST_SEGMENTS)
+  {
+    if (req->Handle == MONA_REQUEST_NULL)
+    {
+      if (req->Chunk == 0)
+      {
+        na_size_t total = 0;
+        for (const auto& run : req->Pieces)
+        {
+          total += run.first * run.second;
+        }
+        if (total != req->Envelope.Length)
+        {
+          vtkGenericWarningMacro("Invalid segment table from " << req->Sender);
+          req->State = MONA_COMM_REQUEST_DONE;
+          return 0;
+        }
+        req->Offset = 0;
+        req->Chunk = 1;
+        req->Run = 0;
+        req->RunPiece = 0;
+      }
+      while (req->Run < req->Pieces.size() && req->RunPiece == req->Pieces[req->Run].second)
+      {
+        req->Run++;
+        req->RunPiece = 0;
+      }
+      if (req->Run == req->Pieces.size())
+      {
+        req->State = MONA_COMM_REQUEST_DONE;
+        break;
+      }
+      na_size_t n = req->Pieces[req->Run].first;
+      na_return_t ret = mona_comm_irecv(req->Communicator->MonaComm->Handle,
+        static_cast<char*>(req->Buffer) + req->Offset, n, req->Sender,
+        MonaCommunicatorChunkTag(req->Tag, req->Chunk, req->Envelope.ChunksInFlight), NULL,
+        NULL, NULL, &req->Handle);
+      if (ret != NA_SUCCESS)
+      {
+        vtkGenericWarningMacro("MoNA error occurred in mona_comm_irecv: " << ret);
+        req->Handle = MONA_REQUEST_NULL;
+        req->State = MONA_COMM_REQUEST_DONE;
+        return 0;
+      }
+      req->Offset += n;
+      req->Chunk++;
+      req->RunPiece++;
+    }
+    if (!MonaCommunicatorProgressHandle(req->Handle, blocking, flag))
+    {
+      req->State = MONA_COMM_REQUEST_DONE;
+      return 0;
+    }
+    if (!flag)
+    {
+      return 1;
+    }
+  }
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::IprobeInternal(
+  int source, int tag, int* flag, int* actualSource, int sizeoftype, int* size)
+{
+  DEBUG("{}: src={}, tag={}", __FUNCTION__, source, tag);
+  if (!this->CheckTag(tag))
+  {
+    return 0;
+  }
+  source = MonaCommunicatorGetSource(source);
+  *flag = 0;
+
+  MonaCommunicatorEnvelope envelope;
+  int sender;
+  if (!this->ProbeState->Find(source, tag, 0, &envelope, sender))
+  {
+    if (!this->ProbeState->Post(this->MonaComm->Handle, source, tag) ||
+      !this->ProbeState->Progress(source, tag, 0))
+    {
+      return 0;
+    }
+    if (!this->ProbeState->Find(source, tag, 0, &envelope, sender))
+    {
+      return 1;
+    }
+  }
+
+  *flag = 1;
+  if (actualSource)
+  {
+    *actualSource = sender;
+  }
+  if (size)
+  {
+    *size = static_cast<int>(envelope.Length / sizeoftype);
+  }
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// Reduction kernels handed to mona_comm_reduce/allreduce. Each kernel is a
+// plain element-wise loop over contiguous buffers (no aliasing, no branches
+// the compiler cannot turn into selects), so large reductions vectorize.
+struct MonaCommunicatorMaxOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return (b < a) ? a : b; }
+};
+struct MonaCommunicatorMinOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return (a < b) ? a : b; }
+};
+struct MonaCommunicatorSumOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(a + b); }
+};
+struct MonaCommunicatorProductOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(a * b); }
+};
+struct MonaCommunicatorLogicalAndOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(a && b); }
+};
+struct MonaCommunicatorLogicalOrOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(a || b); }
+};
+struct MonaCommunicatorLogicalXorOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(!a != !b); }
+};
+struct MonaCommunicatorBitwiseAndOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(a & b); }
+};
+struct MonaCommunicatorBitwiseOrOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(a | b); }
+};
+struct MonaCommunicatorBitwiseXorOp
+{
+  template <typename T>
+  static T Apply(T a, T b) { return static_cast<T>(a ^ b); }
+};
+
+template <typename T, typename Op>
+static void MonaCommunicatorReduceKernel(
+  const void* in, void* inout, na_size_t typesize, na_size_t count, void* uargs)
+{
+  (void)typesize;
+  (void)uargs;
+  const T* __restrict src = static_cast<const T*>(in);
+  T* __restrict dst = static_cast<T*>(inout);
+  for (na_size_t i = 0; i < count; ++i)
+  {
+    dst[i] = Op::Apply(src[i], dst[i]);
+  }
+}
+
+// Bitwise operations only make sense on integral types; floating point types
+// get no kernel and the reduction is rejected.
+template <typename T, typename Op>
+static mona_op_t MonaCommunicatorBitwiseKernel(std::true_type)
+{
+  return &MonaCommunicatorReduceKernel<T, Op>;
+}
+
+template <typename T, typename Op>
+static mona_op_t MonaCommunicatorBitwiseKernel(std::false_type)
+{
+  return nullptr;
+}
+
+template <typename T>
+static mona_op_t MonaCommunicatorGetReduceKernel(int operation, T*)
+{
+  typedef typename std::is_integral<T>::type IsIntegral;
+  switch (operation)
+  {
+    case vtkCommunicator::MAX_OP:
+      return &MonaCommunicatorReduceKernel<T, MonaCommunicatorMaxOp>;
+    case vtkCommunicator::MIN_OP:
+      return &MonaCommunicatorReduceKernel<T, MonaCommunicatorMinOp>;
+    case vtkCommunicator::SUM_OP:
+      return &MonaCommunicatorReduceKernel<T, MonaCommunicatorSumOp>;
+    case vtkCommunicator::PRODUCT_OP:
+      return &MonaCommunicatorReduceKernel<T, MonaCommunicatorProductOp>;
+    case vtkCommunicator::LOGICAL_AND_OP:
+      return &MonaCommunicatorReduceKernel<T, MonaCommunicatorLogicalAndOp>;
+    case vtkCommunicator::LOGICAL_OR_OP:
+      return &MonaCommunicatorReduceKernel<T, MonaCommunicatorLogicalOrOp>;
+    case vtkCommunicator::LOGICAL_XOR_OP:
+      return &MonaCommunicatorReduceKernel<T, MonaCommunicatorLogicalXorOp>;
+    case vtkCommunicator::BITWISE_AND_OP:
+      return MonaCommunicatorBitwiseKernel<T, MonaCommunicatorBitwiseAndOp>(IsIntegral());
+    case vtkCommunicator::BITWISE_OR_OP:
+      return MonaCommunicatorBitwiseKernel<T, MonaCommunicatorBitwiseOrOp>(IsIntegral());
+    case vtkCommunicator::BITWISE_XOR_OP:
+      return MonaCommunicatorBitwiseKernel<T, MonaCommunicatorBitwiseXorOp>(IsIntegral());
+    default:
+      return nullptr;
+  }
+}
+
+// Look up the kernel and element size for a VTK type / standard operation
+// pair. Returns 0 if the pair is not supported.
+static int MonaCommunicatorGetReduceOperation(
+  int type, int operation, mona_op_t& monaop, na_size_t& typesize)
+{
+  monaop = nullptr;
+  typesize = 0;
+  switch (type)
+  {
+    vtkTemplateMacro(
+      monaop = MonaCommunicatorGetReduceKernel(operation, static_cast<VTK_TT*>(nullptr));
+      typesize = sizeof(VTK_TT));
+    default:
+      break;
+  }
+  return monaop != nullptr;
+}
+
+// Size in bytes of one element of the given VTK type, 0 if unknown.
+static na_size_t MonaCommunicatorGetTypeSize(int type)
+{
+  switch (type)
+  {
+    vtkTemplateMacro(return sizeof(VTK_TT));
+    default:
+      return 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Bridge a vtkCommunicator::Operation to a mona_op_t. The operation and the
+// VTK type travel through the op's user arguments (which live on the caller's
+// stack for the duration of the collective), so concurrent reductions on
+// different ULTs do not share any state.
+struct MonaCommunicatorUserOperation
+{
+  vtkCommunicator::Operation* Operation;
+  int Type;
+};
+
+static void MonaCommunicatorUserFunction(
+  const void* in, void* inout, na_size_t typesize, na_size_t count, void* uargs)
+{
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  (void)typesize;
+  auto op = static_cast<MonaCommunicatorUserOperation*>(uargs);
+  op->Operation->Function(in, inout, static_cast<vtkIdType>(count), op->Type);
+}
+
+//----------------------------------------------------------------------------
+// Return the world communicator (i.e. MPI_COMM_WORLD).
+// Create one if necessary (singleton).
+MonaCommunicator* MonaCommunicator::GetWorldCommunicatorByMona(mona_comm_t mona_comm)
+{
+  DEBUG("{}: comm={}", __FUNCTION__, (void*)mona_comm);
+
+  if (MonaCommunicator::WorldCommunicator == 0)
+  {
+    MonaCommunicator* comm = MonaCommunicator::New();
+    comm->MonaComm->Handle = mona_comm;
+    comm->InitializeNumberOfProcesses();
+    comm->Initialized = 1;
+    comm->KeepHandleOn();
+    MonaCommunicator::WorldCommunicator = comm;
+  }
+  return MonaCommunicator::WorldCommunicator;
+}
+
+MonaCommunicator* MonaCommunicator::GetWorldCommunicator()
+{
+  DEBUG("{}", __FUNCTION__);
+  int err, size;
+
+  if (MonaCommunicator::WorldCommunicator == 0)
+  {
+      throw std::runtime_error("MonaCommunicator::GetWorldCommunicator: WorldCommunicator not set "
+              "(use MonaCommunicator::GetWorldCommunicatorByMona instead)");
+  }
+  return MonaCommunicator::WorldCommunicator;
+}
+
+//----------------------------------------------------------------------------
+void MonaCommunicator::PrintSelf(ostream& os, vtkIndent indent)
+{
+  DEBUG("{}", __FUNCTION__);
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "MPI Communicator handler: ";
+  if (this->MonaComm->Handle)
+  {
+    os << this->MonaComm->Handle << endl;
+  }
+  else
+  {
+    os << "(none)\n";
+  }
+  os << indent << "UseSsend: " << (this->UseSsend ? "On" : " Off") << endl;
+  os << indent << "ChunkSize: " << this->ChunkSize << endl;
+  os << indent << "ChunksInFlight: " << this->ChunksInFlight << endl;
+  os << indent << "HierarchicalCollectives: " << (this->HierarchicalCollectives ? "On" : "Off")
+     << endl;
+  os << indent << "AllReduceRingThreshold: " << this->AllReduceRingThreshold << endl;
+  os << indent << "BroadcastPipelineThreshold: " << this->BroadcastPipelineThreshold << endl;
+  os << indent << "BroadcastSegmentSize: " << this->BroadcastSegmentSize << endl;
+  os << indent << "Initialized: " << (this->Initialized ? "On\n" : "Off\n");
+  os << indent << "Keep handle: " << (this->KeepHandle ? "On\n" : "Off\n");
+  if (this != MonaCommunicator::WorldCommunicator)
+  {
+    os << indent << "World communicator: ";
+    if (MonaCommunicator::WorldCommunicator)
+    {
+      os << endl;
+      MonaCommunicator::WorldCommunicator->PrintSelf(os, indent.GetNextIndent());
+    }
+    else
+    {
+      os << "(none)";
+    }
+    os << endl;
+  }
+  return;
+}
+
+//----------------------------------------------------------------------------
+MonaCommunicator::MonaCommunicator()
+{
+  DEBUG("{} constructor", __FUNCTION__);
+  this->MonaComm = new MonaCommunicatorOpaqueComm;
+  this->Initialized = 0;
+  this->KeepHandle = 0;
+  this->LastSenderId = -1;
+  this->UseSsend = 0;
+  this->ChunkSize = vtkIdType(64) << 20;
+  this->ChunksInFlight = 4;
+  this->HierarchicalCollectives = 0;
+  this->AllReduceRingThreshold = vtkIdType(512) << 10;
+  this->BroadcastPipelineThreshold = vtkIdType(1) << 20;
+  this->BroadcastSegmentSize = vtkIdType(256) << 10;
+  this->ProbeState = new MonaCommunicatorProbeState;
+}
+
+//----------------------------------------------------------------------------
+MonaCommunicator::~MonaCommunicator()
+{
+  DEBUG("{} destructor", __FUNCTION__);
+  // MoNA cannot cancel a receive, envelopes still awaited by Iprobe are leaked
+  if (!this->ProbeState->Posted.empty())
+  {
+    vtkWarningMacro(<< this->ProbeState->Posted.size() << " Iprobe receives still pending");
+  }
+  delete this->ProbeState;
+  // Free the handle if required and asked for.
+  if (this->MonaComm)
+  {
+    // The world handle is owned by the caller, but the subsets cached for it
+    // are ours.
+    if (this->MonaComm->Handle && (!this->KeepHandle || this == MonaCommunicator::WorldCommunicator))
+    {
+      MonaCommunicatorSubsetCache::Release(this->MonaComm->Handle);
+      MonaTags::Release(this->MonaComm->Handle);
+    }
+    if (this->MonaComm->Handle && !this->KeepHandle)
+    {
+      if (this->MonaComm->Handle != NULL)
+      {
+        mona_comm_free(this->MonaComm->Handle);
+      }
+    }
+    delete this->MonaComm;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::Initialize(vtkProcessGroup* group)
+{
+  DEBUG("{}: group={}", __FUNCTION__, (void*)group);
+  MonaCommunicator* parent = MonaCommunicator::SafeDownCast(group->GetCommunicator());
+  if (!parent)
+  {
+    vtkErrorMacro("The group is not attached to a MonaCommunicator.");
+    return 0;
+  }
+  if (!parent->Initialized)
+  {
+    vtkErrorMacro("The group's communicator is not initialized.");
+    return 0;
+  }
+
+  std::vector<int> ranks(group->GetNumberOfProcessIds());
+  bool isMember = false;
+  for (size_t i = 0; i < ranks.size(); i++)
+  {
+    ranks[i] = group->GetProcessId(static_cast<int>(i));
+    isMember = isMember || (ranks[i] == parent->LocalProcessId);
+  }
+
+  // Like MPI_Comm_create, processes outside the group end up without a
+  // handle, which is not an error.
+  if (!isMember)
+  {
+    this->Modified();
+    return 1;
+  }
+  return this->InitializeSubset(parent, ranks);
+}
+
+//-----------------------------------------------------------------------------
+// MoNA has no split, exchange the (color, key) pairs and build the subset of
+// processes sharing our color, ordered by key then by rank in oldcomm.
+int MonaCommunicator::SplitInitialize(vtkCommunicator* oldcomm, int color, int key)
+{
+  DEBUG("{}: color={}, key={}", __FUNCTION__, color, key);
+  MonaCommunicator* parent = MonaCommunicator::SafeDownCast(oldcomm);
+  if (!parent)
+  {
+    vtkErrorMacro("Split communicator must be a MonaCommunicator.");
+    return 0;
+  }
+
+  int numProcs = parent->NumberOfProcesses;
+  int local[2] = { color, key };
+  std::vector<int> all(2 * numProcs);
+  na_return_t ret = mona_comm_allgather(
+    parent->MonaComm->Handle, local, sizeof(local), all.data(),
+    MonaCommunicatorCollectiveTag(parent->MonaComm->Handle));
+  if (ret != NA_SUCCESS)
+  {
+    vtkErrorMacro("mona_comm_allgather failed with status " << ret);
+    return 0;
+  }
+
+  // A negative color (e.g. MPI_UNDEFINED) excludes this process, which like
+  // MPI_Comm_split gets no handle and is not an error.
+  if (color < 0)
+  {
+    this->Modified();
+    return 1;
+  }
+
+  std::vector<std::pair<int, int> > members;
+  for (int i = 0; i < numProcs; i++)
+  {
+    if (all[2 * i] == color)
+    {
+      members.push_back(std::make_pair(all[2 * i + 1], i));
+    }
+  }
+  std::sort(members.begin(), members.end());
+
+  std::vector<int> ranks(members.size());
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    ranks[i] = members[i].second;
+  }
+  return this->InitializeSubset(parent, ranks);
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::InitializeSubset(MonaCommunicator* parent, const std::vector<int>& ranks)
+{
+  DEBUG("{}: parent={}, size={}", __FUNCTION__, (void*)parent, ranks.size());
+  mona_comm_t subset = MonaCommunicatorSubsetCache::Get(parent->MonaComm->Handle, ranks);
+  if (!subset)
+  {
+    vtkErrorMacro("Could not create a subset of " << ranks.size() << " processes.");
+    return 0;
+  }
+  // the cache keeps the subset, our own copy of it keeps our traffic and
+  // collective tags apart from the other users of the same membership
+  mona_comm_t handle = nullptr;
+  na_return_t ret = mona_comm_dup(subset, &handle);
+  if (ret != NA_SUCCESS)
+  {
+    vtkErrorMacro("mona_comm_dup failed with status " << ret);
+    return 0;
+  }
+
+  this->ReleaseHandle();
+  this->MonaComm->Handle = handle;
+  this->KeepHandleOff();
+  this->InitializeNumberOfProcesses();
+  this->Initialized = 1;
+  this->Modified();
+  return 1;
+}
+
+int MonaCommunicator::InitializeExternal(MonaCommunicatorOpaqueComm* comm)
+{
+  DEBUG("{}: comm={}, mona_comm={}", __FUNCTION__, (void*)comm, (void*)comm->GetHandle());
+  this->KeepHandleOn();
+  free(this->MonaComm->Handle); // XXX ??
+  this->MonaComm->Handle = comm->GetHandle();
+  this->InitializeNumberOfProcesses();
+  this->Initialized = 1;
+
+  this->Modified();
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// Start the copying process
+
+void MonaCommunicator::InitializeCopy(MonaCommunicator* source)
+{
+  DEBUG("{}: source={}", __FUNCTION__, (void*)source);
+  if (!source)
+  {
+    return;
+  }
+
+  this->LocalProcessId = source->LocalProcessId;
+  this->NumberOfProcesses = source->NumberOfProcesses;
+  this->MaximumNumberOfProcesses = source->MaximumNumberOfProcesses;
+  this->Initialized = source->Initialized;
+  this->UseSsend = source->UseSsend;
+  this->ChunkSize = source->ChunkSize;
+  this->ChunksInFlight = source->ChunksInFlight;
+  this->HierarchicalCollectives = source->HierarchicalCollectives;
+  this->AllReduceRingThreshold = source->AllReduceRingThreshold;
+  this->BroadcastPipelineThreshold = source->BroadcastPipelineThreshold;
+  this->BroadcastSegmentSize = source->BroadcastSegmentSize;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+// Give up the current handle, freeing it if we own it.
+void MonaCommunicator::ReleaseHandle()
+{
+  DEBUG("{}", __FUNCTION__);
+  if (this->MonaComm->Handle && !this->KeepHandle)
+  {
+    MonaCommunicatorSubsetCache::Release(this->MonaComm->Handle);
+    MonaTags::Release(this->MonaComm->Handle);
+    mona_comm_free(this->MonaComm->Handle);
+  }
+  this->MonaComm->Handle = nullptr;
+}
+
+//----------------------------------------------------------------------------
+// Node layout for the hierarchical collectives, or null when the flat
+// collectives should be used. Collective the first time it is called.
+const MonaCommunicatorNodeLayout* MonaCommunicator::GetNodeLayout()
+{
+  if (!this->HierarchicalCollectives || !this->MonaComm->Handle)
+  {
+    return nullptr;
+  }
+  const MonaCommunicatorNodeLayout* layout =
+    MonaCommunicatorNodeCache::Get(this->MonaComm->Handle);
+  if (!layout)
+  {
+    vtkWarningMacro("Could not determine the node layout, using flat collectives");
+    this->HierarchicalCollectives = 0;
+    return nullptr;
+  }
+  return layout->IsFlat() ? nullptr : layout;
+}
+
+//-----------------------------------------------------------------------------
+// Set the number of processes and maximum number of processes
+// to the size obtained from Mona.
+int MonaCommunicator::InitializeNumberOfProcesses()
+{
+  DEBUG("{}",__FUNCTION__);
+  int ret;
+  this->Modified();
+  mona_comm_t mona_comm = this->MonaComm->Handle;
+  // get size and rank
+  int size, rank;
+  ret = mona_comm_size(mona_comm, &size);
+  //std::cout << "debug size " << size << std::endl;
+  if (ret != 0)
+  {
+    throw std::runtime_error("failed to get mona size");
+    return -1;
+  }
+
+  ret = mona_comm_rank(mona_comm, &rank);
+  //std::cout << "debug rank " << rank << std::endl;
+
+  if (ret != 0)
+  {
+    throw std::runtime_error("failed to get mona rank");
+    return -1;
+  }
+
+  this->MaximumNumberOfProcesses = size;
+  this->NumberOfProcesses = this->MaximumNumberOfProcesses;
+  // get the rank id
+  // TODO check error
+  this->LocalProcessId = rank;
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// Copy the MPI handle
+void MonaCommunicator::CopyFrom(MonaCommunicator* source)
+{
+  DEBUG("{}: source={}", __FUNCTION__, (void*)source);
+  if (!source)
+  {
+    return;
+  }
+
+  this->ReleaseHandle();
+  this->InitializeCopy(source);
+  if (source->MonaComm->Handle)
+  {
+    // the handle is shared, the source keeps ownership
+    this->KeepHandleOn();
+    this->MonaComm->Handle = source->MonaComm->Handle;
+  }
+}
+
+//----------------------------------------------------------------------------
+// Duplicate the MoNA handle
+
+void MonaCommunicator::Duplicate(MonaCommunicator* source)
+{
+  DEBUG("{}: source={}", __FUNCTION__, (void*)source);
+  if (!source)
+  {
+    return;
+  }
+
+  this->ReleaseHandle();
+  this->InitializeCopy(source);
+  this->KeepHandleOff();
+  if (source->MonaComm->Handle)
+  {
+    na_return_t ret = mona_comm_dup(source->MonaComm->Handle, &this->MonaComm->Handle);
+    if (ret != NA_SUCCESS)
+    {
+      vtkErrorMacro("mona_comm_dup failed with status " << ret);
+      this->MonaComm->Handle = nullptr;
+      this->Initialized = 0;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+char* MonaCommunicator::Allocate(size_t size)
+{
+  DEBUG("{}: size={}", __FUNCTION__, size);
+  return MonaCommunicatorBufferPool::Allocate(size);
+}
+
+//----------------------------------------------------------------------------
+void MonaCommunicator::Free(char* ptr)
+{
+  DEBUG("{}", __FUNCTION__);
+  MonaCommunicatorBufferPool::Free(ptr);
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::CheckForMPIError(int err)
+{
+  DEBUG("{}: err={}", __FUNCTION__, err);
+
+  if (err == MPI_SUCCESS)
+  {
+    return 1;
+  }
+  else
+  {
+    char* msg = MonaController::ErrorString(err);
+    vtkGenericWarningMacro("MPI error occurred: " << msg);
+    delete[] msg;
+    return 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::CheckTag(int tag)
+{
+  if ((static_cast<uint32_t>(tag) & ~MONA_COMM_USER_TAG_MASK) != 0)
+  {
+    vtkErrorMacro(<< "Invalid tag " << tag << ", point-to-point tags must be between 0 and "
+                  << MONA_COMM_USER_TAG_MASK);
+    return 0;
+  }
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::SendVoidArray(
+  const void* data, vtkIdType length, int type, int remoteProcessId, int tag)
+{
+  DEBUG("{}: length={}, type={}, dest={}, tag={}",
+          __FUNCTION__, length, type, remoteProcessId, tag);
+  if (!this->CheckTag(tag))
+  {
+    return 0;
+  }
+  const char* byteData = static_cast<const char*>(data);
+  // MPI_Datatype mpiType = MonaCommunicatorGetMPIType(type);
+  int sizeOfType;
+  switch (type)
+  {
+    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
+    default:
+      vtkWarningMacro(<< "Invalid data type " << type);
+      sizeOfType = 1;
+      break;
+  }
+
+  // the envelope tells the receiver how much data follows, and how it is
+  // split when it is larger than ChunkSize. Small payloads go inside it.
+  na_size_t size = static_cast<na_size_t>(length) * sizeOfType;
+  MonaMetrics::Scope metrics(MonaMetrics::SEND, tag, size);
+  na_size_t chunkSize = static_cast<na_size_t>(this->ChunkSize);
+  int eager = (size <= MONA_COMM_EAGER_LIMIT);
+  int chunked = !eager && (size > chunkSize);
+  MonaCommunicatorEnvelope envelope;
+  envelope.Magic = MONA_COMM_ENVELOPE_MAGIC;
+  envelope.Length = size;
+  envelope.ChunkSize = chunked ? chunkSize : 0;
+  envelope.ChunksInFlight = chunked ? this->ChunksInFlight : 0;
+  envelope.Segments = 0;
+  if (eager && size > 0)
+  {
+    memcpy(envelope.Eager, byteData, size);
+  }
+  na_return_t ret = mona_comm_send(this->MonaComm->Handle, &envelope,
+    MonaCommunicatorEnvelopeSize(envelope), remoteProcessId, tag);
+  if (ret != NA_SUCCESS)
+  {
+    vtkErrorMacro(<< "MoNA error occurred in mona_comm_send: " << ret);
+    return 0;
+  }
+
+  if (eager)
+  {
+    return 1;
+  }
+  if (chunked)
+  {
+    return this->SendChunks(
+      byteData, size, chunkSize, this->ChunksInFlight, remoteProcessId, tag);
+  }
+  if (MonaCommunicatorSendData(byteData, size, remoteProcessId, tag, this->MonaComm->Handle,
+        vtkCommunicator::UseCopy, this->UseSsend) != 0)
+  {
+    vtkErrorMacro(<< "Could not send " << size << " bytes to " << remoteProcessId);
+    return 0;
+  }
+  return 1;
+}
+
+int MonaCommunicator::ReceiveVoidArray(
+  void* data, vtkIdType maxlength, int type, int remoteProcessId, int tag)
+{
+  DEBUG("{}: maxlength={}, type={}, src={}, tag={}",
+          __FUNCTION__, maxlength, type, remoteProcessId, tag);
+  this->Count = 0;
+  if (!this->CheckTag(tag))
+  {
+    return 0;
+  }
+  char* byteData = static_cast<char*>(data);
+  MonaMetrics::Scope metrics(MonaMetrics::RECEIVE, tag);
+
+  int sizeOfType;
+  switch (type)
+  {
+    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
+    default:
+      vtkWarningMacro(<< "Invalid data type " << type);
+      sizeOfType = 1;
+      break;
+  }
+
+  // the envelope gives the sender and the actual length of the message
+  MonaCommunicatorEnvelope envelope;
+  if (!this->ReceiveEnvelope(remoteProcessId, tag, &envelope, this->LastSenderId))
+  {
+    return 0;
+  }
+  metrics.SetBytes(envelope.Length);
+  vtkIdType length = static_cast<vtkIdType>(envelope.Length / sizeOfType);
+  if (length > maxlength)
+  {
+    vtkErrorMacro(<< "Message of " << length << " elements from " << this->LastSenderId
+                  << " does not fit in a buffer of " << maxlength);
+    return 0;
+  }
+
+  if (!this->ReceivePayload(byteData, envelope, this->LastSenderId, tag))
+  {
+    return 0;
+  }
+  this->Count = length;
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// Receive the payload announced by envelope, which came from remoteProcessId.
+int MonaCommunicator::ReceivePayload(
+  char* data, const MonaCommunicatorEnvelope& envelope, int remoteProcessId, int tag)
+{
+  if (MonaCommunicatorIsEager(envelope))
+  {
+    if (envelope.Length > 0)
+    {
+      memcpy(data, envelope.Eager, envelope.Length);
+    }
+    return 1;
+  }
+  if (envelope.Segments != 0)
+  {
+    std::vector<MonaCommunicatorSegment> segments(1, { data, envelope.Length });
+    return MonaCommunicatorReceiveSegments(
+      this->MonaComm->Handle, envelope, segments, remoteProcessId, tag);
+  }
+  if (envelope.ChunkSize != 0)
+  {
+    if (envelope.ChunksInFlight == 0 || envelope.ChunksInFlight > 64)
+    {
+      vtkErrorMacro(<< "Invalid envelope from " << remoteProcessId);
+      return 0;
+    }
+    return this->ReceiveChunks(data, envelope.Length, envelope.ChunkSize,
+      static_cast<int>(envelope.ChunksInFlight), remoteProcessId, tag);
+  }
+  return (this->ReceiveDataInternal(data, envelope.Length, remoteProcessId, tag,
+            this->MonaComm->Handle, vtkCommunicator::UseCopy, this->LastSenderId) == 0);
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::SendSegments(const void* const* segments, const vtkIdType* lengths,
+  int count, int remoteProcessId, int tag)
+{
+  DEBUG("{}: count={}, dest={}, tag={}", __FUNCTION__, count, remoteProcessId, tag);
+  if (!this->CheckTag(tag))
+  {
+    return 0;
+  }
+  std::vector<MonaCommunicatorSegment> list(count);
+  na_size_t total = 0;
+  for (int i = 0; i < count; i++)
+  {
+    list[i].Data = const_cast<char*>(static_cast<const char*>(segments[i]));
+    list[i].Length = static_cast<na_size_t>(lengths[i]);
+    total += list[i].Length;
+  }
+  MonaCommunicatorMergeSegments(list);
+  if (list.size() <= 1)
+  {
+    // a single piece of memory is an ordinary message
+    return this->SendVoidArray(
+      list.empty() ? nullptr : list[0].Data, static_cast<vtkIdType>(total), VTK_CHAR,
+      remoteProcessId, tag);
+  }
+  // the piece table goes where the payload of an ordinary message goes, and
+  // receivers only accept one no larger than the data. It has at most one
+  // entry per piece, when that could be more than the data itself (segments
+  // of a few bytes) packing is cheaper anyway, and so it is when the whole
+  // message fits in the envelope.
+  na_size_t chunkSize = static_cast<na_size_t>(this->ChunkSize);
+  na_size_t pieces = 0;
+  for (const MonaCommunicatorSegment& segment : list)
+  {
+    pieces += (segment.Length + chunkSize - 1) / chunkSize;
+  }
+  if (total <= MONA_COMM_EAGER_LIMIT ||
+    pieces * sizeof(MonaCommunicatorPieceTable::value_type) > total)
+  {
+    char* packed = MonaCommunicator::Allocate(total);
+    na_size_t offset = 0;
+    for (const MonaCommunicatorSegment& segment : list)
+    {
+      memcpy(packed + offset, segment.Data, segment.Length);
+      offset += segment.Length;
+    }
+    int retVal = this->SendVoidArray(
+      packed, static_cast<vtkIdType>(total), VTK_CHAR, remoteProcessId, tag);
+    MonaCommunicator::Free(packed);
+    return retVal;
+  }
+  MonaMetrics::Scope metrics(MonaMetrics::SEND, tag, total);
+  return MonaCommunicatorSendSegments(
+    this->MonaComm->Handle, list, chunkSize, this->ChunksInFlight, remoteProcessId, tag);
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::ReceiveSegments(void* const* segments, const vtkIdType* lengths,
+  int count, int remoteProcessId, int tag)
+{
+  DEBUG("{}: count={}, src={}, tag={}", __FUNCTION__, count, remoteProcessId, tag);
+  this->Count = 0;
+  if (!this->CheckTag(tag))
+  {
+    return 0;
+  }
+  MonaMetrics::Scope metrics(MonaMetrics::RECEIVE, tag);
+  std::vector<MonaCommunicatorSegment> list(count);
+  na_size_t capacity = 0;
+  for (int i = 0; i < count; i++)
+  {
+    list[i].Data = static_cast<char*>(segments[i]);
+    list[i].Length = static_cast<na_size_t>(lengths[i]);
+    capacity += list[i].Length;
+  }
+  MonaCommunicatorMergeSegments(list);
+
+  MonaCommunicatorEnvelope envelope;
+  if (!this->ReceiveEnvelope(remoteProcessId, tag, &envelope, this->LastSenderId))
+  {
+    return 0;
+  }
+  metrics.SetBytes(envelope.Length);
+  if (envelope.Length > capacity)
+  {
+    vtkErrorMacro(<< "Message of " << envelope.Length << " bytes from " << this->LastSenderId
+                  << " does not fit in segments of " << capacity << " bytes");
+    return 0;
+  }
+
+  int retVal;
+  if (envelope.Segments != 0)
+  {
+    retVal = MonaCommunicatorReceiveSegments(
+      this->MonaComm->Handle, envelope, list, this->LastSenderId, tag);
+  }
+  else if (envelope.Length == 0 || envelope.Length <= list[0].Length)
+  {
+    retVal = this->ReceivePayload(
+      list.empty() ? nullptr : list[0].Data, envelope, this->LastSenderId, tag);
+  }
+  else
+  {
+    // a contiguous message spread over several segments goes through a
+    // staging buffer
+    char* staging = MonaCommunicator::Allocate(envelope.Length);
+    retVal = this->ReceivePayload(staging, envelope, this->LastSenderId, tag);
+    if (retVal)
+    {
+      size_t index = 0;
+      na_size_t offset = 0;
+      MonaCommunicatorScatter(staging, envelope.Length, list, index, offset);
+    }
+    MonaCommunicator::Free(staging);
+  }
+  if (retVal)
+  {
+    this->Count = static_cast<vtkIdType>(envelope.Length);
+  }
+  return retVal;
+}
+
+//----------------------------------------------------------------------------
+// The rows (along x) of subExtent within an array laid out over extent, x
+// varying fastest. Returns false when subExtent is not inside extent.
+static bool MonaCommunicatorSubExtentRows(const int extent[6], const int subExtent[6],
+  int elementSize, std::vector<na_size_t>& offsets, na_size_t& rowLength)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    if (subExtent[2 * i] < extent[2 * i] || subExtent[2 * i + 1] > extent[2 * i + 1])
+    {
+      return false;
+    }
+  }
+  offsets.clear();
+  rowLength = 0;
+  if (subExtent[0] > subExtent[1] || subExtent[2] > subExtent[3] || subExtent[4] > subExtent[5])
+  {
+    return true;
+  }
+  na_size_t nx = extent[1] - extent[0] + 1;
+  na_size_t ny = extent[3] - extent[2] + 1;
+  rowLength = static_cast<na_size_t>(subExtent[1] - subExtent[0] + 1) * elementSize;
+  for (int z = subExtent[4]; z <= subExtent[5]; z++)
+  {
+    for (int y = subExtent[2]; y <= subExtent[3]; y++)
+    {
+      na_size_t element = (static_cast<na_size_t>(z - extent[4]) * ny + (y - extent[2])) * nx +
+        (subExtent[0] - extent[0]);
+      offsets.push_back(element * elementSize);
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::SendSubExtent(const void* data, const int extent[6],
+  const int subExtent[6], int elementSize, int remoteProcessId, int tag)
+{
+  DEBUG("{}: elementSize={}, dest={}, tag={}", __FUNCTION__, elementSize, remoteProcessId, tag);
+  std::vector<na_size_t> offsets;
+  na_size_t rowLength;
+  if (!MonaCommunicatorSubExtentRows(extent, subExtent, elementSize, offsets, rowLength))
+  {
+    vtkErrorMacro("Sub-extent is not inside the extent of the data.");
+    return 0;
+  }
+  std::vector<const void*> segments(offsets.size());
+  for (size_t i = 0; i < offsets.size(); i++)
+  {
+    segments[i] = static_cast<const char*>(data) + offsets[i];
+  }
+  std::vector<vtkIdType> lengths(offsets.size(), static_cast<vtkIdType>(rowLength));
+  return this->SendSegments(segments.data(), lengths.data(), static_cast<int>(segments.size()),
+    remoteProcessId, tag);
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::ReceiveSubExtent(void* data, const int extent[6], const int subExtent[6],
+  int elementSize, int remoteProcessId, int tag)
+{
+  DEBUG("{}: elementSize={}, src={}, tag={}", __FUNCTION__, elementSize, remoteProcessId, tag);
+  std::vector<na_size_t> offsets;
+  na_size_t rowLength;
+  if (!MonaCommunicatorSubExtentRows(extent, subExtent, elementSize, offsets, rowLength))
+  {
+    vtkErrorMacro("Sub-extent is not inside the extent of the data.");
+    return 0;
+  }
+  std::vector<void*> segments(offsets.size());
+  for (size_t i = 0; i < offsets.size(); i++)
+  {
+    segments[i] = static_cast<char*>(data) + offsets[i];
+  }
+  std::vector<vtkIdType> lengths(offsets.size(), static_cast<vtkIdType>(rowLength));
+  return this->ReceiveSegments(segments.data(), lengths.data(),
+    static_cast<int>(segments.size()), remoteProcessId, tag);
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::SendSubExtent(vtkDataArray* array, const int extent[6],
+  const int subExtent[6], int remoteProcessId, int tag)
+{
+  if (!array || !array->HasStandardMemoryLayout())
+  {
+    vtkErrorMacro("SendSubExtent needs an array with the standard memory layout.");
+    return 0;
+  }
+  return this->SendSubExtent(array->GetVoidPointer(0), extent, subExtent,
+    array->GetNumberOfComponents() * array->GetDataTypeSize(), remoteProcessId, tag);
+}
+
+int MonaCommunicator::ReceiveSubExtent(vtkDataArray* array, const int extent[6],
+  const int subExtent[6], int remoteProcessId, int tag)
+{
+  if (!array || !array->HasStandardMemoryLayout())
+  {
+    vtkErrorMacro("ReceiveSubExtent needs an array with the standard memory layout.");
+    return 0;
+  }
+  return this->ReceiveSubExtent(array->GetVoidPointer(0), extent, subExtent,
+    array->GetNumberOfComponents() * array->GetDataTypeSize(), remoteProcessId, tag);
+}
+
+//----------------------------------------------------------------------------
+// Binary channel for vtkImageData and vtkPolyData. The data object goes out
+// as a header describing its structure and arrays, followed by the buffers
+// of all the arrays as a single multi-segment message (see SendSegments).
+// Buffers are sent from, and received into, the array memory: nothing goes
+// through a writer or a parser.
+#define MONA_COMM_DATA_OBJECT_MAGIC 0x4d6f4e41446f626aull
+
+// Where an array of the header belongs
+enum MonaCommunicatorArraySlot
+{
+  MONA_COMM_SLOT_FIELD = 0,
+  MONA_COMM_SLOT_POINT = 1,
+  MONA_COMM_SLOT_CELL = 2,
+  MONA_COMM_SLOT_POINTS = 3,
+  // offsets then connectivity of the verts, lines, polys and strips
+  MONA_COMM_SLOT_CELLS = 4,
+  MONA_COMM_SLOT_END = MONA_COMM_SLOT_CELLS + 8
+};
+
+class MonaCommunicatorHeader
+{
+public:
+  template <typename T>
+  void Put(const T& value)
+  {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    this->Buffer.insert(this->Buffer.end(), bytes, bytes + sizeof(T));
+  }
+
+  void PutName(const char* name)
+  {
+    // UINT32_MAX tells a null name from an empty one
+    uint32_t length = name ? static_cast<uint32_t>(strlen(name)) : UINT32_MAX;
+    this->Put(length);
+    if (name)
+    {
+      this->Buffer.insert(this->Buffer.end(), name, name + length);
+    }
+  }
+
+  template <typename T>
+  bool Get(T& value)
+  {
+    if (this->Buffer.size() - this->Position < sizeof(T))
+    {
+      return false;
+    }
+    memcpy(&value, this->Buffer.data() + this->Position, sizeof(T));
+    this->Position += sizeof(T);
+    return true;
+  }
+
+  bool GetName(std::string& name, bool& isNull)
+  {
+    uint32_t length;
+    if (!this->Get(length))
+    {
+      return false;
+    }
+    isNull = (length == UINT32_MAX);
+    if (isNull)
+    {
+      return true;
+    }
+    if (this->Buffer.size() - this->Position < length)
+    {
+      return false;
+    }
+    name.assign(this->Buffer.data() + this->Position, length);
+    this->Position += length;
+    return true;
+  }
+
+  std::vector<char> Buffer;
+  size_t Position = 0;
+};
+
+//----------------------------------------------------------------------------
+static bool MonaCommunicatorAddArray(MonaCommunicatorHeader& header,
+  std::vector<vtkDataArray*>& arrays, vtkDataArray* array, int slot, int attribute)
+{
+  // arrays that are not contiguous would have to be copied out first
+  if (!array || !array->HasStandardMemoryLayout())
+  {
+    return false;
+  }
+  header.Put(static_cast<int32_t>(slot));
+  header.Put(static_cast<int32_t>(attribute));
+  header.Put(static_cast<int32_t>(array->GetDataType()));
+  header.Put(static_cast<int32_t>(array->GetNumberOfComponents()));
+  header.Put(static_cast<int64_t>(array->GetNumberOfTuples()));
+  header.PutName(array->GetName());
+  arrays.push_back(array);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+static bool MonaCommunicatorAddFieldArrays(MonaCommunicatorHeader& header,
+  std::vector<vtkDataArray*>& arrays, vtkFieldData* fields, int slot)
+{
+  if (!fields)
+  {
+    return true;
+  }
+  vtkDataSetAttributes* attributes = vtkDataSetAttributes::SafeDownCast(fields);
+  for (int i = 0; i < fields->GetNumberOfArrays(); i++)
+  {
+    int attribute = attributes ? attributes->IsArrayAnAttribute(i) : -1;
+    if (!MonaCommunicatorAddArray(header,
+          arrays, vtkDataArray::SafeDownCast(fields->GetAbstractArray(i)), slot, attribute))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Describe data in header and list the arrays whose buffers follow it.
+// Returns false when data cannot take the binary channel: it is not an image
+// or a poly data, or it holds arrays that are not contiguous vtkDataArrays.
+static bool MonaCommunicatorDescribeDataObject(
+  vtkDataObject* data, MonaCommunicatorHeader& header, std::vector<vtkDataArray*>& arrays)
+{
+  vtkImageData* image = vtkImageData::SafeDownCast(data);
+  vtkPolyData* poly = vtkPolyData::SafeDownCast(data);
+  if (!image && !poly)
+  {
+    return false;
+  }
+  header.Put(MONA_COMM_DATA_OBJECT_MAGIC);
+  header.Put(static_cast<int32_t>(data->GetDataObjectType()));
+  header.Put(static_cast<int32_t>(1));
+
+  if (image)
+  {
+    int extent[6];
+    double origin[3], spacing[3];
+    image->GetExtent(extent);
+    image->GetOrigin(origin);
+    image->GetSpacing(spacing);
+    const double* direction = image->GetDirectionMatrix()->GetData();
+    for (int i = 0; i < 6; i++)
+    {
+      header.Put(static_cast<int32_t>(extent[i]));
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      header.Put(origin[i]);
+      header.Put(spacing[i]);
+    }
+    for (int i = 0; i < 9; i++)
+    {
+      header.Put(direction[i]);
+    }
+  }
+
+  // the array count is patched in once the arrays are known
+  size_t countPosition = header.Buffer.size();
+  header.Put(static_cast<uint32_t>(0));
+  bool ok = MonaCommunicatorAddFieldArrays(header, arrays, data->GetFieldData(),
+    MONA_COMM_SLOT_FIELD);
+  if (poly)
+  {
+    ok = ok &&
+      MonaCommunicatorAddFieldArrays(header, arrays, poly->GetPointData(), MONA_COMM_SLOT_POINT);
+    ok = ok &&
+      MonaCommunicatorAddFieldArrays(header, arrays, poly->GetCellData(), MONA_COMM_SLOT_CELL);
+    if (ok && poly->GetPoints())
+    {
+      ok = MonaCommunicatorAddArray(
+        header, arrays, poly->GetPoints()->GetData(), MONA_COMM_SLOT_POINTS, -1);
+    }
+    vtkCellArray* cells[4] = { poly->GetVerts(), poly->GetLines(), poly->GetPolys(),
+      poly->GetStrips() };
+    for (int k = 0; ok && k < 4; k++)
+    {
+      if (cells[k] && cells[k]->GetNumberOfCells() > 0)
+      {
+        ok = MonaCommunicatorAddArray(header, arrays, cells[k]->GetOffsetsArray(),
+               MONA_COMM_SLOT_CELLS + 2 * k, -1) &&
+          MonaCommunicatorAddArray(header, arrays, cells[k]->GetConnectivityArray(),
+            MONA_COMM_SLOT_CELLS + 2 * k + 1, -1);
+      }
+    }
+  }
+  else
+  {
+    ok = ok &&
+      MonaCommunicatorAddFieldArrays(header, arrays, image->GetPointData(), MONA_COMM_SLOT_POINT);
+    ok = ok &&
+      MonaCommunicatorAddFieldArrays(header, arrays, image->GetCellData(), MONA_COMM_SLOT_CELL);
+  }
+  if (!ok)
+  {
+    return false;
+  }
+  uint32_t count = static_cast<uint32_t>(arrays.size());
+  memcpy(header.Buffer.data() + countPosition, &count, sizeof(count));
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// vtkCommunicator::Send has already sent the type of data, which the
+// receiving vtkCommunicator used to create or check the object.
+int MonaCommunicator::SendElementalDataObject(
+  vtkDataObject* data, int remoteProcessId, int tag)
+{
+  DEBUG("{}: dest={}, tag={}", __FUNCTION__, remoteProcessId, tag);
+  MonaCommunicatorHeader header;
+  std::vector<vtkDataArray*> arrays;
+  bool binary = MonaCommunicatorDescribeDataObject(data, header, arrays);
+  if (!binary)
+  {
+    // the header only tells the receiver to use the vtkCommunicator path
+    header.Buffer.clear();
+    arrays.clear();
+    header.Put(MONA_COMM_DATA_OBJECT_MAGIC);
+    header.Put(static_cast<int32_t>(data->GetDataObjectType()));
+    header.Put(static_cast<int32_t>(0));
+  }
+  if (!this->SendVoidArray(header.Buffer.data(), static_cast<vtkIdType>(header.Buffer.size()),
+        VTK_CHAR, remoteProcessId, tag))
+  {
+    return 0;
+  }
+  if (!binary)
+  {
+    return this->Superclass::SendElementalDataObject(data, remoteProcessId, tag);
+  }
+
+  if (arrays.empty())
+  {
+    return 1;
+  }
+  std::vector<const void*> segments(arrays.size());
+  std::vector<vtkIdType> lengths(arrays.size());
+  for (size_t i = 0; i < arrays.size(); i++)
+  {
+    segments[i] = arrays[i]->GetVoidPointer(0);
+    lengths[i] = arrays[i]->GetNumberOfValues() * arrays[i]->GetDataTypeSize();
+  }
+  return this->SendSegments(segments.data(), lengths.data(), static_cast<int>(segments.size()),
+    remoteProcessId, tag);
+}
+
+//----------------------------------------------------------------------------
+// Receive the header sent by SendElementalDataObject. Returns the type of the data
+// object in type and whether its arrays follow in binary.
+int MonaCommunicator::ReceiveDataObjectHeader(
+  int remoteProcessId, int tag, std::vector<char>& header, int& type, int& binary)
+{
+  MonaCommunicatorEnvelope envelope;
+  if (!this->ReceiveEnvelope(remoteProcessId, tag, &envelope, this->LastSenderId))
+  {
+    return 0;
+  }
+  header.resize(envelope.Length);
+  if (!this->ReceivePayload(header.data(), envelope, this->LastSenderId, tag))
+  {
+    return 0;
+  }
+
+  MonaCommunicatorHeader reader;
+  reader.Buffer.swap(header);
+  uint64_t magic;
+  int32_t dataType, hasArrays;
+  if (!reader.Get(magic) || magic != MONA_COMM_DATA_OBJECT_MAGIC || !reader.Get(dataType) ||
+    !reader.Get(hasArrays))
+  {
+    vtkErrorMacro(<< "Invalid data object header from " << this->LastSenderId);
+    return 0;
+  }
+  if (hasArrays && dataType != VTK_IMAGE_DATA && dataType != VTK_POLY_DATA)
+  {
+    vtkErrorMacro(<< "Unexpected data object type " << dataType << " from "
+                  << this->LastSenderId);
+    return 0;
+  }
+  // keep only what follows the magic, type and flag
+  header.assign(reader.Buffer.begin() + reader.Position, reader.Buffer.end());
+  type = dataType;
+  binary = hasArrays;
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// Rebuild data from the rest of the header and receive its arrays in place.
+// The arrays are all allocated first, then received in one multi-segment
+// message, and only then attached to data.
+int MonaCommunicator::ReceiveDataObjectArrays(
+  vtkDataObject* data, std::vector<char>& buffer, int remoteProcessId, int tag)
+{
+  MonaCommunicatorHeader header;
+  header.Buffer.swap(buffer);
+  data->Initialize();
+
+  vtkImageData* image = vtkImageData::SafeDownCast(data);
+  vtkPolyData* poly = vtkPolyData::SafeDownCast(data);
+  vtkDataSet* dataSet = image ? static_cast<vtkDataSet*>(image) : poly;
+  bool ok = true;
+  if (image)
+  {
+    int32_t extent[6];
+    double origin[3], spacing[3], direction[9];
+    for (int i = 0; i < 6; i++)
+    {
+      ok = ok && header.Get(extent[i]);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      ok = ok && header.Get(origin[i]) && header.Get(spacing[i]);
+    }
+    for (int i = 0; i < 9; i++)
+    {
+      ok = ok && header.Get(direction[i]);
+    }
+    if (ok)
+    {
+      int ext[6] = { extent[0], extent[1], extent[2], extent[3], extent[4], extent[5] };
+      image->SetExtent(ext);
+      image->SetOrigin(origin);
+      image->SetSpacing(spacing);
+      image->SetDirectionMatrix(direction);
+    }
+  }
+
+  uint32_t count = 0;
+  ok = ok && header.Get(count);
+  struct Entry
+  {
+    vtkSmartPointer<vtkDataArray> Array;
+    int32_t Slot;
+    int32_t Attribute;
+  };
+  std::vector<Entry> entries;
+  std::vector<void*> segments;
+  std::vector<vtkIdType> lengths;
+  for (uint32_t i = 0; ok && i < count; i++)
+  {
+    int32_t slot, attribute, dataType, components;
+    int64_t tuples;
+    std::string name;
+    bool isNull;
+    if (!header.Get(slot) || !header.Get(attribute) || !header.Get(dataType) ||
+      !header.Get(components) || !header.Get(tuples) || !header.GetName(name, isNull) ||
+      slot < 0 || slot >= MONA_COMM_SLOT_END || components < 1 || tuples < 0 ||
+      (slot >= MONA_COMM_SLOT_POINTS && !poly))
+    {
+      ok = false;
+      break;
+    }
+    vtkSmartPointer<vtkDataArray> array =
+      vtkSmartPointer<vtkDataArray>::Take(vtkDataArray::CreateDataArray(dataType));
+    if (!array)
+    {
+      ok = false;
+      break;
+    }
+    array->SetNumberOfComponents(components);
+    array->SetNumberOfTuples(tuples);
+    if (!isNull)
+    {
+      array->SetName(name.c_str());
+    }
+    entries.push_back({ array, slot, attribute });
+    segments.push_back(array->GetVoidPointer(0));
+    lengths.push_back(array->GetNumberOfValues() * array->GetDataTypeSize());
+  }
+  if (!ok)
+  {
+    vtkErrorMacro(<< "Invalid data object header from " << remoteProcessId);
+    return 0;
+  }
+  if (!entries.empty())
+  {
+    vtkIdType total = 0;
+    for (vtkIdType length : lengths)
+    {
+      total += length;
+    }
+    if (!this->ReceiveSegments(segments.data(), lengths.data(),
+          static_cast<int>(segments.size()), remoteProcessId, tag))
+    {
+      return 0;
+    }
+    if (this->Count != total)
+    {
+      vtkErrorMacro(<< "Received " << this->Count << " bytes of arrays from " << remoteProcessId
+                    << " instead of " << total);
+      return 0;
+    }
+  }
+
+  vtkSmartPointer<vtkDataArray> offsets[4];
+  for (size_t i = 0; ok && i < entries.size(); i++)
+  {
+    vtkDataArray* array = entries[i].Array;
+    int32_t slot = entries[i].Slot;
+    int32_t attribute = entries[i].Attribute;
+    if (slot == MONA_COMM_SLOT_FIELD)
+    {
+      data->GetFieldData()->AddArray(array);
+    }
+    else if (slot == MONA_COMM_SLOT_POINT || slot == MONA_COMM_SLOT_CELL)
+    {
+      vtkDataSetAttributes* attributes = (slot == MONA_COMM_SLOT_POINT)
+        ? static_cast<vtkDataSetAttributes*>(dataSet->GetPointData())
+        : static_cast<vtkDataSetAttributes*>(dataSet->GetCellData());
+      int index = attributes->AddArray(array);
+      if (attribute >= 0)
+      {
+        attributes->SetActiveAttribute(index, attribute);
+      }
+    }
+    else if (slot == MONA_COMM_SLOT_POINTS)
+    {
+      vtkNew<vtkPoints> points;
+      points->SetData(array);
+      poly->SetPoints(points);
+    }
+    else if ((slot - MONA_COMM_SLOT_CELLS) % 2 == 0)
+    {
+      offsets[(slot - MONA_COMM_SLOT_CELLS) / 2] = array;
+    }
+    else
+    {
+      int k = (slot - MONA_COMM_SLOT_CELLS) / 2;
+      vtkNew<vtkCellArray> cells;
+      ok = offsets[k] && cells->SetData(offsets[k], array);
+      switch (k)
+      {
+        case 0:
+          poly->SetVerts(cells);
+          break;
+        case 1:
+          poly->SetLines(cells);
+          break;
+        case 2:
+          poly->SetPolys(cells);
+          break;
+        default:
+          poly->SetStrips(cells);
+          break;
+      }
+    }
+  }
+  if (!ok)
+  {
+    vtkErrorMacro(<< "Invalid data object header from " << remoteProcessId);
+    return 0;
+  }
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// vtkCommunicator::ReceiveDataObject has already received the type and
+// created or checked data accordingly.
+int MonaCommunicator::ReceiveElementalDataObject(
+  vtkDataObject* data, int remoteProcessId, int tag)
+{
+  DEBUG("{}: src={}, tag={}", __FUNCTION__, remoteProcessId, tag);
+  std::vector<char> header;
+  int type, binary;
+  if (!this->ReceiveDataObjectHeader(remoteProcessId, tag, header, type, binary))
+  {
+    return 0;
+  }
+  // everything else comes from the sender of the header
+  int source = this->LastSenderId;
+  if (data->GetDataObjectType() != type)
+  {
+    vtkErrorMacro(<< "Cannot receive a data object of type " << type << " from " << source
+                  << " into a " << data->GetClassName());
+    return 0;
+  }
+  if (!binary)
+  {
+    return this->Superclass::ReceiveElementalDataObject(data, source, tag);
+  }
+  return this->ReceiveDataObjectArrays(data, header, source, tag);
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockSend(
+  const int* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, dest={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockSendInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockSend(
+  const unsigned long* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, dest={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockSendInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockSend(
+  const char* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, dest={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockSendInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockSend(
+  const unsigned char* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, dest={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockSendInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockSend(
+  const float* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, dest={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockSendInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockSend(
+  const double* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, dest={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockSendInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+#ifdef VTK_USE_64BIT_IDS
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockSend(
+  const vtkIdType* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, dest={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockSendInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+#endif
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockReceive(
+  int* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, src={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockReceiveInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockReceive(
+  unsigned long* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, src={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockReceiveInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockReceive(
+  char* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, src={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockReceiveInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockReceive(
+  unsigned char* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, src={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockReceiveInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockReceive(
+  float* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, src={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockReceiveInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockReceive(
+  double* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, src={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockReceiveInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+#ifdef VTK_USE_64BIT_IDS
+//----------------------------------------------------------------------------
+int MonaCommunicator::NoBlockReceive(
+  vtkIdType* data, int length, int remoteProcessId, int tag, Request& req)
+{
+  DEBUG("{}: length={}, src={}, tag={}", __FUNCTION__, length, remoteProcessId, tag);
+  return this->NoBlockReceiveInternal(
+    data, static_cast<na_size_t>(length) * sizeof(*data), remoteProcessId, tag, req);
+}
+#endif
+
+//----------------------------------------------------------------------------
+MonaCommunicator::Request::Request()
+{
+  DEBUG("{}", __FUNCTION__);
+  this->Req = new MonaCommunicatorOpaqueRequest;
+}
+
+//----------------------------------------------------------------------------
+// Copies alias the same MoNA request, like copies of an MPI_Request handle.
+MonaCommunicator::Request::Request(const MonaCommunicator::Request& src)
+{
+  DEBUG("{}", __FUNCTION__);
+  this->Req = src.Req;
+  ++this->Req->ReferenceCount;
+}
+
+//----------------------------------------------------------------------------
+MonaCommunicator::Request& MonaCommunicator::Request::operator=(
+  const MonaCommunicator::Request& src)
+{
+  DEBUG("{}", __FUNCTION__);
+  if (this->Req == src.Req)
+  {
+    return *this;
+  }
+  MonaCommunicator::ReleaseRequest(this->Req);
+  this->Req = src.Req;
+  ++this->Req->ReferenceCount;
+  return *this;
+}
+
+//----------------------------------------------------------------------------
+MonaCommunicator::Request::~Request()
+{
+  DEBUG("{}", __FUNCTION__);
+  MonaCommunicator::ReleaseRequest(this->Req);
+}
+
+//----------------------------------------------------------------------------
+void MonaCommunicator::ReleaseRequest(MonaCommunicatorOpaqueRequest* req)
+{
+  if (--req->ReferenceCount > 0)
+  {
+    return;
+  }
+  if (req->State != MONA_COMM_REQUEST_DONE)
+  {
+    if (req->IsReceive)
+    {
+      // MoNA cannot cancel a receive and will still write into the request
+      vtkGenericWarningMacro("Destroying a pending MoNA receive request, it is leaked");
+      return;
+    }
+    // let the send finish, MoNA still reads the envelope from the request
+    MonaCommunicator::AdvanceRequest(req, 1);
+  }
+  delete req;
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::Request::Test()
+{
+  DEBUG("{}", __FUNCTION__);
+  if (!MonaCommunicator::AdvanceRequest(this->Req, 0))
+  {
+    return 0;
+  }
+  return this->Req->State == MONA_COMM_REQUEST_DONE;
+}
+
+//----------------------------------------------------------------------------
+void MonaCommunicator::Request::Wait()
+{
+  DEBUG("{}", __FUNCTION__);
+  MonaCommunicator::AdvanceRequest(this->Req, 1);
+}
+
+//----------------------------------------------------------------------------
+void MonaCommunicator::Request::Cancel()
+{
+  DEBUG("{}", __FUNCTION__);
+    vtkGenericWarningMacro("Cancelling a MoNA request is not supported");
+}
+
+//-----------------------------------------------------------------------------
+void MonaCommunicator::Barrier()
+{
+  DEBUG("{}", __FUNCTION__);
+  MonaMetrics::Scope metrics(MonaMetrics::BARRIER);
+  static const int traceEvent = MonaTrace::RegisterEvent("barrier");
+  MonaTrace::Scope trace(traceEvent);
+  const MonaCommunicatorNodeLayout* layout = this->GetNodeLayout();
+  if (layout)
+  {
+    MonaCommunicatorNodeBarrier(layout);
+    return;
+  }
+  mona_comm_barrier(
+    this->MonaComm->Handle, MonaCommunicatorCollectiveTag(this->MonaComm->Handle));
+}
+
+//----------------------------------------------------------------------------
+int MonaCommunicator::BroadcastVoidArray(void* data, vtkIdType length, int type, int root)
+{
+  DEBUG("{}: length={}, type={}, root={}",
+          __FUNCTION__, length, type, root);
+  MonaMetrics::Scope metrics(
+    MonaMetrics::BROADCAST, -1, MonaCommunicatorGetTypeSize(type) * length);
+  if (!MonaCommunicatorCheckSize(length))
+    return 0;
+
+  // check the type length
+  int sizeOfType;
+  switch (type)
+  {
+    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
+    default:
+      vtkWarningMacro(<< "Invalid data type " << type);
+      sizeOfType = 1;
+      break;
+  }
+  // barrier
+  auto mona_comm = this->MonaComm->GetHandle();
+
+  size_t dataSize = sizeOfType * length;
+  const MonaCommunicatorNodeLayout* layout = this->GetNodeLayout();
+  if (layout)
+  {
+    return MonaCommunicatorNodeBcast(layout, data, dataSize, root) == NA_SUCCESS;
+  }
+  if (dataSize >= static_cast<size_t>(this->BroadcastPipelineThreshold) &&
+    this->NumberOfProcesses > 2)
+  {
+    return MonaCommunicatorPipelinedBcast(mona_comm, data, dataSize, root,
+             static_cast<na_size_t>(this->BroadcastSegmentSize),
+             this->ChunksInFlight) == NA_SUCCESS;
+  }
+  // it only works when we add log here and open the debug
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_bcast(mona_comm, data, dataSize, root, tag);
+  if (status == NA_SUCCESS)
+  {
+    return true;
+  }
+  else
+  {
+    return false;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::GatherVoidArray(
+  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, int destProcessId)
+{
+  DEBUG("{}: length={}, type={}, root={}",
+          __FUNCTION__, length, type, destProcessId);
+  MonaMetrics::Scope metrics(MonaMetrics::GATHER, -1, MonaCommunicatorGetTypeSize(type) * length);
+
+  // check the type length
+  int sizeOfType;
+  switch (type)
+  {
+    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
+    default:
+      vtkWarningMacro(<< "Invalid data type " << type);
+      sizeOfType = 1;
+      break;
+  }
+
+  size_t dataSize = sizeOfType * length;
+  auto mona_comm = this->MonaComm->GetHandle();
+  const MonaCommunicatorNodeLayout* layout = this->GetNodeLayout();
+  if (layout)
+  {
+    return MonaCommunicatorNodeGather(mona_comm, layout, sendBuffer, recvBuffer, dataSize,
+             destProcessId, this->LocalProcessId) == NA_SUCCESS;
+  }
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_gather(
+    mona_comm, sendBuffer, dataSize, recvBuffer, destProcessId, tag);
+  return (status == NA_SUCCESS);
+}
+
+//-----------------------------------------------------------------------------
+// Convert per-process lengths and offsets (in elements of a VTK type) to the
+// byte sizes and offsets expected by the MoNA v-collectives. Everything stays
+// in 64 bits so pieces beyond 2 GB are addressed correctly.
+static void MonaCommunicatorToByteLayout(const vtkIdType* lengths, const vtkIdType* offsets,
+  int numProcs, na_size_t typesize, std::vector<na_size_t>& byteLengths,
+  std::vector<na_size_t>& byteOffsets)
+{
+  byteLengths.resize(numProcs);
+  byteOffsets.resize(numProcs);
+  for (int i = 0; i < numProcs; i++)
+  {
+    byteLengths[i] = static_cast<na_size_t>(lengths[i]) * typesize;
+    byteOffsets[i] = static_cast<na_size_t>(offsets[i]) * typesize;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::GatherVVoidArray(const void* sendBuffer, void* recvBuffer,
+  vtkIdType sendLength, vtkIdType* recvLengths, vtkIdType* offsets, int type, int destProcessId)
+{
+  DEBUG("{}: sendLength={}, type={}, root={}", __FUNCTION__, sendLength, type, destProcessId);
+  MonaMetrics::Scope metrics(
+    MonaMetrics::GATHER, -1, MonaCommunicatorGetTypeSize(type) * sendLength);
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Invalid data type " << type);
+    return 0;
+  }
+
+  // The lengths and offsets are only significant on the root.
+  std::vector<na_size_t> byteLengths;
+  std::vector<na_size_t> byteOffsets;
+  if (this->LocalProcessId == destProcessId)
+  {
+    MonaCommunicatorToByteLayout(
+      recvLengths, offsets, this->NumberOfProcesses, typesize, byteLengths, byteOffsets);
+  }
+
+  auto mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_gatherv(mona_comm, sendBuffer, sendLength * typesize, recvBuffer,
+    byteLengths.data(), byteOffsets.data(), destProcessId, tag);
+  return (status == NA_SUCCESS);
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::ScatterVoidArray(
+  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, int srcProcessId)
+{
+  DEBUG("{}: length={}, type={}, root={}", __FUNCTION__, length, type, srcProcessId);
+  MonaMetrics::Scope metrics(MonaMetrics::SCATTER, -1, MonaCommunicatorGetTypeSize(type) * length);
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Invalid data type " << type);
+    return 0;
+  }
+
+  auto mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_scatter(
+    mona_comm, sendBuffer, length * typesize, recvBuffer, srcProcessId, tag);
+  return (status == NA_SUCCESS);
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::ScatterVVoidArray(const void* sendBuffer, void* recvBuffer,
+  vtkIdType* sendLengths, vtkIdType* offsets, vtkIdType recvLength, int type, int srcProcessId)
+{
+  DEBUG("{}: recvLength={}, type={}, root={}", __FUNCTION__, recvLength, type, srcProcessId);
+  MonaMetrics::Scope metrics(
+    MonaMetrics::SCATTER, -1, MonaCommunicatorGetTypeSize(type) * recvLength);
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Invalid data type " << type);
+    return 0;
+  }
+
+  // The lengths and offsets are only significant on the root.
+  std::vector<na_size_t> byteLengths;
+  std::vector<na_size_t> byteOffsets;
+  if (this->LocalProcessId == srcProcessId)
+  {
+    MonaCommunicatorToByteLayout(
+      sendLengths, offsets, this->NumberOfProcesses, typesize, byteLengths, byteOffsets);
+  }
+
+  auto mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_scatterv(mona_comm, sendBuffer, byteLengths.data(),
+    byteOffsets.data(), recvBuffer, recvLength * typesize, srcProcessId, tag);
+  return (status == NA_SUCCESS);
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::AllGatherVoidArray(
+  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type)
+{
+  DEBUG("{}: length={}, type={}", __FUNCTION__, length, type);
+  MonaMetrics::Scope metrics(
+    MonaMetrics::ALL_GATHER, -1, MonaCommunicatorGetTypeSize(type) * length);
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Invalid data type " << type);
+    return 0;
+  }
+
+  auto mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_allgather(
+    mona_comm, sendBuffer, length * typesize, recvBuffer, tag);
+  return (status == NA_SUCCESS);
+}
+
+//-----------------------------------------------------------------------------
+// MoNA has no allgatherv, so gather the pieces on process 0 and broadcast the
+// part of the receive buffer they cover. Lengths and offsets are known on
+// every process, as vtkCommunicator::AllGatherV requires.
+int MonaCommunicator::AllGatherVVoidArray(const void* sendBuffer, void* recvBuffer,
+  vtkIdType sendLength, vtkIdType* recvLengths, vtkIdType* offsets, int type)
+{
+  DEBUG("{}: sendLength={}, type={}", __FUNCTION__, sendLength, type);
+  MonaMetrics::Scope metrics(
+    MonaMetrics::ALL_GATHER, -1, MonaCommunicatorGetTypeSize(type) * sendLength);
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Invalid data type " << type);
+    return 0;
+  }
+
+  std::vector<na_size_t> byteLengths;
+  std::vector<na_size_t> byteOffsets;
+  MonaCommunicatorToByteLayout(
+    recvLengths, offsets, this->NumberOfProcesses, typesize, byteLengths, byteOffsets);
+
+  na_size_t extent = 0;
+  for (int i = 0; i < this->NumberOfProcesses; i++)
+  {
+    extent = std::max(extent, byteOffsets[i] + byteLengths[i]);
+  }
+
+  auto mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_gatherv(mona_comm, sendBuffer, sendLength * typesize,
+    recvBuffer, byteLengths.data(), byteOffsets.data(), 0, tag);
+  if (status != NA_SUCCESS)
+  {
+    return 0;
+  }
+  tag = MonaCommunicatorCollectiveTag(mona_comm);
+  status = mona_comm_bcast(mona_comm, recvBuffer, extent, 0, tag);
+  return (status == NA_SUCCESS);
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::ReduceVoidArray(const void* sendBuffer, void* recvBuffer, vtkIdType length,
+  int type, int operation, int destProcessId)
+{
+  DEBUG("{}: length={}, type={}, operation={}, root={}",
+          __FUNCTION__, length, type, operation, destProcessId);
+  MonaMetrics::Scope metrics(MonaMetrics::REDUCE, -1, MonaCommunicatorGetTypeSize(type) * length);
+  auto mona_comm = this->MonaComm->GetHandle();
+
+  na_size_t typesize;
+  mona_op_t monaop;
+  if (!MonaCommunicatorGetReduceOperation(type, operation, monaop, typesize))
+  {
+    vtkWarningMacro(<< "Operation number " << operation << " not supported for type number "
+                    << type << ".");
+    return 0;
+  }
+
+  const MonaCommunicatorNodeLayout* layout = this->GetNodeLayout();
+  if (layout)
+  {
+    return MonaCommunicatorNodeReduce(mona_comm, layout, sendBuffer, recvBuffer, typesize, length,
+             monaop, destProcessId, this->LocalProcessId) == NA_SUCCESS;
+  }
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_reduce(mona_comm, sendBuffer, recvBuffer, typesize, length, monaop,
+    NULL, destProcessId, tag);
+
+  if (status == NA_SUCCESS)
+  {
+    return true;
+  }
+  else
+  {
+    std::cerr << "failed for reduce with status " << status << std::endl;
+    return false;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::ReduceVoidArray(const void* sendBuffer, void* recvBuffer, vtkIdType length,
+  int type, Operation* operation, int destProcessId)
+{
+  DEBUG("{}: length={}, type={}, root={}", __FUNCTION__, length, type, destProcessId);
+  MonaMetrics::Scope metrics(MonaMetrics::REDUCE, -1, MonaCommunicatorGetTypeSize(type) * length);
+  auto mona_comm = this->MonaComm->GetHandle();
+
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Type number " << type << " not supported.");
+    return 0;
+  }
+
+  MonaCommunicatorUserOperation userOp;
+  userOp.Operation = operation;
+  userOp.Type = type;
+
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_reduce(mona_comm, sendBuffer, recvBuffer, typesize, length,
+    MonaCommunicatorUserFunction, &userOp, destProcessId, tag);
+
+  if (status == NA_SUCCESS)
+  {
+    return true;
+  }
+  else
+  {
+    std::cerr << "failed for reduce with status " << status << std::endl;
+    return false;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::AllReduceVoidArray(
+  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, int operation)
+{
+  DEBUG("{}: length={}, type={}, operation={}",
+          __FUNCTION__, length, type, operation);
+  MonaMetrics::Scope metrics(
+    MonaMetrics::ALL_REDUCE, -1, MonaCommunicatorGetTypeSize(type) * length);
+  // get comm
+  auto mona_comm = this->MonaComm->GetHandle();
+
+  //check info here
+  // get size and rank
+  /*
+  int size, rank;
+  int ret = mona_comm_size(mona_comm, &size);
+  std::cout << "debug size for allreduce " << size << std::endl;
+  if (ret != 0)
+  {
+    throw std::runtime_error("failed to get mona size");
+    return -1;
+  }
+
+  ret = mona_comm_rank(mona_comm, &rank);
+  std::cout << "debug rank for allreduce " << rank << std::endl;
+
+  if (ret != 0)
+  {
+    throw std::runtime_error("failed to get mona rank");
+    return -1;
+  }
+  */
+
+
+  na_size_t typesize;
+  mona_op_t monaop;
+  if (!MonaCommunicatorGetReduceOperation(type, operation, monaop, typesize))
+  {
+    vtkWarningMacro(<< "Operation number " << operation << " not supported for type number "
+                    << type << ".");
+    return 0;
+  }
+
+  const MonaCommunicatorNodeLayout* layout = this->GetNodeLayout();
+  if (layout)
+  {
+    return MonaCommunicatorNodeAllReduce(
+             layout, sendBuffer, recvBuffer, typesize, length, monaop) == NA_SUCCESS;
+  }
+  if (this->NumberOfProcesses > 1)
+  {
+    na_return_t ret;
+    if (typesize * length >= static_cast<na_size_t>(this->AllReduceRingThreshold) &&
+      length >= this->NumberOfProcesses)
+    {
+      ret = MonaCommunicatorRingAllReduce(
+        mona_comm, sendBuffer, recvBuffer, typesize, length, monaop);
+    }
+    else
+    {
+      ret = MonaCommunicatorRecursiveDoublingAllReduce(
+        mona_comm, sendBuffer, recvBuffer, typesize, length, monaop);
+    }
+    return ret == NA_SUCCESS;
+  }
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_allreduce(
+    mona_comm, sendBuffer, recvBuffer, typesize, length, monaop, NULL, tag);
+
+  // the source code may use true or false to adjust if it is ok
+  if (status == NA_SUCCESS)
+  {
+    return true;
+  }
+  else
+  {
+    std::cerr << "failed for allreduce" << std::endl;
+    return false;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::AllReduceVoidArray(
+  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, Operation* operation)
+{
+  DEBUG("{}: length={}, type={}", __FUNCTION__, length, type);
+  MonaMetrics::Scope metrics(
+    MonaMetrics::ALL_REDUCE, -1, MonaCommunicatorGetTypeSize(type) * length);
+  auto mona_comm = this->MonaComm->GetHandle();
+
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Type number " << type << " not supported.");
+    return 0;
+  }
+
+  MonaCommunicatorUserOperation userOp;
+  userOp.Operation = operation;
+  userOp.Type = type;
+
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t status = mona_comm_allreduce(mona_comm, sendBuffer, recvBuffer, typesize, length,
+    MonaCommunicatorUserFunction, &userOp, tag);
+
+  if (status == NA_SUCCESS)
+  {
+    return true;
+  }
+  else
+  {
+    std::cerr << "failed for allreduce with status " << status << std::endl;
+    return false;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Seconds taken by the slowest rank to run fn repetitions times, fn returns
+// the status of the collective it runs. The failures are shared along with
+// the timings, so that all the ranks see one and give up together. Returns 1
+// on success and 0 if any rank failed.
+template <typename Function>
+static int MonaCommunicatorTime(mona_comm_t comm, int repetitions, Function fn, double& slowest)
+{
+  na_return_t ret = mona_comm_barrier(comm, MonaCommunicatorCollectiveTag(comm));
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; ret == NA_SUCCESS && i < repetitions; i++)
+  {
+    ret = fn();
+  }
+  // { elapsed, failed }, reduced with MAX
+  double local[2] = {
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+    (ret == NA_SUCCESS) ? 0.0 : 1.0
+  };
+  double global[2];
+  mona_op_t maxOp;
+  na_size_t typesize;
+  MonaCommunicatorGetReduceOperation(VTK_DOUBLE, vtkCommunicator::MAX_OP, maxOp, typesize);
+  ret = mona_comm_allreduce(
+    comm, local, global, typesize, 2, maxOp, NULL, MonaCommunicatorCollectiveTag(comm));
+  if (ret != NA_SUCCESS || global[1] != 0.0)
+  {
+    return 0;
+  }
+  slowest = global[0];
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+// The cache file has one line per communicator size:
+//   <processes> <AllReduceRingThreshold> <BroadcastPipelineThreshold> <BroadcastSegmentSize>
+typedef std::map<int, std::vector<vtkIdType> > MonaCommunicatorTuningTable;
+
+static void MonaCommunicatorReadTuning(const char* fileName, MonaCommunicatorTuningTable& table)
+{
+  std::ifstream file(fileName);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty() || line[0] == '#')
+    {
+      continue;
+    }
+    std::istringstream fields(line);
+    int processes;
+    std::vector<vtkIdType> values(3);
+    if (fields >> processes >> values[0] >> values[1] >> values[2])
+    {
+      table[processes] = values;
+    }
+  }
+}
+
+static void MonaCommunicatorWriteTuning(
+  const char* fileName, const MonaCommunicatorTuningTable& table)
+{
+  std::ofstream file(fileName);
+  file << "# processes AllReduceRingThreshold BroadcastPipelineThreshold BroadcastSegmentSize\n";
+  for (const auto& entry : table)
+  {
+    file << entry.first << " " << entry.second[0] << " " << entry.second[1] << " "
+         << entry.second[2] << "\n";
+  }
+  if (!file)
+  {
+    vtkGenericWarningMacro("Could not write the collective tuning cache " << fileName);
+  }
+}
+
+//-----------------------------------------------------------------------------
+int MonaCommunicator::Autotune(const char* cacheFile)
+{
+  DEBUG("{}: cacheFile={}", __FUNCTION__, cacheFile ? cacheFile : "(none)");
+  mona_comm_t mona_comm = this->MonaComm->Handle;
+  if (!mona_comm)
+  {
+    return 0;
+  }
+
+  // rank 0 looks the communicator size up and shares the result
+  MonaCommunicatorTuningTable table;
+  vtkIdType cached[4] = { 0, 0, 0, 0 };
+  if (this->LocalProcessId == 0 && cacheFile)
+  {
+    MonaCommunicatorReadTuning(cacheFile, table);
+    auto it = table.find(this->NumberOfProcesses);
+    if (it != table.end())
+    {
+      cached[0] = 1;
+      std::copy(it->second.begin(), it->second.end(), cached + 1);
+    }
+  }
+  if (mona_comm_bcast(mona_comm, cached, sizeof(cached), 0,
+        MonaCommunicatorCollectiveTag(mona_comm)) != NA_SUCCESS)
+  {
+    return 0;
+  }
+  if (cached[0])
+  {
+    this->SetAllReduceRingThreshold(cached[1]);
+    this->SetBroadcastPipelineThreshold(cached[2]);
+    this->SetBroadcastSegmentSize(cached[3]);
+    return 1;
+  }
+
+  // Time each algorithm on messages of 1 KiB to 16 MiB. The timings are the
+  // slowest rank's, so all ranks reach the same decisions.
+  const int repetitions = 5;
+  const na_size_t smallest = na_size_t(1) << 10;
+  const na_size_t largest = na_size_t(16) << 20;
+  mona_op_t sumOp;
+  na_size_t typesize;
+  MonaCommunicatorGetReduceOperation(VTK_DOUBLE, vtkCommunicator::SUM_OP, sumOp, typesize);
+  std::vector<double> send(largest / sizeof(double), 1.0);
+  std::vector<double> recv(send.size());
+
+  vtkIdType ringThreshold = VTK_ID_MAX;
+  for (na_size_t bytes = smallest; bytes <= largest; bytes *= 2)
+  {
+    na_size_t count = bytes / sizeof(double);
+    if (count < static_cast<na_size_t>(this->NumberOfProcesses))
+    {
+      continue;
+    }
+    double doubling, ring;
+    if (!MonaCommunicatorTime(mona_comm, repetitions,
+          [&]() {
+            return MonaCommunicatorRecursiveDoublingAllReduce(
+              mona_comm, send.data(), recv.data(), typesize, count, sumOp);
+          },
+          doubling) ||
+      !MonaCommunicatorTime(mona_comm, repetitions,
+        [&]() {
+          return MonaCommunicatorRingAllReduce(
+            mona_comm, send.data(), recv.data(), typesize, count, sumOp);
+        },
+        ring))
+    {
+      vtkErrorMacro("Timing the allreduce algorithms failed, the tuning is abandoned.");
+      return 0;
+    }
+    if (ring < doubling)
+    {
+      ringThreshold = static_cast<vtkIdType>(bytes);
+      break;
+    }
+  }
+
+  // the segment size is picked on the largest message, then the crossover
+  char* buffer = reinterpret_cast<char*>(recv.data());
+  na_size_t segmentSize = static_cast<na_size_t>(this->BroadcastSegmentSize);
+  double best = 0;
+  for (na_size_t segment = na_size_t(64) << 10; segment <= (na_size_t(4) << 20); segment *= 4)
+  {
+    double pipelined;
+    if (!MonaCommunicatorTime(mona_comm, repetitions,
+          [&]() {
+            return MonaCommunicatorPipelinedBcast(
+              mona_comm, buffer, largest, 0, segment, this->ChunksInFlight);
+          },
+          pipelined))
+    {
+      vtkErrorMacro("Timing the pipelined broadcast failed, the tuning is abandoned.");
+      return 0;
+    }
+    if (best == 0 || pipelined < best)
+    {
+      best = pipelined;
+      segmentSize = segment;
+    }
   }
-  // barrier
-  auto mona_comm = this->MonaComm->GetHandle();
-
-  size_t dataSize = sizeOfType * length;
-  // it only works when we add log here and open the debug
-  na_return_t status = mona_comm_bcast(mona_comm, data, dataSize, root, MONA_COMM_BCAST_TAG);
-  if (status == NA_SUCCESS)
+  vtkIdType pipelineThreshold = VTK_ID_MAX;
+  for (na_size_t bytes = smallest; bytes <= largest; bytes *= 2)
   {
-    return true;
+    double binomial, pipelined;
+    if (!MonaCommunicatorTime(mona_comm, repetitions,
+          [&]() {
+            return mona_comm_bcast(
+              mona_comm, buffer, bytes, 0, MonaCommunicatorCollectiveTag(mona_comm));
+          },
+          binomial) ||
+      !MonaCommunicatorTime(mona_comm, repetitions,
+        [&]() {
+          return MonaCommunicatorPipelinedBcast(
+            mona_comm, buffer, bytes, 0, segmentSize, this->ChunksInFlight);
+        },
+        pipelined))
+    {
+      vtkErrorMacro("Timing the broadcast algorithms failed, the tuning is abandoned.");
+      return 0;
+    }
+    if (pipelined < binomial)
+    {
+      pipelineThreshold = static_cast<vtkIdType>(bytes);
+      break;
+    }
   }
-  else
+
+  this->SetAllReduceRingThreshold(ringThreshold);
+  this->SetBroadcastPipelineThreshold(pipelineThreshold);
+  this->SetBroadcastSegmentSize(static_cast<vtkIdType>(segmentSize));
+  if (this->LocalProcessId == 0 && cacheFile)
   {
-    return false;
+    std::vector<vtkIdType>& entry = table[this->NumberOfProcesses];
+    entry = { ringThreshold, pipelineThreshold, static_cast<vtkIdType>(segmentSize) };
+    MonaCommunicatorWriteTuning(cacheFile, table);
   }
+  return 1;
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::GatherVoidArray(
-  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, int destProcessId)
+// The non-blocking collectives run as ULTs inside MoNA and only have a single
+// handle, the payload handle of the request. With IsReceive cleared they go
+// through Test/Wait/WaitAll/WaitAny like a send.
+static int MonaCommunicatorFinishStart(
+  MonaCommunicatorOpaqueRequest* r, na_return_t ret, const char* function)
 {
-  DEBUG("{}: length={}, type={}, root={}",
-          __FUNCTION__, length, type, destProcessId);
-
-  // check the type length
-  int sizeOfType;
-  switch (type)
+  if (ret != NA_SUCCESS)
   {
-    vtkTemplateMacro(sizeOfType = sizeof(VTK_TT));
-    default:
-      vtkWarningMacro(<< "Invalid data type " << type);
-      sizeOfType = 1;
-      break;
+    vtkGenericWarningMacro("MoNA error occurred in " << function << ": " << ret);
+    r->Handle = MONA_REQUEST_NULL;
+    return 0;
   }
-
-  size_t dataSize = sizeOfType * length;
-  auto mona_comm = this->MonaComm->GetHandle();
-  na_return_t status = mona_comm_gather(
-    mona_comm, sendBuffer, dataSize, recvBuffer, destProcessId, MONA_COMM_GATHER_TAG);
-  return (status == NA_SUCCESS);
+  r->State = MONA_COMM_REQUEST_PAYLOAD;
+  return 1;
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::GatherVVoidArray(const void* sendBuffer, void* recvBuffer,
-  vtkIdType sendLength, vtkIdType* recvLengths, vtkIdType* offsets, int type, int destProcessId)
+int MonaCommunicator::IBarrier(Request& req)
 {
-    throw std::runtime_error("MonaCommunicator::GatherVVoidArray not implemented");
-    return 0;
+  DEBUG("{}", __FUNCTION__);
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  r->Reset();
+  r->Communicator = this;
+  MonaCommunicatorStartMetrics(r, MonaMetrics::BARRIER, 0);
+  mona_comm_t mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  return MonaCommunicatorFinishStart(
+    r, mona_comm_ibarrier(mona_comm, tag, &r->Handle), "mona_comm_ibarrier");
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::ScatterVoidArray(
-  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, int srcProcessId)
+int MonaCommunicator::IBroadcastVoidArray(
+  void* data, vtkIdType length, int type, int root, Request& req)
 {
-    throw std::runtime_error("MonaCommunicator::ScatterVoidArray not implemented");
+  DEBUG("{}: length={}, type={}, root={}", __FUNCTION__, length, type, root);
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Type number " << type << " not supported.");
     return 0;
+  }
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  r->Reset();
+  r->Communicator = this;
+  MonaCommunicatorStartMetrics(r, MonaMetrics::BROADCAST, typesize * length);
+  mona_comm_t mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t ret =
+    mona_comm_ibcast(mona_comm, data, typesize * length, root, tag, &r->Handle);
+  return MonaCommunicatorFinishStart(r, ret, "mona_comm_ibcast");
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::ScatterVVoidArray(const void* sendBuffer, void* recvBuffer,
-  vtkIdType* sendLengths, vtkIdType* offsets, vtkIdType recvLength, int type, int srcProcessId)
+int MonaCommunicator::IGatherVoidArray(const void* sendBuffer, void* recvBuffer,
+  vtkIdType length, int type, int destProcessId, Request& req)
 {
-    throw std::runtime_error("MonaCommunicator::ScatterVVoidArray not implemented");
+  DEBUG("{}: length={}, type={}, root={}", __FUNCTION__, length, type, destProcessId);
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Type number " << type << " not supported.");
     return 0;
+  }
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  r->Reset();
+  r->Communicator = this;
+  MonaCommunicatorStartMetrics(r, MonaMetrics::GATHER, typesize * length);
+  mona_comm_t mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t ret = mona_comm_igather(
+    mona_comm, sendBuffer, typesize * length, recvBuffer, destProcessId, tag, &r->Handle);
+  return MonaCommunicatorFinishStart(r, ret, "mona_comm_igather");
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::AllGatherVoidArray(
-  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type)
+int MonaCommunicator::IAllReduceVoidArray(const void* sendBuffer, void* recvBuffer,
+  vtkIdType length, int type, int operation, Request& req)
 {
-    throw std::runtime_error("MonaCommunicator::AllGatherVoidArray not implemented");
+  DEBUG("{}: length={}, type={}, operation={}", __FUNCTION__, length, type, operation);
+  na_size_t typesize;
+  mona_op_t monaop;
+  if (!MonaCommunicatorGetReduceOperation(type, operation, monaop, typesize))
+  {
+    vtkWarningMacro(<< "Operation number " << operation << " not supported for type number "
+                    << type << ".");
     return 0;
+  }
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  r->Reset();
+  r->Communicator = this;
+  MonaCommunicatorStartMetrics(r, MonaMetrics::ALL_REDUCE, typesize * length);
+  mona_comm_t mona_comm = this->MonaComm->GetHandle();
+  na_tag_t tag = MonaCommunicatorCollectiveTag(mona_comm);
+  na_return_t ret = mona_comm_iallreduce(
+    mona_comm, sendBuffer, recvBuffer, typesize, length, monaop, NULL, tag, &r->Handle);
+  return MonaCommunicatorFinishStart(r, ret, "mona_comm_iallreduce");
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::AllGatherVVoidArray(const void* sendBuffer, void* recvBuffer,
-  vtkIdType sendLength, vtkIdType* recvLengths, vtkIdType* offsets, int type)
+// Persistent requests keep everything a message needs besides the MoNA
+// operations themselves (the resolved source, the byte size, the prebuilt
+// envelope of a send) in the opaque request, Start only posts them again.
+int MonaCommunicator::SendInit(
+  const void* data, vtkIdType length, int type, int remoteProcessId, int tag, Request& req)
 {
-    throw std::runtime_error("MonaCommunicator::AllGatherVVoidArray not implemented");
+  DEBUG("{}: length={}, type={}, dest={}, tag={}", __FUNCTION__, length, type, remoteProcessId,
+    tag);
+  if (!this->CheckTag(tag))
+  {
+    return 0;
+  }
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
+  {
+    vtkWarningMacro(<< "Type number " << type << " not supported.");
+    return 0;
+  }
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  if (r->State != MONA_COMM_REQUEST_DONE)
+  {
+    vtkWarningMacro("Cannot set up a persistent send on an active request");
     return 0;
+  }
+  r->Reset();
+  r->Communicator = this;
+  r->Buffer = const_cast<void*>(data);
+  r->Capacity = typesize * length;
+  r->Source = remoteProcessId;
+  r->Tag = tag;
+  r->Envelope.Magic = MONA_COMM_ENVELOPE_MAGIC;
+  r->Envelope.Length = r->Capacity;
+  r->Persistent = 1;
+  return 1;
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::ReduceVoidArray(const void* sendBuffer, void* recvBuffer, vtkIdType length,
-  int type, int operation, int destProcessId)
+int MonaCommunicator::ReceiveInit(
+  void* data, vtkIdType length, int type, int remoteProcessId, int tag, Request& req)
 {
-  DEBUG("{}: length={}, type={}, operation={}, root={}",
-          __FUNCTION__, length, type, operation, destProcessId);
-  auto mona_comm = this->MonaComm->GetHandle();
-
-  // get mona operation
-  /*
-  vtk type: 6 operation: 0
-  vtk type: 3 operation: 0
-  vtk type: 11 operation: 0
-  vtk type: 17 vtk operation: 2
-  vtk type: 11 vtk operation: 1
-  vtk type: 11 vtk operation: 0
-
-  #define VTK_INT 6
-  #define VTK_UNSIGNED_CHAR 3
-  #define VTK_DOUBLE 11
-  #define VTK_UNSIGNED_LONG_LONG 17
-
-  operation
-  0 MAX_OP
-  1 MIN_OP
-  2 SUM_OP
-  */
-  // TODO use more flexible type transfer instead of hardcode it in future
-  size_t typesize;
-  mona_op_t monaop;
-  switch (operation)
+  DEBUG("{}: length={}, type={}, src={}, tag={}", __FUNCTION__, length, type, remoteProcessId,
+    tag);
+  if (!this->CheckTag(tag))
   {
-    case MAX_OP:
-      if (type == VTK_INT)
-      {
-        monaop = mona_op_max_i32;
-        typesize = sizeof(int32_t);
-      }
-      else if (type == VTK_UNSIGNED_CHAR)
-      {
-        monaop = mona_op_max_u8;
-        typesize = sizeof(unsigned char);
-      }
-      else if (type == VTK_DOUBLE)
-      {
-        monaop = mona_op_max_f64;
-        typesize = sizeof(double);
-      }
-      else
-      {
-        vtkWarningMacro(<< "operation number " << operation << " and type number " << type
-                        << " not supported.");
-      }
-      break;
-    case MIN_OP:
-      if (type == VTK_DOUBLE)
-      {
-        monaop = mona_op_min_f64;
-        typesize = sizeof(double);
-      }
-      else
-      {
-        vtkWarningMacro(<< "operation number " << operation << " and type number " << type
-                        << " not supported.");
-      }
-      break;
-    case SUM_OP:
-      if (type == VTK_UNSIGNED_LONG_LONG)
-      {
-        monaop = mona_op_sum_u64;
-        typesize = sizeof(uint64_t);
-      }
-      else
-      {
-        vtkWarningMacro(<< "operation number " << operation << " and type number " << type
-                        << " not supported.");
-      }
-      break;
-    default:
-      vtkWarningMacro(<< "Operation number " << operation << " not supported.");
-      return 0;
+    return 0;
   }
-
-  na_return_t status = mona_comm_reduce(mona_comm, sendBuffer, recvBuffer, typesize, length, monaop,
-    NULL, destProcessId, MONA_COMM_REDUCE_TAG);
-
-  if (status == NA_SUCCESS)
+  na_size_t typesize = MonaCommunicatorGetTypeSize(type);
+  if (typesize == 0)
   {
-    return true;
+    vtkWarningMacro(<< "Type number " << type << " not supported.");
+    return 0;
   }
-  else
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  if (r->State != MONA_COMM_REQUEST_DONE)
   {
-    std::cerr << "failed for reduce with status " << status << std::endl;
-    return false;
+    vtkWarningMacro("Cannot set up a persistent receive on an active request");
+    return 0;
   }
+  r->Reset();
+  r->Communicator = this;
+  r->IsReceive = 1;
+  r->Buffer = data;
+  r->Capacity = typesize * length;
+  r->Source = MonaCommunicatorGetSource(remoteProcessId);
+  r->Tag = tag;
+  r->Persistent = 1;
+  return 1;
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::ReduceVoidArray(const void* sendBuffer, void* recvBuffer, vtkIdType length,
-  int type, Operation* operation, int destProcessId)
+int MonaCommunicator::Start(Request& req)
 {
-    throw std::runtime_error("MonaCommunicator::ReduceVoidArray not implemented");
-  return 0;
+  MonaCommunicatorOpaqueRequest* r = req.Req;
+  DEBUG("{}: receive={}, remote={}, tag={}", __FUNCTION__, r->IsReceive, r->Source, r->Tag);
+  if (!r->Persistent)
+  {
+    vtkGenericWarningMacro("Start needs a request set up by SendInit or ReceiveInit");
+    return 0;
+  }
+  if (r->State != MONA_COMM_REQUEST_DONE)
+  {
+    vtkGenericWarningMacro("Starting a persistent request that is still active");
+    return 0;
+  }
+  r->Handle = MONA_REQUEST_NULL;
+  r->EnvelopeHandle = MONA_REQUEST_NULL;
+  if (!r->IsReceive)
+  {
+    return r->Communicator->StartSendInternal(r);
+  }
+  // only the envelope of the last message is left to clear
+  r->Envelope.Magic = 0;
+  r->Envelope.Length = 0;
+  r->Envelope.ChunkSize = 0;
+  r->Envelope.ChunksInFlight = 0;
+  r->Envelope.Segments = 0;
+  r->Offset = 0;
+  r->Chunk = 0;
+  r->Run = 0;
+  r->RunPiece = 0;
+  r->Sender = r->Source;
+  return r->Communicator->StartReceiveInternal(r);
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::AllReduceVoidArray(
-  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, int operation)
+int MonaCommunicator::StartAll(const int count, Request requests[])
 {
-  DEBUG("{}: length={}, type={}, operation={}",
-          __FUNCTION__, length, type, operation);
-  // get comm
-  auto mona_comm = this->MonaComm->GetHandle();
-
-  //check info here
-  // get size and rank
-  /*
-  int size, rank;
-  int ret = mona_comm_size(mona_comm, &size);
-  std::cout << "debug size for allreduce " << size << std::endl;
-  if (ret != 0)
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  int retVal = 1;
+  for (int i = 0; i < count; ++i)
   {
-    throw std::runtime_error("failed to get mona size");
-    return -1;
+    retVal &= this->Start(requests[i]);
   }
+  return retVal;
+}
 
-  ret = mona_comm_rank(mona_comm, &rank);
-  std::cout << "debug rank for allreduce " << rank << std::endl;
-
-  if (ret != 0)
+//-----------------------------------------------------------------------------
+int MonaCommunicator::WaitAll(const int count, Request requests[])
+{
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  int retVal = 1;
+  for (int i = 0; i < count; ++i)
   {
-    throw std::runtime_error("failed to get mona rank");
-    return -1;
+    retVal &= MonaCommunicator::AdvanceRequest(requests[i].Req, 1);
   }
-  */
+  return retVal;
+}
 
+//-----------------------------------------------------------------------------
+int MonaCommunicator::WaitAny(const int count, Request requests[], int& idx)
+{
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  idx = -1;
 
-  // get typesize and operator
-  na_size_t typesize;
-  mona_op_t monaop;
-  switch (operation)
+  std::vector<mona_request_t> reqs;
+  std::vector<mona_request_t*> slots;
+  std::vector<int> positions;
+  reqs.reserve(count);
+  slots.reserve(count);
+  positions.reserve(count);
+  while (true)
   {
-    case MAX_OP:
-      if (type == VTK_INT)
-      {
-        monaop = mona_op_max_i32;
-        typesize = sizeof(int32_t);
-      }
-      else if (type == VTK_UNSIGNED_CHAR)
-      {
-        monaop = mona_op_max_u8;
-        typesize = sizeof(unsigned char);
-      }
-      else if (type == VTK_DOUBLE)
-      {
-        monaop = mona_op_max_f64;
-        typesize = sizeof(double);
-      }
-      else
-      {
-        vtkWarningMacro(<< "operation number " << operation << " and type number " << type
-                        << " not supported.");
-      }
-      break;
-    case MIN_OP:
-      if (type == VTK_DOUBLE)
+    // first make whatever progress is possible without blocking
+    bool active = false;
+    bool pending = false;
+    reqs.clear();
+    slots.clear();
+    positions.clear();
+    for (int i = 0; i < count; ++i)
+    {
+      MonaCommunicatorOpaqueRequest* r = requests[i].Req;
+      if (r->State == MONA_COMM_REQUEST_DONE)
       {
-        monaop = mona_op_min_f64;
-        typesize = sizeof(double);
+        continue;
       }
-      else
+      if (!MonaCommunicator::AdvanceRequest(r, 0))
       {
-        vtkWarningMacro(<< "operation number " << operation << " and type number " << type
-                        << " not supported.");
+        idx = i;
+        return 0;
       }
-      break;
-    case SUM_OP:
-      if (type == VTK_UNSIGNED_LONG_LONG)
+      if (r->State == MONA_COMM_REQUEST_DONE)
       {
-        monaop = mona_op_sum_u64;
-        typesize = sizeof(uint64_t);
+        idx = i;
+        return 1;
       }
-      else
+      active = true;
+      mona_request_t* slot = r->Handle != MONA_REQUEST_NULL ? &r->Handle : &r->EnvelopeHandle;
+      if (*slot == MONA_REQUEST_NULL)
       {
-        vtkWarningMacro(<< "operation number " << operation << " and type number " << type
-                        << " not supported.");
+        pending = true;
+        continue;
       }
-      break;
-    default:
-      vtkWarningMacro(<< "Operation number " << operation << " not supported.");
-      return 0;
-  }
-
-  na_return_t status = mona_comm_allreduce(
-    mona_comm, sendBuffer, recvBuffer, typesize, length, monaop, NULL, MONA_COMM_ALLREDUCE_TAG);
+      reqs.push_back(*slot);
+      slots.push_back(slot);
+      positions.push_back(i);
+    }
+    if (!active)
+    {
+      // all requests are inactive, same as MPI_UNDEFINED for MPI_Waitany
+      return 1;
+    }
+    if (pending)
+    {
+      // some receives are still queued behind an Iprobe and have nothing to
+      // wait on yet, poll instead of blocking in mona_wait_any
+      ABT_thread_yield();
+      continue;
+    }
 
-  // the source code may use true or false to adjust if it is ok
-  if (status == NA_SUCCESS)
-  {
-    return true;
-  }
-  else
-  {
-    std::cerr << "failed for allreduce" << std::endl;
-    return false;
+    // block until one of the MoNA requests completes; mona_wait_any releases
+    // it, the next round moves the owning request forward
+    size_t index = 0;
+    na_return_t err = mona_wait_any(reqs.size(), reqs.data(), &index);
+    if (err != NA_SUCCESS)
+    {
+      vtkGenericWarningMacro("MoNA error occurred in mona_wait_any: " << err);
+      idx = positions[index];
+      return 0;
+    }
+    *slots[index] = MONA_REQUEST_NULL;
   }
 }
 
 //-----------------------------------------------------------------------------
-int MonaCommunicator::AllReduceVoidArray(
-  const void* sendBuffer, void* recvBuffer, vtkIdType length, int type, Operation* operation)
-{
-    throw std::runtime_error("MonaCommunicator::AllReduceVoidArray is not implemented");
-    return 0;
-}
-
-//-----------------------------------------------------------------------------
-int MonaCommunicator::WaitAll(const int count, Request requests[])
+int MonaCommunicator::WaitSome(const int count, Request requests[], int& NCompleted, int* completed)
 {
-    std::runtime_error("MonaCommunicator::WaitAll not implemented");
-    return 0;
-}
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  assert("pre: completed array is nullptr!" && (completed != nullptr));
+  NCompleted = 0;
 
-//-----------------------------------------------------------------------------
-int MonaCommunicator::WaitAny(const int count, Request requests[], int& idx)
-{
-    std::runtime_error("MonaCommunicator::WaitAll not implemented");
+  // block until at least one request is done, then sweep up every other
+  // request that completed in the meantime
+  int idx = -1;
+  if (!this->WaitAny(count, requests, idx))
+  {
     return 0;
-}
+  }
+  if (idx == -1)
+  {
+    return 1;
+  }
 
-//-----------------------------------------------------------------------------
-int MonaCommunicator::WaitSome(const int count, Request requests[], int& NCompleted, int* completed)
-{
-    throw std::runtime_error("MonaCommunicator::WaitSome not implemented");
+  int N = 0;
+  int retVal = this->TestSome(count, requests, N, completed + 1);
+  completed[0] = idx;
+  NCompleted = N + 1;
+  return retVal;
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::TestAll(const int count, MonaCommunicator::Request requests[], int& flag)
 {
-    throw std::runtime_error("MonaCommunicator::TestAll not implemented");
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  flag = 1;
+  int retVal = 1;
+  for (int i = 0; i < count; ++i)
+  {
+    retVal &= MonaCommunicator::AdvanceRequest(requests[i].Req, 0);
+    if (requests[i].Req->State != MONA_COMM_REQUEST_DONE)
+    {
+      flag = 0;
+    }
+  }
+  return retVal;
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::TestAny(
   const int count, MonaCommunicator::Request requests[], int& idx, int& flag)
 {
-    throw std::runtime_error("MonaCommunicator::TestAny not implemented");
-    return 0;
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  idx = -1;
+  flag = 0;
+  bool active = false;
+  for (int i = 0; i < count; ++i)
+  {
+    MonaCommunicatorOpaqueRequest* r = requests[i].Req;
+    if (r->State == MONA_COMM_REQUEST_DONE)
+    {
+      continue;
+    }
+    active = true;
+    if (!MonaCommunicator::AdvanceRequest(r, 0))
+    {
+      return 0;
+    }
+    if (r->State == MONA_COMM_REQUEST_DONE)
+    {
+      idx = i;
+      flag = 1;
+      return 1;
+    }
+  }
+
+  if (!active)
+  {
+    // nothing to wait for, same as MPI_Testany on inactive requests
+    flag = 1;
+  }
+  return 1;
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::TestSome(const int count, Request requests[], int& NCompleted, int* completed)
 {
-    throw std::runtime_error("MonaCommunicator::TestSome not implemented");
-    return 0;
+  DEBUG("{}: count={}", __FUNCTION__, count);
+  assert("pre: completed array is nullptr!" && (completed != nullptr));
+  NCompleted = 0;
+  int retVal = 1;
+  for (int i = 0; i < count; ++i)
+  {
+    MonaCommunicatorOpaqueRequest* r = requests[i].Req;
+    if (r->State == MONA_COMM_REQUEST_DONE)
+    {
+      continue;
+    }
+    retVal &= MonaCommunicator::AdvanceRequest(r, 0);
+    if (r->State == MONA_COMM_REQUEST_DONE)
+    {
+      completed[NCompleted++] = i;
+    }
+  }
+  return retVal;
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::Iprobe(int source, int tag, int* flag, int* actualSource)
 {
-    throw std::runtime_error("MonaCommunicator::Iprobe not implemented");
-    return 0;
+  return this->IprobeInternal(source, tag, flag, actualSource, 1, nullptr);
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::Iprobe(
   int source, int tag, int* flag, int* actualSource, int* vtkNotUsed(type), int* size)
 {
-    throw std::runtime_error("MonaCommunicator::Iprobe not implemented");
-    return 0;
+  return this->IprobeInternal(source, tag, flag, actualSource, sizeof(int), size);
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::Iprobe(
   int source, int tag, int* flag, int* actualSource, unsigned long* vtkNotUsed(type), int* size)
 {
-    throw std::runtime_error("MonaCommunicator::Iprobe not implemented");
-    return 0;
+  return this->IprobeInternal(source, tag, flag, actualSource, sizeof(unsigned long), size);
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::Iprobe(
   int source, int tag, int* flag, int* actualSource, const char* vtkNotUsed(type), int* size)
 {
-    throw std::runtime_error("MonaCommunicator::Iprobe not implemented");
-    return 0;
+  return this->IprobeInternal(source, tag, flag, actualSource, sizeof(char), size);
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::Iprobe(
   int source, int tag, int* flag, int* actualSource, float* vtkNotUsed(type), int* size)
 {
-    throw std::runtime_error("MonaCommunicator::Iprobe not implemented");
-    return 0;
+  return this->IprobeInternal(source, tag, flag, actualSource, sizeof(float), size);
 }
 
 //-----------------------------------------------------------------------------
 int MonaCommunicator::Iprobe(
   int source, int tag, int* flag, int* actualSource, double* vtkNotUsed(type), int* size)
 {
-    throw std::runtime_error("MonaCommunicator::Iprobe not implemented");
-    return 0;
+  return this->IprobeInternal(source, tag, flag, actualSource, sizeof(double), size);
 }
@@ -5,11 +5,16 @@
 #include <vtkCommunicator.h>
 #include "Mona.hpp"
 
+#include <vector>
+
 class MonaController;
+class vtkDataArray;
 class vtkProcessGroup;
 
 class MonaCommunicatorOpaqueComm;
+class MonaCommunicatorNodeLayout;
 class MonaCommunicatorOpaqueRequest;
+class MonaCommunicatorProbeState;
 class MonaCommunicatorReceiveDataInfo;
 
 class VTKPARALLELMPI_EXPORT MonaCommunicator : public vtkCommunicator
@@ -46,15 +51,19 @@ public:
   static MonaCommunicator* GetWorldCommunicatorByMona(mona_comm_t mona_comm);
 
   /**
-   * Used to initialize the communicator (i.e. create the underlying MPI_Comm).
-   * The group must be associated with a valid MonaCommunicator.
+   * Used to initialize the communicator (i.e. create the underlying mona_comm_t
+   * with mona_comm_subset, and owned by this communicator). The group must be
+   * associated with a valid MonaCommunicator. Processes outside the group are
+   * left without a handle.
    */
   int Initialize(vtkProcessGroup *group);
 
   /**
-   * Used to initialize the communicator (i.e. create the underlying MPI_Comm)
-   * using MPI_Comm_split on the given communicator. Return values are 1 for success
-   * and 0 otherwise.
+   * Used to initialize the communicator (i.e. create the underlying mona_comm_t)
+   * by splitting the given communicator by color, ordered by key, as
+   * MPI_Comm_split does. This is collective over oldcomm. Processes with a
+   * negative color are left without a handle, which is not an error. Return
+   * values are 1 for success and 0 otherwise.
    */
   int SplitInitialize(vtkCommunicator *oldcomm, int color, int key);
 
@@ -62,7 +71,10 @@ public:
   /**
    * Performs the actual communication.  You will usually use the convenience
    * Send functions defined in the superclass. Return values are 1 for success
-   * and 0 otherwise.
+   * and 0 otherwise. Tags must be between 0 and 2^24 - 1. The messages are
+   * not plain MoNA messages, each one starts with an envelope that carries
+   * the payload when it is small (see the README), so the peer must be a
+   * MonaCommunicator or follow the same format.
    */
   virtual int SendVoidArray(const void *data, vtkIdType length, int type,
                             int remoteProcessId, int tag) override;
@@ -163,6 +175,44 @@ public:
                                  Operation *operation) override;
   //@}
 
+  //@{
+  /**
+   * Non-blocking variants of Barrier, Broadcast, Gather and AllReduce. MoNA
+   * runs each of them as a ULT and the request completes with it, so it can
+   * be finished with Wait, Test, WaitAll, WaitAny and friends. The buffers
+   * must not be touched until then. IAllReduceVoidArray only supports the
+   * standard operations. Return values are 1 for success and 0 otherwise.
+   */
+  int IBarrier(Request& req);
+  int IBroadcastVoidArray(void* data, vtkIdType length, int type, int srcProcessId,
+                          Request& req);
+  int IGatherVoidArray(const void* sendBuffer, void* recvBuffer, vtkIdType length,
+                       int type, int destProcessId, Request& req);
+  int IAllReduceVoidArray(const void* sendBuffer, void* recvBuffer, vtkIdType length,
+                          int type, int operation, Request& req);
+  //@}
+
+  //@{
+  /**
+   * Persistent requests, like MPI_Send_init/MPI_Recv_init and MPI_Start, for
+   * messages repeated with the same buffer, peer and tag (e.g. each time
+   * step). SendInit and ReceiveInit only set up req, Start posts the message
+   * and it is then finished like any non-blocking request (Wait, Test,
+   * WaitAll...), after which it can be started again. The matching side can
+   * use plain or persistent operations. A persistent receive from a known
+   * source has its payload receive posted on Start, so the payload lands in
+   * place without waiting for the envelope. Using req for another
+   * non-blocking operation turns it back into a regular request. Return
+   * values are 1 for success and 0 otherwise.
+   */
+  int SendInit(const void* data, vtkIdType length, int type, int remoteProcessId, int tag,
+               Request& req);
+  int ReceiveInit(void* data, vtkIdType length, int type, int remoteProcessId, int tag,
+                  Request& req);
+  int Start(Request& req);
+  int StartAll(const int count, Request requests[]);
+  //@}
+
   //@{
   /**
    * Nonblocking test for a message.  Inputs are: source -- the source rank
@@ -170,8 +220,9 @@ public:
    * flag -- True if a message matches; actualSource -- the rank
    * sending the message (useful if ANY_SOURCE is used) if flag is True
    * and actualSource isn't nullptr; size -- the length of the message in
-   * bytes if flag is true (only set if size isn't nullptr). The return
-   * value is 1 for success and 0 otherwise.
+   * units of the given type if flag is true (only set if size isn't nullptr).
+   * The return value is 1 for success and 0 otherwise.
+   * A message found by Iprobe stays queued until it is received.
    */
   int Iprobe(int source, int tag, int* flag, int* actualSource);
   int Iprobe(int source, int tag, int* flag, int* actualSource,
@@ -186,6 +237,43 @@ public:
              double* type, int* size);
   //@}
 
+  //@{
+  /**
+   * Send and receive count memory segments (lengths in bytes) as one
+   * message, without packing them into a contiguous buffer: each segment is
+   * sent from, and received into, its own memory (UseCopy does not apply).
+   * The segments of the two ends need not match, a multi-segment message
+   * can be received by a plain Receive and a plain message by
+   * ReceiveSegments; pieces that straddle the receiver's segments go through
+   * a staging buffer. Segments averaging fewer than 16 bytes, and messages
+   * small enough to travel in the envelope, are packed and sent as a plain
+   * message. After ReceiveSegments, GetCount gives the
+   * number of bytes received. Return values are 1 for success and 0
+   * otherwise.
+   */
+  int SendSegments(const void* const* segments, const vtkIdType* lengths, int count,
+                   int remoteProcessId, int tag);
+  int ReceiveSegments(void* const* segments, const vtkIdType* lengths, int count,
+                      int remoteProcessId, int tag);
+  //@}
+
+  //@{
+  /**
+   * Send and receive the strided sub-box subExtent of an array laid out
+   * over extent (VTK extents, x varying fastest), e.g. the halo of a piece
+   * of vtkImageData, as one multi-segment message. elementSize is the size
+   * in bytes of one tuple, the vtkDataArray versions take it from the array.
+   */
+  int SendSubExtent(const void* data, const int extent[6], const int subExtent[6],
+                    int elementSize, int remoteProcessId, int tag);
+  int ReceiveSubExtent(void* data, const int extent[6], const int subExtent[6],
+                       int elementSize, int remoteProcessId, int tag);
+  int SendSubExtent(vtkDataArray* array, const int extent[6], const int subExtent[6],
+                    int remoteProcessId, int tag);
+  int ReceiveSubExtent(vtkDataArray* array, const int extent[6], const int subExtent[6],
+                       int remoteProcessId, int tag);
+  //@}
+
   /**
    * Given the request objects of a set of non-blocking operations
    * (send and/or receive) this method blocks until all requests are complete.
@@ -251,6 +339,67 @@ public:
   vtkBooleanMacro(UseSsend, int);
   //@}
 
+  //@{
+  /**
+   * Messages of more than ChunkSize bytes are sent by SendVoidArray as a
+   * pipeline of ChunkSize chunks, with up to ChunksInFlight of them
+   * outstanding at a time. The receiver follows the sender's settings.
+   * Defaults are 64 MiB and 4.
+   */
+  vtkSetClampMacro(ChunkSize, vtkIdType, 1, VTK_ID_MAX);
+  vtkGetMacro(ChunkSize, vtkIdType);
+  vtkSetClampMacro(ChunksInFlight, int, 1, 64);
+  vtkGetMacro(ChunksInFlight, int);
+  //@}
+
+  //@{
+  /**
+   * When on, Barrier, Broadcast, Gather, and Reduce/AllReduce with a
+   * standard operation are done node by node: the ranks of a node meet on
+   * their lowest rank, and only these node leaders communicate across nodes.
+   * Ranks are placed by host name, or by the value of the MONA_VTK_NODE_NAME
+   * environment variable when it is set. The layout is computed by the first
+   * such collective. Nothing changes when all ranks share one node or each
+   * one has its own. Traffic within a node still goes through the MoNA
+   * transport, so this only pays off when that transport has a fast local
+   * path; it adds rounds otherwise. Default is off. Must be set the same way
+   * on all processes.
+   */
+  vtkSetMacro(HierarchicalCollectives, int);
+  vtkGetMacro(HierarchicalCollectives, int);
+  vtkBooleanMacro(HierarchicalCollectives, int);
+  //@}
+
+  //@{
+  /**
+   * Algorithm selection of the flat collectives. AllReduce with a standard
+   * operation uses recursive doubling below AllReduceRingThreshold bytes and
+   * a ring (reduce-scatter then allgather) from there on. Broadcast uses
+   * MoNA's binomial tree below BroadcastPipelineThreshold bytes and a
+   * binomial tree pipelined in BroadcastSegmentSize segments from there on,
+   * with up to ChunksInFlight segments outstanding per child. Defaults are
+   * 512 KiB, 1 MiB and 256 KiB. These, and ChunksInFlight, must be the same
+   * on all processes.
+   */
+  vtkSetClampMacro(AllReduceRingThreshold, vtkIdType, 0, VTK_ID_MAX);
+  vtkGetMacro(AllReduceRingThreshold, vtkIdType);
+  vtkSetClampMacro(BroadcastPipelineThreshold, vtkIdType, 0, VTK_ID_MAX);
+  vtkGetMacro(BroadcastPipelineThreshold, vtkIdType);
+  vtkSetClampMacro(BroadcastSegmentSize, vtkIdType, 1, VTK_ID_MAX);
+  vtkGetMacro(BroadcastSegmentSize, vtkIdType);
+  //@}
+
+  /**
+   * Set the thresholds above by timing the algorithms on this communicator.
+   * When cacheFile is given, the values found for a communicator of the same
+   * size are read from it instead, and new values are added to it (by rank
+   * 0). This is a collective operation. MonaController::Initialize calls it
+   * on the world communicator when MONA_VTK_AUTOTUNE is set, to the name of
+   * the cache file or to an empty string for no cache. Returns 1 for success
+   * and 0 otherwise, in which case the thresholds are left unchanged.
+   */
+  int Autotune(const char* cacheFile = nullptr);
+
   /**
    * Copies all the attributes of source, deleting previously
    * stored data. The MPI communicator handle is also copied.
@@ -268,6 +417,28 @@ protected:
   // not be called if the current communicator does not include this process
   int InitializeNumberOfProcesses();
 
+  // Use the (cached) subset of parent made of the given parent ranks, in
+  // that order.
+  int InitializeSubset(MonaCommunicator* parent, const std::vector<int>& ranks);
+
+  // Node layout used by the hierarchical collectives, null when they are off
+  // or would not help.
+  const MonaCommunicatorNodeLayout* GetNodeLayout();
+
+  //@{
+  /**
+   * Send and receive the data objects that vtkCommunicator does not split
+   * further, so every caller of Send/Receive of a vtkDataObject takes the same
+   * path. vtkImageData and vtkPolyData are sent as a header describing their
+   * structure and arrays, followed by the buffer of each vtkDataArray as its
+   * own message, sent from and received into the array memory. Other data
+   * objects, and data sets holding arrays without the standard memory layout,
+   * fall back to the marshalling of vtkCommunicator behind the same header.
+   */
+  int SendElementalDataObject(vtkDataObject* data, int remoteProcessId, int tag) override;
+  int ReceiveElementalDataObject(vtkDataObject* data, int remoteProcessId, int tag) override;
+  //@}
+
   //@{
   /**
    * KeepHandle is normally off. This means that the MPI
@@ -288,10 +459,14 @@ protected:
 
   void InitializeCopy(MonaCommunicator* source);
 
+  // Drop the current handle, freeing it (and the subsets cached for it) if
+  // it is owned by this communicator.
+  void ReleaseHandle();
+
   /**
    * Copies all the attributes of source, deleting previously
-   * stored data EXCEPT the MPI communicator handle which is
-   * duplicated with MPI_Comm_dup(). Therefore, although the
+   * stored data EXCEPT the MoNA communicator handle which is
+   * duplicated with mona_comm_dup(). Therefore, although the
    * processes in the communicator remain the same, a new context
    * is created. This prevents the two communicators from
    * intefering with each other during message send/receives even
@@ -308,17 +483,80 @@ protected:
   // TODO, use the MonaCommunicatorReceiveDataInfo to wrap the mona comm 
   // when there is complete support about the mona type and status
   virtual int ReceiveDataInternal(
-    char *data, int length, int sizeoftype, int remoteProcessId, int tag,
+    char *data, na_size_t size, int remoteProcessId, int tag,
     mona_comm_t monacomm, int useCopy, int &senderId);
 
+  //@{
+  /**
+   * Pipelined transfer of a payload described by a chunked envelope.
+   */
+  int SendChunks(const char* data, na_size_t size, na_size_t chunkSize, int window,
+                 int remoteProcessId, int tag);
+  int ReceiveChunks(char* data, na_size_t size, na_size_t chunkSize, int window,
+                    int remoteProcessId, int tag);
+  //@}
+
+  //@{
+  /**
+   * Point-to-point messages are an envelope on the user tag followed by the
+   * payload on the user tag with bit 31 set, see MonaCommunicatorEnvelope.
+   * Payloads of at most MONA_COMM_EAGER_LIMIT bytes are carried by the
+   * envelope itself, so a small message is a single MoNA message. Peers
+   * using raw mona_comm_send/recv must follow this format. ReceiveEnvelope
+   * blocks until the envelope of the next matching message is available.
+   */
+  int ReceiveEnvelope(int remoteProcessId, int tag, MonaCommunicatorEnvelope* envelope,
+                      int &senderId);
+  int ReceivePayload(char* data, const MonaCommunicatorEnvelope& envelope,
+                     int remoteProcessId, int tag);
+  int ReceiveDataObjectHeader(int remoteProcessId, int tag, std::vector<char>& header,
+                              int& type, int& binary);
+  int ReceiveDataObjectArrays(vtkDataObject* data, std::vector<char>& header,
+                              int remoteProcessId, int tag);
+  int NoBlockSendInternal(const void* data, na_size_t size, int remoteProcessId,
+                          int tag, Request& req);
+  int NoBlockReceiveInternal(void* data, na_size_t size, int remoteProcessId,
+                             int tag, Request& req);
+  int StartSendInternal(MonaCommunicatorOpaqueRequest* r);
+  int StartReceiveInternal(MonaCommunicatorOpaqueRequest* r);
+  int IprobeInternal(int source, int tag, int* flag, int* actualSource,
+                     int sizeoftype, int* size);
+  //@}
+
+  /**
+   * Point-to-point tags must fit in bits 0..23, the upper bits of a MoNA tag
+   * are taken by the protocol (chunk slots, collective tags, payloads).
+   * Reports an error and returns 0 for any other tag.
+   */
+  int CheckTag(int tag);
+
+  /**
+   * Move a non-blocking request forward, waiting for it when blocking is set.
+   * Returns 0 on error.
+   */
+  static int AdvanceRequest(MonaCommunicatorOpaqueRequest* req, int blocking);
+
+  /**
+   * Drop a reference to a request, completing pending sends before the
+   * request is freed.
+   */
+  static void ReleaseRequest(MonaCommunicatorOpaqueRequest* req);
+
 
   MonaCommunicatorOpaqueComm* MonaComm;
+  MonaCommunicatorProbeState* ProbeState;
 
   int Initialized;
   int KeepHandle;
 
   int LastSenderId;
   int UseSsend;
+  vtkIdType ChunkSize;
+  int ChunksInFlight;
+  int HierarchicalCollectives;
+  vtkIdType AllReduceRingThreshold;
+  vtkIdType BroadcastPipelineThreshold;
+  vtkIdType BroadcastSegmentSize;
   static int CheckForMPIError(int err);
 
 private:
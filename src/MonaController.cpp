@@ -13,6 +13,7 @@ PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
 #include "MonaController.hpp"
+#include "MonaEventLog.hpp"
 
 #include <vtkIntArray.h>
 #include <vtkObjectFactory.h>
@@ -20,6 +21,7 @@ PURPOSE.  See the above copyright notice for more information.
 #include <vtkSmartPointer.h>
 
 #include <cassert>
+#include <cstdlib>
 
 #include <spdlog/spdlog.h>
 #include "Mona.hpp"
@@ -38,6 +40,8 @@ PURPOSE.  See the above copyright notice for more information.
 int MonaController::Initialized = 0;
 char MonaController::ProcessorName[MPI_MAX_PROCESSOR_NAME] = "";
 int MonaController::UseSsendForRMI = 0;
+std::string MonaController::MetricsFilePrefix =
+  getenv("MONA_VTK_METRICS") ? getenv("MONA_VTK_METRICS") : "";
 
 // Output window which prints out the process id
 // with the error or warning messages
@@ -85,8 +89,11 @@ MonaController::MonaController()
   if (MonaController::Initialized)
   {
     this->InitializeCommunicator(MonaCommunicator::GetWorldCommunicator());
-    // TODO, consider the RMICommunicator when it is needed
-    this->RMICommunicator = NULL;
+    // Copy MonaController::WorldRMICommunicator which is created when
+    // the controller is initialized
+    MonaCommunicator* comm = MonaCommunicator::New();
+    comm->CopyFrom(MonaController::WorldRMICommunicator);
+    this->RMICommunicator = comm;
   }
 
   this->OutputWindow = 0;
@@ -134,6 +141,30 @@ void MonaController::TriggerRMIInternal(
 }
 
 //----------------------------------------------------------------------------
+// When MONA_VTK_AUTOTUNE is set, the collective algorithms of the world
+// communicator are tuned at startup, with the file it names as cache.
+static void MonaControllerAutotune(MonaCommunicator* comm)
+{
+  const char* cacheFile = getenv("MONA_VTK_AUTOTUNE");
+  if (cacheFile)
+  {
+    comm->Autotune(*cacheFile ? cacheFile : nullptr);
+  }
+}
+
+//----------------------------------------------------------------------------
+// When MONA_VTK_TRACE is set, the clocks are aligned for MonaEventLog at
+// startup and the trace of all the processes is written at Finalize to the
+// file it names.
+static void MonaControllerInitializeTrace(MonaController* controller)
+{
+  const char* traceFile = getenv("MONA_VTK_TRACE");
+  if (traceFile && *traceFile)
+  {
+    MonaEventLog::InitializeLogging(controller);
+  }
+}
+
 void MonaController::Initialize(int*, char***, int)
 {
   DEBUG("{}", __FUNCTION__ );
@@ -151,19 +182,9 @@ void MonaController::Initialize(int*, char***, int)
 
   // XXX TODO fill out processor name (mona self address)
 
-  // TODO? set it as GetWorldCommunicator or null currently
-  // consider this thing when the RMICommunicator will be used actually
-  // create the WorldRMICommunicator
-  MonaController::WorldRMICommunicator = NULL;
-
-  // set the necessary info into the new communicator
-  // ((MonaCommunicator*)(this->Communicator))->Duplicate(MonaController::WorldRMICommunicator);
-
-  this->RMICommunicator = NULL;
-  // Since we use Delete to get rid of the reference, we should use nullptr to
-  // register.
-  // TODO, consider RMICommunicator in future
-  // this->RMICommunicator->Register(nullptr);
+  MonaControllerAutotune((MonaCommunicator*)this->Communicator);
+  MonaControllerInitializeTrace(this);
+  this->InitializeWorldRMICommunicator();
   this->Modified();
 }
 
@@ -187,20 +208,28 @@ void MonaController::Initialize(mona_comm_t mona_comm)
 
   // XXX TODO fill out processor name (mona self address)
 
-  // TODO? set it as GetWorldCommunicator or null currently
-  // consider this thing when the RMICommunicator will be used actually
-  // create the WorldRMICommunicator
-  MonaController::WorldRMICommunicator = NULL;
+  MonaControllerAutotune((MonaCommunicator*)this->Communicator);
+  MonaControllerInitializeTrace(this);
+  this->InitializeWorldRMICommunicator();
+  this->Modified();
+}
 
-  // set the necessary info into the new communicator
-  // ((MonaCommunicator*)(this->Communicator))->Duplicate(MonaController::WorldRMICommunicator);
+// Create the WorldRMICommunicator, a duplicate of the world communicator so
+// that RMI messages never share a tag space with user level messages.
+void MonaController::InitializeWorldRMICommunicator()
+{
+  DEBUG("{}", __FUNCTION__ );
+  MonaController::WorldRMICommunicator = MonaCommunicator::New();
+  MonaController::WorldRMICommunicator->Duplicate((MonaCommunicator*)this->Communicator);
 
-  this->RMICommunicator = NULL;
+  if (this->RMICommunicator)
+  {
+    this->RMICommunicator->Delete();
+  }
+  this->RMICommunicator = MonaController::WorldRMICommunicator;
   // Since we use Delete to get rid of the reference, we should use nullptr to
   // register.
-  // TODO, consider RMICommunicator in future
-  // this->RMICommunicator->Register(nullptr);
-  this->Modified();
+  this->RMICommunicator->Register(nullptr);
 }
 
 
@@ -210,12 +239,50 @@ const char* MonaController::GetProcessorName()
   return ProcessorName;
 }
 
+//----------------------------------------------------------------------------
+int MonaController::WriteMetrics(const char* fileName)
+{
+  DEBUG("{}: fileName={}", __FUNCTION__, fileName);
+  if (!MonaMetrics::WriteJSON(fileName, this->GetLocalProcessId()))
+  {
+    vtkWarningMacro("Could not write the communication metrics to " << fileName);
+    return 0;
+  }
+  return 1;
+}
+
+void MonaController::SetMetricsFilePrefix(const char* prefix)
+{
+  MonaController::MetricsFilePrefix = prefix ? prefix : "";
+}
+
+const char* MonaController::GetMetricsFilePrefix()
+{
+  return MonaController::MetricsFilePrefix.c_str();
+}
+
 // Good-bye world
 void MonaController::Finalize()
 {
   DEBUG("{}", __FUNCTION__ );
   if (MonaController::Initialized)
   {
+    if (!MonaController::MetricsFilePrefix.empty())
+    {
+      std::string fileName = MonaController::MetricsFilePrefix + "." +
+        std::to_string(this->GetLocalProcessId()) + ".json";
+      this->WriteMetrics(fileName.c_str());
+    }
+    const char* traceFile = getenv("MONA_VTK_TRACE");
+    if (traceFile && *traceFile)
+    {
+      MonaEventLog::FinalizeLogging(traceFile, this);
+    }
+    if (MonaController::WorldRMICommunicator)
+    {
+      MonaController::WorldRMICommunicator->Delete();
+      MonaController::WorldRMICommunicator = 0;
+    }
     if(MonaCommunicator::WorldCommunicator!=0){
         MonaCommunicator::WorldCommunicator->Delete();
         MonaCommunicator::WorldCommunicator = 0;
@@ -277,10 +344,8 @@ void MonaController::SetCommunicator(MonaCommunicator* comm)
     } else {
         DEBUG("{}: comm=null", __FUNCTION__);
     }
-  //TODO free the old communicator
   this->InitializeCommunicator(comm);
-  //TODO consider RMI communication in future
-  //this->InitializeRMICommunicator();
+  this->InitializeRMICommunicator();
 }
 
 //----------------------------------------------------------------------------
@@ -349,15 +414,46 @@ char* MonaController::ErrorString(int err)
 //-----------------------------------------------------------------------------
 MonaController* MonaController::CreateSubController(vtkProcessGroup* group)
 {
-    throw std::runtime_error("MonaController::CreateSubController not implemented");
+  DEBUG("{}: group={}", __FUNCTION__, (void*)group);
+  VTK_CREATE(MonaCommunicator, subcomm);
+
+  if (!subcomm->Initialize(group))
+  {
     return nullptr;
+  }
+
+  // Processes that are not part of the group get no handle, this is not an
+  // error, they just do not get a controller.
+  if (subcomm->GetMonaComm()->GetHandle() == nullptr)
+  {
+    return nullptr;
+  }
+
+  MonaController* controller = MonaController::New();
+  controller->SetCommunicator(subcomm);
+  return controller;
 }
 
 //-----------------------------------------------------------------------------
 MonaController* MonaController::PartitionController(int localColor, int localKey)
 {
-    throw std::runtime_error("MonaController::PartitionController not implemented");
+  DEBUG("{}: color={}, key={}", __FUNCTION__, localColor, localKey);
+  VTK_CREATE(MonaCommunicator, subcomm);
+
+  if (!subcomm->SplitInitialize(this->Communicator, localColor, localKey))
+  {
     return nullptr;
+  }
+
+  // Processes with a negative color get no handle, and no controller.
+  if (subcomm->GetMonaComm()->GetHandle() == nullptr)
+  {
+    return nullptr;
+  }
+
+  MonaController* controller = MonaController::New();
+  controller->SetCommunicator(subcomm);
+  return controller;
 }
 
 //-----------------------------------------------------------------------------
@@ -377,7 +473,7 @@ int MonaController::WaitSome(
   // Delegate to Mona communicator
   int N = 0;
   int rc = myMonaCommunicator->WaitSome(count, rqsts, N, completed->GetPointer(0));
-  assert("post: Number of completed requests must N > 0" && (N > 0) && (N < (count - 1)));
+  assert("post: Number of completed requests must N <= count" && (N >= 0) && (N <= count));
   completed->Resize(N);
 
   return (rc);
@@ -433,7 +529,7 @@ bool MonaController::TestSome(
 
   int N = 0;
   myMonaCommunicator->TestSome(count, requests, N, completed->GetPointer(0));
-  assert("post: Number of completed requests must N > 0" && (N > 0) && (N < (count - 1)));
+  assert("post: Number of completed requests must N <= count" && (N >= 0) && (N <= count));
 
   if (N > 0)
   {
@@ -7,6 +7,10 @@
 // which take arguments defined in  MonaCommunicator.h by
 // reference.
 #include "MonaCommunicator.hpp" // Needed for direct access to communicator
+#include "MonaMetrics.hpp"
+
+#include <map>
+#include <string>
 
 class vtkIntArray;
 
@@ -96,6 +100,37 @@ public:
 
   virtual MonaController *PartitionController(int localColor, int localKey) override;
 
+  //@{
+  /**
+   * Multi-segment and strided sub-box messages, see
+   * MonaCommunicator::SendSegments and MonaCommunicator::SendSubExtent.
+   */
+  int SendSegments(const void *const *segments, const vtkIdType *lengths, int count,
+                   int remoteProcessId, int tag)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->SendSegments(segments, lengths, count, remoteProcessId, tag);
+  }
+  int ReceiveSegments(void *const *segments, const vtkIdType *lengths, int count,
+                      int remoteProcessId, int tag)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->ReceiveSegments(segments, lengths, count, remoteProcessId, tag);
+  }
+  int SendSubExtent(vtkDataArray *array, const int extent[6], const int subExtent[6],
+                    int remoteProcessId, int tag)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->SendSubExtent(array, extent, subExtent, remoteProcessId, tag);
+  }
+  int ReceiveSubExtent(vtkDataArray *array, const int extent[6], const int subExtent[6],
+                       int remoteProcessId, int tag)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->ReceiveSubExtent(array, extent, subExtent, remoteProcessId, tag);
+  }
+  //@}
+
   /**
    * This method sends data to another process (non-blocking).
    * Tag eliminates ambiguity when multiple sends or receives
@@ -250,6 +285,62 @@ public:
     return ((MonaCommunicator *)this->Communicator)->Iprobe(source, tag, flag, actualSource, type, size);
   }
 
+  //@{
+  /**
+   * Non-blocking collectives, see MonaCommunicator::IBarrier and friends.
+   * Note: These methods delegate to the communicator
+   */
+  int IBarrier(MonaCommunicator::Request& req)
+  {
+    return ((MonaCommunicator *)this->Communicator)->IBarrier(req);
+  }
+  int IBroadcastVoidArray(void *data, vtkIdType length, int type, int srcProcessId,
+                          MonaCommunicator::Request &req)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->IBroadcastVoidArray(data, length, type, srcProcessId, req);
+  }
+  int IGatherVoidArray(const void *sendBuffer, void *recvBuffer, vtkIdType length, int type,
+                       int destProcessId, MonaCommunicator::Request &req)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->IGatherVoidArray(sendBuffer, recvBuffer, length, type, destProcessId, req);
+  }
+  int IAllReduceVoidArray(const void *sendBuffer, void *recvBuffer, vtkIdType length, int type,
+                          int operation, MonaCommunicator::Request &req)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->IAllReduceVoidArray(sendBuffer, recvBuffer, length, type, operation, req);
+  }
+  //@}
+
+  //@{
+  /**
+   * Persistent requests, see MonaCommunicator::SendInit and friends.
+   * Note: These methods delegate to the communicator
+   */
+  int SendInit(const void *data, vtkIdType length, int type, int remoteProcessId, int tag,
+               MonaCommunicator::Request &req)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->SendInit(data, length, type, remoteProcessId, tag, req);
+  }
+  int ReceiveInit(void *data, vtkIdType length, int type, int remoteProcessId, int tag,
+                  MonaCommunicator::Request &req)
+  {
+    return ((MonaCommunicator *)this->Communicator)
+      ->ReceiveInit(data, length, type, remoteProcessId, tag, req);
+  }
+  int Start(MonaCommunicator::Request &req)
+  {
+    return ((MonaCommunicator *)this->Communicator)->Start(req);
+  }
+  int StartAll(const int count, MonaCommunicator::Request requests[])
+  {
+    return ((MonaCommunicator *)this->Communicator)->StartAll(count, requests);
+  }
+  //@}
+
   /**
    * Given the request objects of a set of non-blocking operations
    * (send and/or receive) this method blocks until all requests are complete.
@@ -320,6 +411,40 @@ public:
     return MonaController::UseSsendForRMI;
   }
 
+  //@{
+  /**
+   * Communication metrics of this process (calls, bytes, time and latency
+   * histogram per operation, and per tag for point-to-point messages), see
+   * MonaMetrics. GetMetrics takes a MonaMetrics::Operation.
+   */
+  static MonaMetrics::Counters GetMetrics(int operation)
+  {
+    return MonaMetrics::GetCounters(static_cast<MonaMetrics::Operation>(operation));
+  }
+  static std::map<int, std::map<int, MonaMetrics::Counters> > GetTagMetrics()
+  {
+    return MonaMetrics::GetTagCounters();
+  }
+  static void ResetMetrics() { MonaMetrics::Reset(); }
+  static void SetMetricsEnabled(bool enabled) { MonaMetrics::SetEnabled(enabled); }
+  //@}
+
+  /**
+   * Write the metrics of this process as JSON to fileName. Returns 1 for
+   * success and 0 otherwise.
+   */
+  int WriteMetrics(const char *fileName);
+
+  //@{
+  /**
+   * When set, Finalize writes the metrics of each process to
+   * <prefix>.<rank>.json. Defaults to the value of the MONA_VTK_METRICS
+   * environment variable.
+   */
+  static void SetMetricsFilePrefix(const char *prefix);
+  static const char *GetMetricsFilePrefix();
+  //@}
+
 protected:
   MonaController();
   ~MonaController();
@@ -330,6 +455,10 @@ protected:
   // Duplicate the current communicator, creating RMICommunicator
   void InitializeRMICommunicator();
 
+  // Duplicate the world communicator into WorldRMICommunicator and use it
+  // as RMICommunicator, called once by Initialize()
+  void InitializeWorldRMICommunicator();
+
   /**
    * Implementation for TriggerRMI() provides subclasses an opportunity to
    * modify the behaviour eg. MPIController provides ability to use Ssend
@@ -357,6 +486,8 @@ protected:
    */
   static int UseSsendForRMI;
 
+  static std::string MetricsFilePrefix;
+
 private:
   MonaController(const MonaController &) = delete;
   void operator=(const MonaController &) = delete;
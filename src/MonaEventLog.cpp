@@ -14,60 +14,155 @@
 =========================================================================*/
 
 #include "MonaEventLog.hpp"
-#include "MonaController.hpp"
+#include "MonaTrace.hpp"
+#include <vtkMultiProcessController.h>
 #include <vtkObjectFactory.h>
-#include <mpi.h>
-#include <mpe.h>
 
-int MonaEventLog::LastEventId = 0;
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+// number of round trips used to estimate the offset of each clock, the one
+// with the shortest round trip is kept
+#define MONA_EVENT_LOG_CLOCK_ROUNDS 8
+
+vtkMultiProcessController* MonaEventLog::Controller = nullptr;
 
 vtkStandardNewMacro(MonaEventLog);
 
 void MonaEventLog::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
+  os << indent << "Active: " << this->Active << endl;
+  os << indent << "EventId: " << this->EventId << endl;
 }
 
 MonaEventLog::MonaEventLog()
 {
 
   this->Active = 0;
+  this->EventId = -1;
+  this->StartTime = 0;
 
 }
 
 void MonaEventLog::InitializeLogging()
 {
-  MPE_Init_log();
+  MonaEventLog::InitializeLogging(vtkMultiProcessController::GetGlobalController());
+}
+
+//----------------------------------------------------------------------------
+// Process 0 answers MONA_EVENT_LOG_CLOCK_ROUNDS pings of every other process
+// with its clock and its origin. Each process estimates the offset of its
+// clock as (root time) - (middle of the round trip).
+void MonaEventLog::InitializeLogging(vtkMultiProcessController* controller)
+{
+  MonaEventLog::Controller = controller;
+  MonaTrace::SetEnabled(true);
+  if (!controller || controller->GetNumberOfProcesses() <= 1)
+  {
+    MonaTrace::SetClock(0, MonaTrace::GetOrigin() ? MonaTrace::GetOrigin() : MonaTrace::Now());
+    return;
+  }
+
+  int numProcs = controller->GetNumberOfProcesses();
+  if (controller->GetLocalProcessId() == 0)
+  {
+    // keep the time axis of a previous initialization
+    long long reply[2] = { 0, static_cast<long long>(MonaTrace::GetOrigin()) };
+    if (!reply[1])
+    {
+      reply[1] = static_cast<long long>(MonaTrace::Now());
+    }
+    MonaTrace::SetClock(0, reply[1]);
+    for (int i = 1; i < numProcs; i++)
+    {
+      for (int round = 0; round < MONA_EVENT_LOG_CLOCK_ROUNDS; round++)
+      {
+        long long ping;
+        controller->Receive(&ping, 1, i, CLOCK_TAG);
+        reply[0] = static_cast<long long>(MonaTrace::Now());
+        controller->Send(reply, 2, i, CLOCK_TAG);
+      }
+    }
+    return;
+  }
+
+  long long best = std::numeric_limits<long long>::max();
+  long long offset = 0;
+  long long origin = 0;
+  for (int round = 0; round < MONA_EVENT_LOG_CLOCK_ROUNDS; round++)
+  {
+    long long reply[2];
+    long long start = static_cast<long long>(MonaTrace::Now());
+    controller->Send(&start, 1, 0, CLOCK_TAG);
+    controller->Receive(reply, 2, 0, CLOCK_TAG);
+    long long end = static_cast<long long>(MonaTrace::Now());
+    if (end - start < best)
+    {
+      best = end - start;
+      offset = reply[0] - (start + (end - start) / 2);
+      origin = reply[1];
+    }
+  }
+  MonaTrace::SetClock(offset, origin);
 }
 
 void MonaEventLog::FinalizeLogging(const char* fname)
 {
-  MPE_Finish_log(const_cast<char*>(fname));
+  MonaEventLog::FinalizeLogging(fname,
+    MonaEventLog::Controller ? MonaEventLog::Controller
+                             : vtkMultiProcessController::GetGlobalController());
 }
 
-int MonaEventLog::SetDescription(const char* name, const char* desc)
+//----------------------------------------------------------------------------
+// Every process serializes its events, process 0 receives them in rank
+// order and writes them after its own.
+void MonaEventLog::FinalizeLogging(const char* fname, vtkMultiProcessController* controller)
 {
-  int err, processId;
-  if ( (err = MPI_Comm_rank(MPI_COMM_WORLD,&processId))
-       != MPI_SUCCESS)
+  int processId = controller ? controller->GetLocalProcessId() : 0;
+  int numProcs = controller ? controller->GetNumberOfProcesses() : 1;
+
+  bool enabled = MonaTrace::GetEnabled();
+  MonaTrace::SetEnabled(false);
+  std::ostringstream events;
+  MonaTrace::WriteEvents(events, processId);
+  MonaTrace::Clear();
+  MonaTrace::SetEnabled(enabled);
+
+  std::string local = events.str();
+  if (processId != 0)
   {
-    char *msg = MonaController::ErrorString(err);
-    vtkErrorMacro("MPI error occurred: " << msg);
-    delete[] msg;
-    return 0;
+    vtkIdType length = static_cast<vtkIdType>(local.size());
+    controller->Send(&length, 1, 0, EVENTS_TAG);
+    controller->Send(local.data(), length, 0, EVENTS_TAG);
+    return;
   }
 
-  this->Active = 1;
-  if (processId == 0)
+  std::ofstream file(fname);
+  file << "{\"traceEvents\": [\n" << local;
+  std::vector<char> remote;
+  for (int i = 1; i < numProcs; i++)
+  {
+    vtkIdType length = 0;
+    controller->Receive(&length, 1, i, EVENTS_TAG);
+    remote.resize(length);
+    controller->Receive(remote.data(), length, i, EVENTS_TAG);
+    file << ",\n";
+    file.write(remote.data(), length);
+  }
+  file << "\n], \"displayTimeUnit\": \"ns\"}\n";
+  if (!file)
   {
-    this->BeginId = MPE_Log_get_event_number();
-    this->EndId = MPE_Log_get_event_number();
-    MPE_Describe_state(this->BeginId, this->EndId, const_cast<char*>(name),
-                       const_cast<char*>(desc));
+    vtkGenericWarningMacro("Could not write the event log to " << fname);
   }
-  MPI_Bcast(&this->BeginId, 1, MPI_INT, 0, MPI_COMM_WORLD);
-  MPI_Bcast(&this->EndId, 1, MPI_INT, 0, MPI_COMM_WORLD);
+}
 
+int MonaEventLog::SetDescription(const char* name, const char* desc)
+{
+  this->Active = 1;
+  this->EventId = MonaTrace::RegisterEvent(name, desc ? desc : "mona-vtk");
   return 1;
 }
 
@@ -79,7 +174,7 @@ void MonaEventLog::StartLogging()
     return;
   }
 
-  MPE_Log_event(this->BeginId, 0, "begin");
+  this->StartTime = MonaTrace::Begin();
 }
 
 void MonaEventLog::StopLogging()
@@ -89,10 +184,10 @@ void MonaEventLog::StopLogging()
     vtkWarningMacro("This MonaEventLog has not been initialized. Can not log event.");
     return;
   }
-  MPE_Log_event(this->EndId, 0, "end");
+  MonaTrace::End(this->EventId, this->StartTime);
+  this->StartTime = 0;
 }
 
 MonaEventLog::~MonaEventLog()
 {
 }
-
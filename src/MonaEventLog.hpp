@@ -17,14 +17,19 @@
  * @brief   Class for logging and timing.
  *
  *
- * This class is wrapper around MPE event logging functions
- * (available from Argonne National Lab/Missippi State
- * University). It allows users to create events with names
- * and log them. Different log file formats can be generated
- * by changing MPE's configuration. Some of these formats are
- * binary (for examples SLOG and CLOG) and can be analyzed with
- * viewers from ANL. ALOG is particularly useful since it is
- * text based and can be processed with simple scripts.
+ * This class is a wrapper around the MonaTrace in-memory tracer. It allows
+ * users to create events with names and log them. Each event is recorded
+ * when it stops, with its start time and duration in nanoseconds, into
+ * per-thread ring buffers without any communication or lock, so they can be
+ * left in production code. Nothing is recorded before InitializeLogging, unless MONA_VTK_TRACE
+ * is set. FinalizeLogging gathers the events of all the processes of a
+ * controller into a single Chrome trace JSON file (open it with
+ * chrome://tracing or https://ui.perfetto.dev), one row per process and
+ * thread, with the clocks of all the processes aligned on the clock of
+ * process 0 by InitializeLogging.
+ *
+ * Events can also be recorded without a MonaEventLog object with
+ * MonaTrace::RegisterEvent and MonaTrace::Scope.
  *
  * @sa
  * vtkTimerLog MonaController MonaCommunicator
@@ -33,41 +38,44 @@
 #ifndef MonaEventLog_h
 #define MonaEventLog_h
 
-#include "vtkParallelMPIModule.h" // For export macro
-#include "vtkObject.h"
+#include <vtkObject.h>
+
+class vtkMultiProcessController;
 
-class VTKPARALLELMPI_EXPORT MonaEventLog : public vtkObject
+class MonaEventLog : public vtkObject
 {
 public:
   vtkTypeMacro(MonaEventLog,vtkObject);
 
   /**
-   * Construct a MonaEventLog with the following initial state:
-   * Processes = 0, MaximumNumberOfProcesses = 0.
+   * Construct a MonaEventLog that cannot log events until SetDescription
+   * is called.
    */
   static MonaEventLog* New();
 
   /**
-   * Used to initialize the underlying mpe event.
-   * HAS TO BE CALLED BY ALL PROCESSES before any event
-   * logging is done.
-   * It takes a name and a description for the graphical
-   * representation, for example, "red:vlines3". See
-   * mpe documentation for details.
-   * Returns 0 on MPI failure (or aborts depending on
-   * MPI error handlers)
+   * Name the event logged by this object. desc is used as the category of
+   * the event in the trace. Unlike the MPE version this is local, it does
+   * not need to be called by all processes. Returns 1.
    */
   int SetDescription(const char* name, const char* desc);
 
   //@{
   /**
-   * These methods have to be called once on all processors
-   * before and after invoking any logging events.
-   * The name of the logfile is given by fileName.
-   * See mpe documentation for file formats.
+   * InitializeLogging turns recording on and aligns the clock of each
+   * process of the controller (the global controller by default) with the
+   * clock of process 0. It is a collective operation. It can be called again when the processes
+   * change (e.g. after a MoNA group is resized), the events already
+   * recorded are kept.
+   * FinalizeLogging gathers the events of all the processes of the
+   * controller (the one given to InitializeLogging by default) and process
+   * 0 writes them to fileName. It is a collective operation. The events
+   * are then dropped, so it can be called again later to write a new file.
    */
   static void InitializeLogging();
+  static void InitializeLogging(vtkMultiProcessController* controller);
   static void FinalizeLogging(const char* fileName);
+  static void FinalizeLogging(const char* fileName, vtkMultiProcessController* controller);
   //@}
 
   //@{
@@ -80,22 +88,25 @@ public:
 
   void PrintSelf(ostream& os, vtkIndent indent) override;
 
+  enum Tags
+  {
+    CLOCK_TAG = 68101,
+    EVENTS_TAG = 68102
+  };
+
 protected:
 
   MonaEventLog();
   ~MonaEventLog();
 
-  static int LastEventId;
+  static vtkMultiProcessController* Controller;
   int Active;
-  int BeginId;
-  int EndId;
+  int EventId;
+  // start of the event being logged, see MonaTrace::Begin
+  vtkTypeUInt64 StartTime;
 private:
   MonaEventLog(const MonaEventLog&) = delete;
   void operator=(const MonaEventLog&) = delete;
 };
 
 #endif
-
-
-
-
@@ -0,0 +1,241 @@
+#include "MonaMetrics.hpp"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> MonaMetrics::Enabled(true);
+
+//----------------------------------------------------------------------------
+// Counters updated by Record, the per-operation ones without any lock.
+struct MonaMetricsAtomicCounters
+{
+  std::atomic<uint64_t> Calls;
+  std::atomic<uint64_t> Bytes;
+  std::atomic<uint64_t> Nanoseconds;
+  std::atomic<uint64_t> Histogram[MonaMetrics::NumberOfBuckets];
+};
+
+static MonaMetricsAtomicCounters MonaMetricsOperations[MonaMetrics::NUMBER_OF_OPERATIONS];
+
+// The per-tag counters are sharded per thread: each thread updates its own
+// map, whose lock is only contended while GetTagCounters or Reset read it.
+struct MonaMetricsTagShard
+{
+  std::mutex Mutex;
+  std::map<int, std::map<int, MonaMetrics::Counters> > Tags;
+};
+
+static std::mutex MonaMetricsShardMutex;
+static std::vector<std::unique_ptr<MonaMetricsTagShard> > MonaMetricsShards;
+
+static const char* MonaMetricsOperationNames[MonaMetrics::NUMBER_OF_OPERATIONS] = { "send",
+  "receive", "broadcast", "gather", "scatter", "all_gather", "reduce", "all_reduce", "barrier", "all_to_all" };
+
+//----------------------------------------------------------------------------
+static int MonaMetricsGetBucket(uint64_t nanoseconds)
+{
+  uint64_t microseconds = nanoseconds / 1000;
+  int bucket = 0;
+  while (microseconds && bucket < MonaMetrics::NumberOfBuckets - 1)
+  {
+    microseconds >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+//----------------------------------------------------------------------------
+static MonaMetricsTagShard& MonaMetricsGetShard()
+{
+  thread_local MonaMetricsTagShard* shard = nullptr;
+  if (!shard)
+  {
+    std::lock_guard<std::mutex> lock(MonaMetricsShardMutex);
+    MonaMetricsShards.emplace_back(new MonaMetricsTagShard);
+    shard = MonaMetricsShards.back().get();
+  }
+  return *shard;
+}
+
+//----------------------------------------------------------------------------
+void MonaMetrics::Record(Operation op, int tag, uint64_t bytes, uint64_t nanoseconds)
+{
+  if (op < 0 || op >= NUMBER_OF_OPERATIONS || !MonaMetrics::GetEnabled())
+  {
+    return;
+  }
+  int bucket = MonaMetricsGetBucket(nanoseconds);
+  MonaMetricsAtomicCounters& counters = MonaMetricsOperations[op];
+  counters.Calls.fetch_add(1, std::memory_order_relaxed);
+  counters.Bytes.fetch_add(bytes, std::memory_order_relaxed);
+  counters.Nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+  counters.Histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+  if (op == SEND || op == RECEIVE)
+  {
+    MonaMetricsTagShard& shard = MonaMetricsGetShard();
+    std::lock_guard<std::mutex> lock(shard.Mutex);
+    Counters& tagCounters = shard.Tags[tag][op];
+    tagCounters.Calls++;
+    tagCounters.Bytes += bytes;
+    tagCounters.Nanoseconds += nanoseconds;
+    tagCounters.Histogram[bucket]++;
+  }
+}
+
+//----------------------------------------------------------------------------
+MonaMetrics::Counters MonaMetrics::GetCounters(Operation op)
+{
+  Counters counters;
+  if (op < 0 || op >= NUMBER_OF_OPERATIONS)
+  {
+    return counters;
+  }
+  const MonaMetricsAtomicCounters& source = MonaMetricsOperations[op];
+  counters.Calls = source.Calls.load(std::memory_order_relaxed);
+  counters.Bytes = source.Bytes.load(std::memory_order_relaxed);
+  counters.Nanoseconds = source.Nanoseconds.load(std::memory_order_relaxed);
+  for (int i = 0; i < NumberOfBuckets; i++)
+  {
+    counters.Histogram[i] = source.Histogram[i].load(std::memory_order_relaxed);
+  }
+  return counters;
+}
+
+//----------------------------------------------------------------------------
+std::map<int, std::map<int, MonaMetrics::Counters> > MonaMetrics::GetTagCounters()
+{
+  std::map<int, std::map<int, Counters> > tags;
+  std::lock_guard<std::mutex> lock(MonaMetricsShardMutex);
+  for (const std::unique_ptr<MonaMetricsTagShard>& shard : MonaMetricsShards)
+  {
+    std::lock_guard<std::mutex> shardLock(shard->Mutex);
+    for (const auto& tag : shard->Tags)
+    {
+      for (const auto& op : tag.second)
+      {
+        Counters& counters = tags[tag.first][op.first];
+        counters.Calls += op.second.Calls;
+        counters.Bytes += op.second.Bytes;
+        counters.Nanoseconds += op.second.Nanoseconds;
+        for (int i = 0; i < NumberOfBuckets; i++)
+        {
+          counters.Histogram[i] += op.second.Histogram[i];
+        }
+      }
+    }
+  }
+  return tags;
+}
+
+//----------------------------------------------------------------------------
+const char* MonaMetrics::GetOperationName(Operation op)
+{
+  if (op < 0 || op >= NUMBER_OF_OPERATIONS)
+  {
+    return "unknown";
+  }
+  return MonaMetricsOperationNames[op];
+}
+
+//----------------------------------------------------------------------------
+void MonaMetrics::Reset()
+{
+  for (MonaMetricsAtomicCounters& counters : MonaMetricsOperations)
+  {
+    counters.Calls.store(0, std::memory_order_relaxed);
+    counters.Bytes.store(0, std::memory_order_relaxed);
+    counters.Nanoseconds.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& count : counters.Histogram)
+    {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+  std::lock_guard<std::mutex> lock(MonaMetricsShardMutex);
+  for (const std::unique_ptr<MonaMetricsTagShard>& shard : MonaMetricsShards)
+  {
+    std::lock_guard<std::mutex> shardLock(shard->Mutex);
+    shard->Tags.clear();
+  }
+}
+
+//----------------------------------------------------------------------------
+uint64_t MonaMetrics::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+//----------------------------------------------------------------------------
+void MonaMetrics::SetEnabled(bool enabled)
+{
+  MonaMetrics::Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+bool MonaMetrics::GetEnabled()
+{
+  return MonaMetrics::Enabled.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+static void MonaMetricsWriteCounters(std::ostream& os, const MonaMetrics::Counters& counters)
+{
+  os << "{\"calls\": " << counters.Calls << ", \"bytes\": " << counters.Bytes
+     << ", \"seconds\": " << counters.Nanoseconds * 1e-9 << ", \"latency_histogram\": [";
+  // trailing empty buckets are left out
+  int last = MonaMetrics::NumberOfBuckets;
+  while (last > 0 && counters.Histogram[last - 1] == 0)
+  {
+    last--;
+  }
+  for (int i = 0; i < last; i++)
+  {
+    os << (i ? ", " : "") << counters.Histogram[i];
+  }
+  os << "]}";
+}
+
+//----------------------------------------------------------------------------
+void MonaMetrics::WriteJSON(std::ostream& os, int rank)
+{
+  os << "{\n  \"rank\": " << rank << ",\n";
+  os << "  \"latency_histogram_bounds_us\": \"bucket i < 2^i\",\n";
+  os << "  \"operations\": {";
+  for (int op = 0; op < NUMBER_OF_OPERATIONS; op++)
+  {
+    os << (op ? ",\n" : "\n") << "    \"" << MonaMetricsOperationNames[op] << "\": ";
+    MonaMetricsWriteCounters(os, MonaMetrics::GetCounters(static_cast<Operation>(op)));
+  }
+  os << "\n  },\n  \"tags\": {";
+  bool first = true;
+  for (const auto& tag : MonaMetrics::GetTagCounters())
+  {
+    os << (first ? "\n" : ",\n") << "    \"" << tag.first << "\": {";
+    first = false;
+    bool firstOp = true;
+    for (const auto& op : tag.second)
+    {
+      os << (firstOp ? "" : ", ") << "\"" << MonaMetricsOperationNames[op.first] << "\": ";
+      firstOp = false;
+      MonaMetricsWriteCounters(os, op.second);
+    }
+    os << "}";
+  }
+  os << "\n  }\n}\n";
+}
+
+//----------------------------------------------------------------------------
+bool MonaMetrics::WriteJSON(const char* fileName, int rank)
+{
+  std::ofstream file(fileName);
+  if (!file)
+  {
+    return false;
+  }
+  MonaMetrics::WriteJSON(file, rank);
+  return static_cast<bool>(file);
+}
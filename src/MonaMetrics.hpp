@@ -0,0 +1,155 @@
+/**
+ * @class   MonaMetrics
+ * @brief   Per-process counters of the MoNA communication.
+ *
+ * MonaMetrics keeps, for each kind of operation done by MonaCommunicator,
+ * the number of calls, the number of bytes moved, the total time spent and
+ * a histogram of the latencies. Point-to-point operations are also counted
+ * per tag. Recording is always compiled in and costs a few relaxed atomic
+ * increments per call (plus an uncontended lock of the per-tag counters of
+ * the calling thread), it can be turned off with SetEnabled(false).
+ *
+ * Nonblocking operations are recorded when they complete, with the time
+ * from the call that started them.
+ *
+ * The counters are process wide: they cover all the communicators of the
+ * process, and the IceT communicator of src/icet. MonaController gives access to them and writes them as JSON when
+ * it is finalized.
+ *
+ * @sa
+ * MonaController MonaCommunicator
+ */
+
+#ifndef MonaMetrics_h
+#define MonaMetrics_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+class MonaMetrics
+{
+public:
+  enum Operation
+  {
+    SEND = 0,
+    RECEIVE,
+    BROADCAST,
+    GATHER,
+    SCATTER,
+    ALL_GATHER,
+    REDUCE,
+    ALL_REDUCE,
+    BARRIER,
+    ALL_TO_ALL,
+    NUMBER_OF_OPERATIONS
+  };
+
+  // Bucket i of the latency histograms counts the calls that took less than
+  // 2^i microseconds (and at least 2^(i-1) for i > 0), the last bucket
+  // counts everything slower.
+  static const int NumberOfBuckets = 32;
+
+  struct Counters
+  {
+    uint64_t Calls = 0;
+    uint64_t Bytes = 0;
+    uint64_t Nanoseconds = 0;
+    uint64_t Histogram[NumberOfBuckets] = {};
+  };
+
+  /**
+   * Record a call to op that moved bytes in the given time. tag is only
+   * used for SEND and RECEIVE.
+   */
+  static void Record(Operation op, int tag, uint64_t bytes, uint64_t nanoseconds);
+
+  /**
+   * Steady clock in nanoseconds, for the operations timed across calls.
+   */
+  static uint64_t Now();
+
+  //@{
+  /**
+   * Snapshot of the counters of one operation, or of the point-to-point
+   * operations on each tag (keyed by tag, then operation).
+   */
+  static Counters GetCounters(Operation op);
+  static std::map<int, std::map<int, Counters> > GetTagCounters();
+  //@}
+
+  static const char* GetOperationName(Operation op);
+
+  /**
+   * Set all the counters back to zero.
+   */
+  static void Reset();
+
+  //@{
+  /**
+   * Turn recording on (the default) or off.
+   */
+  static void SetEnabled(bool enabled);
+  static bool GetEnabled();
+  //@}
+
+  //@{
+  /**
+   * Write the counters of this process as a JSON object, rank is only used
+   * to label it. WriteJSON with a file name returns false when the file
+   * cannot be written.
+   */
+  static void WriteJSON(std::ostream& os, int rank);
+  static bool WriteJSON(const char* fileName, int rank);
+  //@}
+
+  /**
+   * Times the scope it lives in and records it when it goes out of scope.
+   * Bytes can be set later, once they are known.
+   */
+  class Scope
+  {
+  public:
+    Scope(Operation op, int tag = -1, uint64_t bytes = 0)
+      : Op(op)
+      , Tag(tag)
+      , Bytes(bytes)
+      , Active(MonaMetrics::GetEnabled())
+    {
+      if (this->Active)
+      {
+        this->Start = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~Scope()
+    {
+      if (this->Active)
+      {
+        auto elapsed = std::chrono::steady_clock::now() - this->Start;
+        MonaMetrics::Record(this->Op, this->Tag, this->Bytes,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      }
+    }
+
+    void SetBytes(uint64_t bytes) { this->Bytes = bytes; }
+
+  private:
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+
+    Operation Op;
+    int Tag;
+    uint64_t Bytes;
+    bool Active;
+    std::chrono::steady_clock::time_point Start;
+  };
+
+private:
+  static std::atomic<bool> Enabled;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef MonaTags_h
+#define MonaTags_h
+
+#include <mona.h>
+#include <mona-coll.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace MonaTags
+{
+
+// Description:
+// Collective operations on a mona_comm_t are matched by tag only, so two
+// collectives of the same kind in flight on one communicator would
+// cross-match if they used a fixed tag. Instead each collective takes the
+// next tag of a per-communicator sequence:
+//
+//   bit  30      always set, marks a collective tag (point-to-point user
+//                tags are limited to bits 0..23 and MonaCommunicator
+//                rejects any other)
+//   bits 28..29  space, so that independent layers sharing a handle
+//                (MonaCommunicator, the IceT bridge, the application)
+//                never draw the same tag
+//   bits 20..27  epoch, see NextEpoch()
+//   bits 0..19   sequence number within the epoch
+//
+// Every member of the communicator must draw its tags in the same order,
+// which is the usual rule for issuing collectives. Collectives started from
+// different ULTs may then overlap, as long as the tags are drawn in the
+// same order everywhere (e.g. before spawning the ULTs).
+enum Space
+{
+  Communicator = 0,
+  IceT = 1,
+  Application = 2
+};
+
+const na_tag_t CollectiveFlag = 0x40000000u;
+const int SpaceShift = 28;
+const int EpochShift = 20;
+const uint32_t EpochMask = 0xffu;
+const uint32_t SequenceMask = 0xfffffu;
+
+struct State
+{
+  uint32_t Epoch = 0;
+  uint32_t Sequence = 0;
+};
+
+typedef std::pair<mona_comm_t, int> Key;
+
+inline std::mutex& GetMutex()
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+inline std::map<Key, State>& GetStates()
+{
+  static std::map<Key, State> states;
+  return states;
+}
+
+// Description:
+// Tag for the next collective issued in the given space on comm.
+inline na_tag_t NextCollectiveTag(mona_comm_t comm, Space space)
+{
+  std::lock_guard<std::mutex> lock(GetMutex());
+  State& state = GetStates()[Key(comm, space)];
+  na_tag_t tag = CollectiveFlag | (static_cast<na_tag_t>(space) << SpaceShift) |
+    ((state.Epoch & EpochMask) << EpochShift) | (state.Sequence & SequenceMask);
+  state.Sequence = (state.Sequence + 1) & SequenceMask;
+  return tag;
+}
+
+// Description:
+// Start a new epoch for the given space on comm: sequence numbers restart
+// at 0 under a new epoch number. Calling it at a phase boundary (e.g. every
+// time step) keeps a mismatch in one phase from leaking into the next.
+// NOTE: like the collectives themselves, all members must call it.
+inline void NextEpoch(mona_comm_t comm, Space space)
+{
+  std::lock_guard<std::mutex> lock(GetMutex());
+  State& state = GetStates()[Key(comm, space)];
+  state.Epoch = (state.Epoch + 1) & EpochMask;
+  state.Sequence = 0;
+}
+
+// Description:
+// Forget the sequences kept for comm, to be called before it is freed.
+inline void Release(mona_comm_t comm)
+{
+  std::lock_guard<std::mutex> lock(GetMutex());
+  std::map<Key, State>& states = GetStates();
+  states.erase(states.lower_bound(Key(comm, 0)), states.upper_bound(Key(comm, Application)));
+}
+
+} // END namespace MonaTags
+
+#endif // MonaTags_h
@@ -0,0 +1,288 @@
+#ifndef MonaTrace_h
+#define MonaTrace_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace MonaTrace
+{
+
+// Description:
+// In-memory event tracer. Begin/End record a timestamped event into a ring
+// buffer owned by the calling thread: no lock and no allocation, only a
+// clock read and a few stores. When a buffer is full the oldest events are
+// overwritten. The buffers are written as Chrome trace (Perfetto) JSON
+// events, MonaEventLog gathers them from all the ranks into one file on a
+// shared time axis.
+//
+// It is header-only so that the IceT bridge can record its events into the
+// same buffers as mona-vtk.
+//
+// Recording is off until MonaEventLog::InitializeLogging (or SetEnabled)
+// turns it on, or from the start when MONA_VTK_TRACE is set, so that a
+// process that is not traced does not allocate buffers it never writes.
+//
+// Events are recorded whole when they end, as a start time and a duration
+// (Chrome "X" events). ULTs sharing an execution stream, and thus a buffer,
+// may yield inside an event (e.g. in mona_wait) and end their events in any
+// order: each event still gets its own start and duration, the events of
+// such ULTs just overlap on the row of the stream.
+struct Event
+{
+  uint64_t Time;
+  uint64_t Duration;
+  uint32_t Id;
+};
+
+const size_t DefaultBufferSize = 1 << 16;
+
+struct Buffer
+{
+  Buffer(size_t size, int thread)
+    : Events(size)
+    , Mask(size - 1)
+    , Head(0)
+    , Thread(thread)
+  {
+  }
+
+  std::vector<Event> Events;
+  uint64_t Mask;
+  std::atomic<uint64_t> Head;
+  int Thread;
+};
+
+// MONA_VTK_TRACE names the file the trace of a run is written to
+inline bool IsTraceRequested()
+{
+  const char* traceFile = getenv("MONA_VTK_TRACE");
+  return traceFile && *traceFile;
+}
+
+struct Registry
+{
+  std::mutex Mutex;
+  std::vector<std::string> Names;
+  std::vector<std::string> Categories;
+  std::vector<std::unique_ptr<Buffer> > Buffers;
+  std::atomic<bool> Enabled{ IsTraceRequested() };
+  size_t BufferSize = DefaultBufferSize;
+  // local time + ClockOffset is the time of the reference clock, Origin is
+  // the time of the reference clock that is written as 0
+  int64_t ClockOffset = 0;
+  uint64_t Origin = 0;
+};
+
+inline Registry& GetRegistry()
+{
+  static Registry registry;
+  return registry;
+}
+
+// Description:
+// Current time of the local clock in nanoseconds.
+inline uint64_t Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// Description:
+// Id of the event with the given name and category, created on first use.
+// Registration takes a lock, it is meant to be done once per event (e.g.
+// in a function-local static), not for each Begin/End.
+inline int RegisterEvent(const char* name, const char* category = "mona-vtk")
+{
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  for (size_t i = 0; i < registry.Names.size(); i++)
+  {
+    if (registry.Names[i] == name && registry.Categories[i] == category)
+    {
+      return static_cast<int>(i);
+    }
+  }
+  registry.Names.push_back(name);
+  registry.Categories.push_back(category);
+  return static_cast<int>(registry.Names.size() - 1);
+}
+
+inline Buffer& GetThreadBuffer()
+{
+  thread_local Buffer* buffer = nullptr;
+  if (!buffer)
+  {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.Mutex);
+    registry.Buffers.emplace_back(
+      new Buffer(registry.BufferSize, static_cast<int>(registry.Buffers.size())));
+    buffer = registry.Buffers.back().get();
+  }
+  return *buffer;
+}
+
+inline void Record(int id, uint64_t start, uint64_t end)
+{
+  Buffer& buffer = GetThreadBuffer();
+  uint64_t head = buffer.Head.load(std::memory_order_relaxed);
+  Event& event = buffer.Events[head & buffer.Mask];
+  event.Time = start;
+  event.Duration = end - start;
+  event.Id = static_cast<uint32_t>(id);
+  buffer.Head.store(head + 1, std::memory_order_release);
+}
+
+inline bool GetEnabled()
+{
+  return GetRegistry().Enabled.load(std::memory_order_relaxed);
+}
+
+// Description:
+// Turn recording on or off.
+inline void SetEnabled(bool enabled)
+{
+  GetRegistry().Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// Description:
+// Start and stop an event registered with RegisterEvent. Begin returns the
+// start time to hand to End, 0 when recording is off (End then records
+// nothing). End may be called from another thread than Begin.
+inline uint64_t Begin()
+{
+  return GetEnabled() ? Now() : 0;
+}
+
+inline void End(int id, uint64_t start)
+{
+  if (start != 0 && GetEnabled())
+  {
+    Record(id, start, Now());
+  }
+}
+
+// Description:
+// Records the event for the lifetime of the scope.
+class Scope
+{
+public:
+  explicit Scope(int id)
+    : Id(id)
+    , Start(Begin())
+  {
+  }
+
+  ~Scope() { End(this->Id, this->Start); }
+
+private:
+  Scope(const Scope&) = delete;
+  void operator=(const Scope&) = delete;
+
+  int Id;
+  uint64_t Start;
+};
+
+// Description:
+// Number of events kept per thread, rounded up to a power of 2. Only the
+// threads that have not recorded anything yet are affected.
+inline void SetBufferSize(size_t size)
+{
+  size_t rounded = 1;
+  while (rounded < size)
+  {
+    rounded <<= 1;
+  }
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  registry.BufferSize = rounded;
+}
+
+// Description:
+// Map the local clock onto the reference clock, see Registry.
+inline void SetClock(int64_t offset, uint64_t origin)
+{
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  registry.ClockOffset = offset;
+  registry.Origin = origin;
+}
+
+inline uint64_t GetOrigin()
+{
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  return registry.Origin;
+}
+
+// Description:
+// Write the recorded events as Chrome trace events (comma separated, no
+// enclosing array) with the given pid, and return the number written.
+// NOTE: the events recorded while this runs may or may not be written,
+// recording should be turned off first for a consistent snapshot.
+inline size_t WriteEvents(std::ostream& os, int pid)
+{
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  size_t count = 0;
+  os << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+     << ", \"args\": {\"name\": \"rank " << pid << "\"}}";
+  count++;
+  for (const std::unique_ptr<Buffer>& buffer : registry.Buffers)
+  {
+    uint64_t head = buffer->Head.load(std::memory_order_acquire);
+    uint64_t size = buffer->Mask + 1;
+    uint64_t first = head > size ? head - size : 0;
+    for (uint64_t i = first; i < head; i++)
+    {
+      const Event& event = buffer->Events[i & buffer->Mask];
+      // Chrome traces are in microseconds
+      char timestamp[32], duration[32];
+      snprintf(timestamp, sizeof(timestamp), "%.3f",
+        (static_cast<int64_t>(event.Time) + registry.ClockOffset -
+          static_cast<int64_t>(registry.Origin)) *
+          1e-3);
+      snprintf(duration, sizeof(duration), "%.3f", event.Duration * 1e-3);
+      os << ",\n{\"name\": \"" << registry.Names[event.Id] << "\", \"cat\": \""
+         << registry.Categories[event.Id] << "\", \"ph\": \"X\", \"ts\": " << timestamp
+         << ", \"dur\": " << duration << ", \"pid\": " << pid
+         << ", \"tid\": " << buffer->Thread << "}";
+      count++;
+    }
+  }
+  return count;
+}
+
+// Description:
+// Write the events of this process alone as a Chrome trace JSON document.
+inline void WriteJSON(std::ostream& os, int pid)
+{
+  os << "{\"traceEvents\": [\n";
+  WriteEvents(os, pid);
+  os << "\n], \"displayTimeUnit\": \"ns\"}\n";
+}
+
+// Description:
+// Drop all the recorded events (the registered events are kept).
+// NOTE: must not race with End, turn recording off first.
+inline void Clear()
+{
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  for (const std::unique_ptr<Buffer>& buffer : registry.Buffers)
+  {
+    buffer->Head.store(0, std::memory_order_release);
+  }
+}
+
+} // END namespace MonaTrace
+
+#endif // MonaTrace_h
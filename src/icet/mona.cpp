@@ -1,6 +1,11 @@
 #include <IceT.h>
 #include <IceTDevDiagnostics.h>
+#include <IceTDevState.h>
+#include <algorithm>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
 #include <mona-coll.h>
 #include <mona.h>
 #include <stdexcept>
@@ -8,11 +13,30 @@
 #include <string.h>
 #include <vector>
 
-#define ICET_MONA_BARRIER_TAG 11111
-#define ICET_MONA_GATHER_TAG 22222
-#define ICET_MONA_GATHERV_TAG 33333
-#define ICET_MONA_ALLGATHER_TAG 44444
-#define ICET_MONA_ALLTOALL_TAG 55555
+#include "../MonaMetrics.hpp"
+#include "../MonaTags.hpp"
+#include "../MonaTrace.hpp"
+#include "mona.hpp"
+
+// collectives draw their tags from the IceT space of the communicator's tag
+// sequence, so they never cross-match each other or MonaCommunicator's
+#define ICET_MONA_COLLECTIVE_TAG(comm) MonaTags::NextCollectiveTag(comm, MonaTags::IceT)
+
+// time spent in the blocking calls goes on the MonaEventLog timeline, which
+// shows the compositing phases of IceT
+#define ICET_MONA_TRACE(name)                                                                      \
+  static const int traceEvent = MonaTrace::RegisterEvent(name, "icet");                            \
+  MonaTrace::Scope traceScope(traceEvent)
+
+// registration cache of icetCreateMonaCommunicator(comm, mona): how many
+// buffers keep their mona memory handle (0 turns the cache off), and the
+// smallest message worth it (smaller ones are sent eagerly by MoNA anyway)
+#ifndef ICET_MONA_REGISTRATION_CACHE_SIZE
+#define ICET_MONA_REGISTRATION_CACHE_SIZE 16
+#endif
+#ifndef ICET_MONA_REGISTRATION_MIN_SIZE
+#define ICET_MONA_REGISTRATION_MIN_SIZE (64 * 1024)
+#endif
 
 #define ICET_MONA_REQUEST_MAGIC_NUMBER ((IceTEnum)0x636f6c7a)
 
@@ -20,6 +44,21 @@
 
 #define ICET_IN_PLACE_COLLECT ((void*)(-1))
 
+// algorithm selection of Allgather and Alltoall (sizes are per rank, in
+// bytes): below the thresholds, recursive doubling allgather (power of two
+// rank counts only) and Bruck alltoall take log2(p) steps, above them ring
+// allgather and pairwise alltoall send each byte once. Alltoall with fewer
+// than ICET_MONA_ALLTOALL_MIN_RANKS ranks is left to MoNA.
+#ifndef ICET_MONA_ALLGATHER_RING_THRESHOLD
+#define ICET_MONA_ALLGATHER_RING_THRESHOLD (64 * 1024)
+#endif
+#ifndef ICET_MONA_ALLTOALL_BRUCK_THRESHOLD
+#define ICET_MONA_ALLTOALL_BRUCK_THRESHOLD 1024
+#endif
+#ifndef ICET_MONA_ALLTOALL_MIN_RANKS
+#define ICET_MONA_ALLTOALL_MIN_RANKS 8
+#endif
+
 static IceTCommunicator MonaDuplicate(IceTCommunicator self);
 static IceTCommunicator MonaSubset(IceTCommunicator self, int count, const IceTInt32* ranks);
 static void MonaDestroy(IceTCommunicator self);
@@ -48,11 +87,85 @@ static int MonaWaitany(IceTCommunicator self, int count, IceTCommRequest* array_
 static int MonaComm_size(IceTCommunicator self);
 static int MonaComm_rank(IceTCommunicator self);
 
+// a registered IceT state buffer, in use while requests on it are in flight.
+// IceT frees and reallocates a state buffer when it needs a larger one, which
+// gives the buffer a new time stamp: the registration only stands for the
+// buffer while the state variable still has the address and time stamp it had
+// when it was registered.
+struct IceTMonaRegistration
+{
+  char* begin;
+  size_t size;
+  na_mem_handle_t handle;
+  int in_flight;
+  IceTContext context;
+  IceTEnum pname;
+  IceTTimeStamp time;
+};
+
+// registrations shared by a communicator and those made from it by
+// Duplicate/Subset, most recently used first
+struct IceTMonaRegistrationCache
+{
+  mona_instance_t mona;
+  std::list<IceTMonaRegistration> entries;
+
+  ~IceTMonaRegistrationCache()
+  {
+    for (IceTMonaRegistration& entry : this->entries)
+    {
+      mona_mem_deregister(this->mona, entry.handle);
+      mona_mem_handle_free(this->mona, entry.handle);
+    }
+  }
+};
+
 typedef struct IceTMonaCommRequestInternalsStruct
 {
   mona_request_t request;
+  // registration the request sends from or receives into, if any
+  IceTMonaRegistration* registration;
+  // MonaMetrics operation recorded when the request is waited for (-1 for
+  // none), with its tag, size and start time
+  int metrics_operation = -1;
+  int metrics_tag;
+  uint64_t metrics_bytes;
+  uint64_t metrics_start;
 } * IceTMonaCommRequestInternals;
 
+// what an IceTCommunicator points to: the MoNA communicator plus what is
+// reused from call to call, so that compositing a frame does not allocate
+// once the first frame has sized everything
+typedef struct IceTMonaCommunicatorDataStruct
+{
+  mona_comm_t comm;
+  // requests released by Wait/Waitany, handed out again by Isend/Irecv
+  std::vector<IceTCommRequest> free_requests;
+  // scratch arrays of Waitany, Gatherv and Subset (the key of the group)
+  std::vector<mona_request_t> waitany_requests;
+  std::vector<IceTInt32> subset_key;
+  std::vector<size_t> gatherv_sizes;
+  std::vector<size_t> gatherv_offsets;
+  // staging of the Bruck alltoall
+  std::vector<char> collective_scratch;
+  // communicators made by Subset, keyed by their list of ranks, and by
+  // Duplicate, handed out again when IceT asks for the same group, e.g. on
+  // the next frame. Duplicates are kept apart: IceT makes one per context and
+  // destroying it flushes the registrations, which a subset of all the ranks
+  // must not do.
+  std::map<std::vector<IceTInt32>, std::vector<IceTCommunicator> > subsets;
+  std::vector<IceTCommunicator> duplicates;
+  // communicator whose cache holds this one (nullptr if it is not cached),
+  // and whether IceT currently holds it
+  struct IceTMonaCommunicatorDataStruct* owner;
+  bool in_use;
+  // made by Duplicate, which IceT calls for each context it creates
+  bool duplicate;
+  // memory registrations of the Isend/Irecv/Sendrecv buffers, nullptr when
+  // the communicator was made without the mona instance
+  std::shared_ptr<IceTMonaRegistrationCache> registrations;
+} * IceTMonaCommunicatorData;
+
 static mona_request_t getMonaRequest(IceTCommRequest icet_request)
 {
   if (icet_request == ICET_COMM_REQUEST_NULL)
@@ -84,8 +197,15 @@ static void setMonaRequest(IceTCommRequest icet_request, const mona_request_t mo
   (((IceTMonaCommRequestInternals)icet_request->internals)->request) = mona_request;
 }
 
-static IceTCommRequest create_request(void)
+static IceTCommRequest create_request(IceTMonaCommunicatorData data)
 {
+  if (!data->free_requests.empty())
+  {
+    IceTCommRequest request = data->free_requests.back();
+    data->free_requests.pop_back();
+    return request;
+  }
+
   IceTCommRequest request;
   request = (IceTCommRequest)malloc(sizeof(struct IceTCommRequestStruct));
   if (!request)
@@ -106,14 +226,177 @@ static IceTCommRequest create_request(void)
   return request;
 }
 
+// time a request from Isend/Irecv to the Wait/Waitany that releases it
+static void start_request_metrics(
+  IceTCommRequest request, MonaMetrics::Operation op, int tag, uint64_t bytes)
+{
+  if (!request || !MonaMetrics::GetEnabled())
+  {
+    return;
+  }
+  IceTMonaCommRequestInternals internals = (IceTMonaCommRequestInternals)request->internals;
+  internals->metrics_operation = op;
+  internals->metrics_tag = tag;
+  internals->metrics_bytes = bytes;
+  internals->metrics_start = MonaMetrics::Now();
+}
+
 static void destroy_request(IceTCommRequest request)
 {
-  mona_request_t mona_request = getMonaRequest(request);
   delete (IceTMonaCommRequestInternalsStruct*)(request->internals);
   free(request);
 }
 
+// give a completed request back to the pool of its communicator
+static void release_request(IceTMonaCommunicatorData data, IceTCommRequest request)
+{
+  IceTMonaCommRequestInternals internals = (IceTMonaCommRequestInternals)request->internals;
+  if (internals->registration)
+  {
+    internals->registration->in_flight--;
+    internals->registration = nullptr;
+  }
+  if (internals->metrics_operation >= 0)
+  {
+    MonaMetrics::Record(static_cast<MonaMetrics::Operation>(internals->metrics_operation),
+      internals->metrics_tag, internals->metrics_bytes,
+      MonaMetrics::Now() - internals->metrics_start);
+    internals->metrics_operation = -1;
+  }
+  setMonaRequest(request, MONA_REQUEST_NULL);
+  data->free_requests.push_back(request);
+}
+
+static void free_registration(IceTMonaRegistrationCache* cache,
+  std::list<IceTMonaRegistration>::iterator entry)
+{
+  mona_mem_deregister(cache->mona, entry->handle);
+  mona_mem_handle_free(cache->mona, entry->handle);
+  cache->entries.erase(entry);
+}
+
+// drop the registrations that are not in flight
+static void flush_registrations(IceTMonaRegistrationCache* cache)
+{
+  for (auto it = cache->entries.begin(); it != cache->entries.end();)
+  {
+    auto next = std::next(it);
+    if (it->in_flight == 0)
+    {
+      free_registration(cache, it);
+    }
+    it = next;
+  }
+}
+
+// whether the state buffer of registration is still the one registered, to
+// be checked with the context of the registration current
+static bool registration_is_live(const IceTMonaRegistration& registration)
+{
+  return icetStateGetType(registration.pname) == ICET_VOID &&
+    icetStateGetTime(registration.pname) == registration.time &&
+    (char*)icetUnsafeStateGetBuffer(registration.pname) == registration.begin &&
+    static_cast<size_t>(icetStateGetNumEntries(registration.pname)) == registration.size;
+}
+
+// Registration of the IceT state buffer holding [buf, buf + size), marked in
+// flight, or nullptr when the message goes through the plain mona_comm calls
+// (no cache, small message, not in a state buffer of the current context, or
+// registration failed). The caller decrements in_flight once the message
+// completes. Whole state buffers are registered, so the different parts of an
+// image buffer that IceT sends and receives share one registration. Buffers
+// that are not IceT state (e.g. those of the application) are never cached:
+// nothing tells when they are freed.
+static IceTMonaRegistration* acquire_registration(
+  IceTMonaCommunicatorData data, const void* buf, size_t size)
+{
+  IceTMonaRegistrationCache* cache = data->registrations.get();
+  if (!cache || ICET_MONA_REGISTRATION_CACHE_SIZE <= 0 || size < ICET_MONA_REGISTRATION_MIN_SIZE)
+  {
+    return nullptr;
+  }
+  IceTContext context = icetGetContext();
+  char* begin = (char*)buf;
+  char* end = begin + size;
+  for (auto it = cache->entries.begin(); it != cache->entries.end();)
+  {
+    auto next = std::next(it);
+    if (it->context == context)
+    {
+      if (!registration_is_live(*it))
+      {
+        // reallocated by IceT, the pages it pins may belong to someone else
+        if (it->in_flight == 0)
+        {
+          free_registration(cache, it);
+        }
+      }
+      else if (it->begin <= begin && end <= it->begin + it->size)
+      {
+        cache->entries.splice(cache->entries.begin(), cache->entries, it);
+        it->in_flight++;
+        return &*it;
+      }
+    }
+    it = next;
+  }
+
+  // find the state buffer holding the range
+  IceTEnum pname;
+  for (pname = 0; pname < ICET_STATE_SIZE; pname++)
+  {
+    if (icetStateGetType(pname) != ICET_VOID)
+    {
+      continue;
+    }
+    char* state = (char*)icetUnsafeStateGetBuffer(pname);
+    if (state && state <= begin && end <= state + icetStateGetNumEntries(pname))
+    {
+      begin = state;
+      end = state + icetStateGetNumEntries(pname);
+      break;
+    }
+  }
+  if (pname == ICET_STATE_SIZE)
+  {
+    return nullptr;
+  }
+
+  na_mem_handle_t handle;
+  if (mona_mem_handle_create(cache->mona, begin, end - begin, NA_MEM_READWRITE, &handle) !=
+    NA_SUCCESS)
+  {
+    return nullptr;
+  }
+  if (mona_mem_register(cache->mona, handle) != NA_SUCCESS)
+  {
+    mona_mem_handle_free(cache->mona, handle);
+    return nullptr;
+  }
+  cache->entries.push_front(IceTMonaRegistration{
+    begin, size_t(end - begin), handle, 1, context, pname, icetStateGetTime(pname) });
+
+  // evict the least recently used registrations that are not in flight
+  auto it = std::prev(cache->entries.end());
+  while (cache->entries.size() > static_cast<size_t>(ICET_MONA_REGISTRATION_CACHE_SIZE) &&
+    it != cache->entries.begin())
+  {
+    auto previous = std::prev(it);
+    if (it->in_flight == 0)
+    {
+      free_registration(cache, it);
+    }
+    it = previous;
+  }
+  return &cache->entries.front();
+}
+
 IceTCommunicator icetCreateMonaCommunicator(const mona_comm_t mona_comm)
+{
+  return icetCreateMonaCommunicator(mona_comm, nullptr);
+}
+
+IceTCommunicator icetCreateMonaCommunicator(const mona_comm_t mona_comm, mona_instance_t mona)
 {
   IceTCommunicator comm;
 
@@ -147,13 +430,17 @@ IceTCommunicator icetCreateMonaCommunicator(const mona_comm_t mona_comm)
   comm->Comm_size = MonaComm_size;
   comm->Comm_rank = MonaComm_rank;
 
-  comm->data = mona_comm;
-  if (!comm->data)
+  IceTMonaCommunicatorData data = new IceTMonaCommunicatorDataStruct();
+  data->comm = mona_comm;
+  data->owner = nullptr;
+  data->in_use = false;
+  data->duplicate = false;
+  if (mona)
   {
-    free(comm);
-    icetRaiseError(ICET_OUT_OF_MEMORY, "Could not allocate memory for IceTCommunicator.");
-    return NULL;
+    data->registrations = std::make_shared<IceTMonaRegistrationCache>();
+    data->registrations->mona = mona;
   }
+  comm->data = data;
   return comm;
 }
 
@@ -165,17 +452,54 @@ void icetDestroyMonaCommunicator(IceTCommunicator comm)
   }
 }
 
-#define MONA_COMM ((mona_comm_t)(self->data))
+#define MONA_DATA ((IceTMonaCommunicatorData)(self->data))
+#define MONA_COMM (MONA_DATA->comm)
+
+// Duplicate and Subset run on all the ranks of the new group in the same
+// order, so the caches of these ranks stay in step and a group found in one
+// of them is found in all. ranks is only used for a subset.
+static IceTCommunicator MonaCachedSubset(
+  IceTCommunicator self, const std::vector<IceTInt32>* ranks, bool duplicate)
+{
+  IceTMonaCommunicatorData data = MONA_DATA;
+  std::vector<IceTCommunicator>& cached = duplicate ? data->duplicates : data->subsets[*ranks];
+  for (IceTCommunicator subset : cached)
+  {
+    IceTMonaCommunicatorData subsetData = (IceTMonaCommunicatorData)(subset->data);
+    if (!subsetData->in_use)
+    {
+      subsetData->in_use = true;
+      return subset;
+    }
+  }
+
+  mona_comm_t subset_comm = nullptr;
+  na_return_t ret = duplicate
+    ? mona_comm_dup(data->comm, &subset_comm)
+    : mona_comm_subset(data->comm, ranks->data(), ranks->size(), &subset_comm);
+  if (ret != NA_SUCCESS)
+  {
+    return ICET_COMM_NULL;
+  }
+  IceTCommunicator subset = icetCreateMonaCommunicator(subset_comm);
+  if (subset != ICET_COMM_NULL)
+  {
+    IceTMonaCommunicatorData subsetData = (IceTMonaCommunicatorData)(subset->data);
+    subsetData->owner = data;
+    subsetData->in_use = true;
+    subsetData->duplicate = duplicate;
+    subsetData->registrations = data->registrations;
+    cached.push_back(subset);
+  }
+  return subset;
+}
 
 static IceTCommunicator MonaDuplicate(IceTCommunicator self)
 {
 
   if (self != ICET_COMM_NULL)
   {
-    auto comm = MONA_COMM;
-    decltype(comm) dup;
-    mona_comm_dup(comm, &dup);
-    return icetCreateMonaCommunicator(dup);
+    return MonaCachedSubset(self, nullptr, true);
   }
   else
   {
@@ -186,27 +510,66 @@ static IceTCommunicator MonaDuplicate(IceTCommunicator self)
 static IceTCommunicator MonaSubset(IceTCommunicator self, int count, const IceTInt32* ranks)
 {
 
-  IceTCommunicator result;
-  auto comm = MONA_COMM;
-  decltype(comm) subset_comm;
-  mona_comm_subset(comm, ranks, count, &subset_comm);
+  // assign reuses the storage of the key, the map only copies it for a group
+  // seen for the first time
+  std::vector<IceTInt32>& key = MONA_DATA->subset_key;
+  key.assign(ranks, ranks + count);
+  return MonaCachedSubset(self, &key, false);
+}
 
-  return icetCreateMonaCommunicator(subset_comm);
+// free the cached communicators that IceT does not hold, and detach the
+// others, which are freed when IceT destroys them
+static void MonaDestroyCached(std::vector<IceTCommunicator>& cached)
+{
+  for (IceTCommunicator subset : cached)
+  {
+    IceTMonaCommunicatorData subsetData = (IceTMonaCommunicatorData)(subset->data);
+    subsetData->owner = nullptr;
+    if (!subsetData->in_use)
+    {
+      MonaDestroy(subset);
+    }
+  }
 }
 
 static void MonaDestroy(IceTCommunicator self)
 {
 
-  auto comm = MONA_COMM;
-  mona_comm_free(comm);
+  IceTMonaCommunicatorData data = MONA_DATA;
+  if (data->duplicate && data->registrations)
+  {
+    // the IceT context is going away with the image buffers that were
+    // registered, the next context may reuse their addresses
+    flush_registrations(data->registrations.get());
+  }
+  if (data->owner)
+  {
+    // back to the cache of the communicator it was made from
+    data->in_use = false;
+    return;
+  }
+  for (auto& entry : data->subsets)
+  {
+    MonaDestroyCached(entry.second);
+  }
+  MonaDestroyCached(data->duplicates);
+  MonaTags::Release(data->comm);
+  mona_comm_free(data->comm);
+  for (IceTCommRequest request : data->free_requests)
+  {
+    destroy_request(request);
+  }
+  delete data;
   free(self);
 }
 
 static void MonaBarrier(IceTCommunicator self)
 {
+  ICET_MONA_TRACE("barrier");
+  MonaMetrics::Scope metrics(MonaMetrics::BARRIER);
 
   auto comm = MONA_COMM;
-  mona_comm_barrier(comm, ICET_MONA_BARRIER_TAG);
+  mona_comm_barrier(comm, ICET_MONA_COLLECTIVE_TAG(comm));
 }
 
 #define GET_DATATYPE_SIZE(icet_type, var)                                                          \
@@ -237,6 +600,64 @@ static void MonaBarrier(IceTCommunicator self)
       break;                                                                                       \
   }
 
+static void release_registration(IceTMonaRegistration* registration)
+{
+  if (registration)
+  {
+    registration->in_flight--;
+  }
+}
+
+// Isend/Irecv from or into the registration of buf when it has one, with
+// mona_isend_mem/mona_irecv_mem to the address of the peer. mona_comm_isend is
+// mona_isend to that address with id 0, so the messages match the plain
+// mona_comm calls on the other side either way.
+static na_return_t MonaIsendBuffer(IceTMonaCommunicatorData data, const void* buf, size_t size,
+  int dest, int tag, mona_request_t* req, IceTMonaRegistration** registration)
+{
+  *registration = acquire_registration(data, buf, size);
+  if (!*registration)
+  {
+    return mona_comm_isend(data->comm, buf, size, dest, tag, req);
+  }
+  na_addr_t addr;
+  na_return_t ret = mona_comm_addr(data->comm, dest, &addr, NA_FALSE);
+  if (ret == NA_SUCCESS)
+  {
+    ret = mona_isend_mem(data->registrations->mona, (*registration)->handle, size,
+      (const char*)buf - (*registration)->begin, addr, 0, tag, req);
+  }
+  if (ret != NA_SUCCESS)
+  {
+    release_registration(*registration);
+    *registration = nullptr;
+  }
+  return ret;
+}
+
+static na_return_t MonaIrecvBuffer(IceTMonaCommunicatorData data, void* buf, size_t size,
+  int src, int tag, mona_request_t* req, IceTMonaRegistration** registration)
+{
+  *registration = acquire_registration(data, buf, size);
+  if (!*registration)
+  {
+    return mona_comm_irecv(data->comm, buf, size, src, tag, NULL, NULL, NULL, req);
+  }
+  na_addr_t addr;
+  na_return_t ret = mona_comm_addr(data->comm, src, &addr, NA_FALSE);
+  if (ret == NA_SUCCESS)
+  {
+    ret = mona_irecv_mem(data->registrations->mona, (*registration)->handle, size,
+      (char*)buf - (*registration)->begin, addr, tag, NULL, NULL, NULL, req);
+  }
+  if (ret != NA_SUCCESS)
+  {
+    release_registration(*registration);
+    *registration = nullptr;
+  }
+  return ret;
+}
+
 static void MonaSend(
   IceTCommunicator self, const void* buf, int count, IceTEnum datatype, int dest, int tag)
 {
@@ -244,13 +665,29 @@ static void MonaSend(
   auto comm = MONA_COMM;
   size_t typesize;
   GET_DATATYPE_SIZE(datatype, typesize);
+  MonaMetrics::Scope metrics(MonaMetrics::SEND, tag, count * typesize);
 
   if (buf == nullptr)
   {
     throw std::runtime_error("send should not be null");
     return;
   }
-  na_return_t ret = mona_comm_send(comm, (void*)buf, count * typesize, dest, tag);
+  na_return_t ret;
+  if (MONA_DATA->registrations)
+  {
+    mona_request_t req;
+    IceTMonaRegistration* registration;
+    ret = MonaIsendBuffer(MONA_DATA, buf, count * typesize, dest, tag, &req, &registration);
+    if (ret == NA_SUCCESS)
+    {
+      ret = mona_wait(req);
+      release_registration(registration);
+    }
+  }
+  else
+  {
+    ret = mona_comm_send(comm, (void*)buf, count * typesize, dest, tag);
+  }
   if (ret != NA_SUCCESS)
   {
     throw std::runtime_error("failed for MonaSend");
@@ -264,13 +701,29 @@ static void MonaRecv(
   auto comm = MONA_COMM;
   size_t typesize;
   GET_DATATYPE_SIZE(datatype, typesize);
+  MonaMetrics::Scope metrics(MonaMetrics::RECEIVE, tag, count * typesize);
 
   if (buf == nullptr)
   {
     throw std::runtime_error("recv should not be null");
     return;
   }
-  na_return_t ret = mona_comm_recv(comm, (void*)buf, count * typesize, src, tag, NULL, NULL, NULL);
+  na_return_t ret;
+  if (MONA_DATA->registrations)
+  {
+    mona_request_t req;
+    IceTMonaRegistration* registration;
+    ret = MonaIrecvBuffer(MONA_DATA, buf, count * typesize, src, tag, &req, &registration);
+    if (ret == NA_SUCCESS)
+    {
+      ret = mona_wait(req);
+      release_registration(registration);
+    }
+  }
+  else
+  {
+    ret = mona_comm_recv(comm, (void*)buf, count * typesize, src, tag, NULL, NULL, NULL);
+  }
   if (ret != NA_SUCCESS)
   {
     throw std::runtime_error("failed for MonaSend");
@@ -281,6 +734,7 @@ static void MonaSendrecv(IceTCommunicator self, const void* sendbuf, int sendcou
   IceTEnum sendtype, int dest, int sendtag, void* recvbuf, int recvcount, IceTEnum recvtype,
   int src, int recvtag)
 {
+  ICET_MONA_TRACE("sendrecv");
 
   auto comm = MONA_COMM;
 
@@ -288,29 +742,60 @@ static void MonaSendrecv(IceTCommunicator self, const void* sendbuf, int sendcou
   size_t recvtypesize;
   GET_DATATYPE_SIZE(sendtype, sendtypesize);
   GET_DATATYPE_SIZE(recvtype, recvtypesize);
+  MonaMetrics::Scope sendMetrics(MonaMetrics::SEND, sendtag, sendcount * sendtypesize);
+  MonaMetrics::Scope recvMetrics(MonaMetrics::RECEIVE, recvtag, recvcount * recvtypesize);
   if (sendbuf == nullptr || recvbuf == NULL)
   {
     throw std::runtime_error("send/recv should not be null");
     return;
   }
 
-  mona_comm_sendrecv(comm, (void*)sendbuf, sendcount * sendtypesize, dest, sendtag, recvbuf,
-    recvcount * recvtypesize, src, recvtag, NULL, NULL, NULL);
+  if (!MONA_DATA->registrations)
+  {
+    mona_comm_sendrecv(comm, (void*)sendbuf, sendcount * sendtypesize, dest, sendtag, recvbuf,
+      recvcount * recvtypesize, src, recvtag, NULL, NULL, NULL);
+    return;
+  }
+
+  mona_request_t sendreq, recvreq;
+  IceTMonaRegistration *sendregistration, *recvregistration;
+  na_return_t ret = MonaIsendBuffer(
+    MONA_DATA, sendbuf, sendcount * sendtypesize, dest, sendtag, &sendreq, &sendregistration);
+  if (ret != NA_SUCCESS)
+  {
+    throw std::runtime_error("failed for MonaSendrecv");
+  }
+  ret = MonaIrecvBuffer(
+    MONA_DATA, recvbuf, recvcount * recvtypesize, src, recvtag, &recvreq, &recvregistration);
+  if (ret == NA_SUCCESS)
+  {
+    ret = mona_wait(recvreq);
+    release_registration(recvregistration);
+  }
+  na_return_t sendret = mona_wait(sendreq);
+  release_registration(sendregistration);
+  if (ret != NA_SUCCESS || sendret != NA_SUCCESS)
+  {
+    throw std::runtime_error("failed for MonaSendrecv");
+  }
 }
 
 static void MonaGather(IceTCommunicator self, const void* sendbuf, int sendcount, IceTEnum datatype,
   void* recvbuf, int root)
 {
+  ICET_MONA_TRACE("gather");
 
   auto comm = MONA_COMM;
   size_t typesize;
   GET_DATATYPE_SIZE(datatype, typesize);
+  MonaMetrics::Scope metrics(MonaMetrics::GATHER, -1, sendcount * typesize);
 
   if (sendbuf == ICET_IN_PLACE_COLLECT)
   {
     sendbuf = MONA_IN_PLACE;
   }
-  mona_comm_gather(comm, sendbuf, sendcount * typesize, recvbuf, root, ICET_MONA_GATHER_TAG);
+  mona_comm_gather(
+    comm, sendbuf, sendcount * typesize, recvbuf, root, ICET_MONA_COLLECTIVE_TAG(comm));
 }
 
 /*
@@ -325,6 +810,7 @@ rank 0 sendsize 3145728
 static void MonaGatherv(IceTCommunicator self, const void* sendbuf, int sendcount,
   IceTEnum datatype, void* recvbuf, const int* recvcounts, const int* recvoffsets, int root)
 {
+  ICET_MONA_TRACE("gatherv");
 
   auto comm = MONA_COMM;
   int size, rank;
@@ -334,14 +820,17 @@ static void MonaGatherv(IceTCommunicator self, const void* sendbuf, int sendcoun
 
   size_t typesize;
   GET_DATATYPE_SIZE(datatype, typesize);
+  MonaMetrics::Scope metrics(MonaMetrics::GATHER, -1, sendcount * typesize);
 
   if (sendbuf == ICET_IN_PLACE_COLLECT)
   {
     sendbuf = MONA_IN_PLACE;
   }
 
-  std::vector<size_t> recvsize_sizet(rank == root ? size : 0);
-  std::vector<size_t> recvoffsets_sizet(rank == root ? size : 0);
+  std::vector<size_t>& recvsize_sizet = MONA_DATA->gatherv_sizes;
+  std::vector<size_t>& recvoffsets_sizet = MONA_DATA->gatherv_offsets;
+  recvsize_sizet.resize(rank == root ? size : 0);
+  recvoffsets_sizet.resize(rank == root ? size : 0);
 
   if (rank == root)
   {
@@ -353,23 +842,87 @@ static void MonaGatherv(IceTCommunicator self, const void* sendbuf, int sendcoun
   }
 
   mona_comm_gatherv(comm, sendbuf, sendcount * typesize, recvbuf, recvsize_sizet.data(),
-    recvoffsets_sizet.data(), root, ICET_MONA_GATHERV_TAG);
+    recvoffsets_sizet.data(), root, ICET_MONA_COLLECTIVE_TAG(comm));
+}
+
+// Recursive doubling allgather, for a power of two number of ranks: at step
+// k each rank swaps the 2^k blocks it has with the rank whose number differs
+// in bit k. recvbuf already holds the block of this rank.
+static na_return_t MonaRecursiveDoublingAllgather(
+  mona_comm_t comm, char* recvbuf, size_t blocksize, na_tag_t tag)
+{
+  int size, rank;
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  na_return_t ret = NA_SUCCESS;
+  for (int mask = 1; ret == NA_SUCCESS && mask < size; mask <<= 1)
+  {
+    int partner = rank ^ mask;
+    size_t mine = static_cast<size_t>(rank & ~(mask - 1)) * blocksize;
+    size_t theirs = static_cast<size_t>(partner & ~(mask - 1)) * blocksize;
+    ret = mona_comm_sendrecv(comm, recvbuf + mine, mask * blocksize, partner, tag,
+      recvbuf + theirs, mask * blocksize, partner, tag, NULL, NULL, NULL);
+  }
+  return ret;
+}
+
+// Ring allgather: at each of the p - 1 steps every rank passes on to its
+// right the block it got from its left at the previous step.
+static na_return_t MonaRingAllgather(
+  mona_comm_t comm, char* recvbuf, size_t blocksize, na_tag_t tag)
+{
+  int size, rank;
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  int right = (rank + 1) % size;
+  int left = (rank + size - 1) % size;
+  na_return_t ret = NA_SUCCESS;
+  for (int step = 0; ret == NA_SUCCESS && step < size - 1; step++)
+  {
+    int sendblock = (rank - step + size) % size;
+    int recvblock = (rank - step - 1 + size) % size;
+    ret = mona_comm_sendrecv(comm, recvbuf + sendblock * blocksize, blocksize, right, tag,
+      recvbuf + recvblock * blocksize, blocksize, left, tag, NULL, NULL, NULL);
+  }
+  return ret;
 }
 
 static void MonaAllgather(
   IceTCommunicator self, const void* sendbuf, int sendcount, IceTEnum datatype, void* recvbuf)
 {
+  ICET_MONA_TRACE("allgather");
 
   auto comm = MONA_COMM;
   size_t typesize;
   GET_DATATYPE_SIZE(datatype, typesize);
+  MonaMetrics::Scope metrics(MonaMetrics::ALL_GATHER, -1, sendcount * typesize);
+  int size, rank;
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  size_t blocksize = sendcount * typesize;
+  bool pof2 = (size & (size - 1)) == 0;
+  na_tag_t tag = ICET_MONA_COLLECTIVE_TAG(comm);
 
-  if (sendbuf == ICET_IN_PLACE_COLLECT)
+  na_return_t ret;
+  if (blocksize < ICET_MONA_ALLGATHER_RING_THRESHOLD && !pof2)
   {
-    sendbuf = MONA_IN_PLACE;
+    if (sendbuf == ICET_IN_PLACE_COLLECT)
+    {
+      sendbuf = MONA_IN_PLACE;
+    }
+    ret = mona_comm_allgather(comm, sendbuf, blocksize, recvbuf, tag);
+  }
+  else
+  {
+    char* blocks = static_cast<char*>(recvbuf);
+    if (sendbuf != ICET_IN_PLACE_COLLECT)
+    {
+      memcpy(blocks + rank * blocksize, sendbuf, blocksize);
+    }
+    ret = blocksize < ICET_MONA_ALLGATHER_RING_THRESHOLD
+      ? MonaRecursiveDoublingAllgather(comm, blocks, blocksize, tag)
+      : MonaRingAllgather(comm, blocks, blocksize, tag);
   }
-  na_return_t ret =
-    mona_comm_allgather(comm, sendbuf, sendcount * typesize, recvbuf, ICET_MONA_ALLGATHER_TAG);
   if (ret != NA_SUCCESS)
   {
     throw std::runtime_error("failed for mona_comm_allgather");
@@ -377,9 +930,82 @@ static void MonaAllgather(
   }
 }
 
+// Pairwise exchange alltoall: at step k every rank sends its block for rank
+// + k and receives the one of rank - k, one message in and one out at a time.
+static na_return_t MonaPairwiseAlltoall(
+  mona_comm_t comm, const char* sendbuf, size_t blocksize, char* recvbuf, na_tag_t tag)
+{
+  int size, rank;
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  memcpy(recvbuf + rank * blocksize, sendbuf + rank * blocksize, blocksize);
+  na_return_t ret = NA_SUCCESS;
+  for (int step = 1; ret == NA_SUCCESS && step < size; step++)
+  {
+    int dest = (rank + step) % size;
+    int src = (rank - step + size) % size;
+    ret = mona_comm_sendrecv(comm, sendbuf + dest * blocksize, blocksize, dest, tag,
+      recvbuf + src * blocksize, blocksize, src, tag, NULL, NULL, NULL);
+  }
+  return ret;
+}
+
+// Bruck alltoall: log2(p) steps instead of p - 1 for small blocks. The blocks
+// are rotated so that block i is for rank + i, then at step k the blocks
+// whose index has bit k set go to rank + 2^k (packed in one message), and a
+// final rotation puts the block from rank - i at position rank - i.
+static na_return_t MonaBruckAlltoall(mona_comm_t comm, const char* sendbuf, size_t blocksize,
+  char* recvbuf, na_tag_t tag, std::vector<char>& scratch)
+{
+  int size, rank;
+  mona_comm_size(comm, &size);
+  mona_comm_rank(comm, &rank);
+  size_t total = size * blocksize;
+  scratch.resize(total + 2 * (total / 2 + blocksize));
+  char* blocks = scratch.data();
+  char* packed = blocks + total;
+  char* unpacked = packed + total / 2 + blocksize;
+  for (int i = 0; i < size; i++)
+  {
+    memcpy(blocks + i * blocksize, sendbuf + ((rank + i) % size) * blocksize, blocksize);
+  }
+
+  na_return_t ret = NA_SUCCESS;
+  for (int k = 1; ret == NA_SUCCESS && k < size; k <<= 1)
+  {
+    size_t n = 0;
+    for (int i = k; i < size; i++)
+    {
+      if (i & k)
+      {
+        memcpy(packed + n, blocks + i * blocksize, blocksize);
+        n += blocksize;
+      }
+    }
+    ret = mona_comm_sendrecv(comm, packed, n, (rank + k) % size, tag, unpacked, n,
+      (rank - k + size) % size, tag, NULL, NULL, NULL);
+    n = 0;
+    for (int i = k; ret == NA_SUCCESS && i < size; i++)
+    {
+      if (i & k)
+      {
+        memcpy(blocks + i * blocksize, unpacked + n, blocksize);
+        n += blocksize;
+      }
+    }
+  }
+
+  for (int i = 0; ret == NA_SUCCESS && i < size; i++)
+  {
+    memcpy(recvbuf + ((rank - i + size) % size) * blocksize, blocks + i * blocksize, blocksize);
+  }
+  return ret;
+}
+
 static void MonaAlltoall(
   IceTCommunicator self, const void* sendbuf, int sendcount, IceTEnum datatype, void* recvbuf)
 {
+  ICET_MONA_TRACE("alltoall");
 
   auto comm = MONA_COMM;
   size_t typesize;
@@ -389,8 +1015,27 @@ static void MonaAlltoall(
     throw std::runtime_error("alltoall should not be null");
     return;
   }
-  na_return_t ret =
-    mona_comm_alltoall(comm, sendbuf, sendcount * typesize, recvbuf, ICET_MONA_ALLTOALL_TAG);
+  int size;
+  mona_comm_size(comm, &size);
+  size_t blocksize = sendcount * typesize;
+  MonaMetrics::Scope metrics(MonaMetrics::ALL_TO_ALL, -1, size * blocksize);
+  na_tag_t tag = ICET_MONA_COLLECTIVE_TAG(comm);
+
+  na_return_t ret;
+  if (size < ICET_MONA_ALLTOALL_MIN_RANKS)
+  {
+    ret = mona_comm_alltoall(comm, sendbuf, blocksize, recvbuf, tag);
+  }
+  else if (blocksize < ICET_MONA_ALLTOALL_BRUCK_THRESHOLD)
+  {
+    ret = MonaBruckAlltoall(comm, static_cast<const char*>(sendbuf), blocksize,
+      static_cast<char*>(recvbuf), tag, MONA_DATA->collective_scratch);
+  }
+  else
+  {
+    ret = MonaPairwiseAlltoall(
+      comm, static_cast<const char*>(sendbuf), blocksize, static_cast<char*>(recvbuf), tag);
+  }
   if (ret != NA_SUCCESS)
   {
     throw std::runtime_error("failed for mona_comm_alltoall");
@@ -401,8 +1046,6 @@ static void MonaAlltoall(
 static IceTCommRequest MonaIsend(
   IceTCommunicator self, const void* buf, int count, IceTEnum datatype, int dest, int tag)
 {
-
-  auto comm = MONA_COMM;
   IceTCommRequest icet_request;
   mona_request_t req;
   size_t typesize;
@@ -412,14 +1055,18 @@ static IceTCommRequest MonaIsend(
     throw std::runtime_error("isend should not be null");
     return icet_request;
   }
-  na_return_t ret = mona_comm_isend(comm, buf, count * typesize, dest, tag, &req);
+  IceTMonaRegistration* registration;
+  na_return_t ret =
+    MonaIsendBuffer(MONA_DATA, buf, count * typesize, dest, tag, &req, &registration);
   if (ret != NA_SUCCESS)
   {
     throw std::runtime_error("failed for mona_comm_isend");
     return icet_request;
   }
-  icet_request = create_request();
+  icet_request = create_request(MONA_DATA);
   setMonaRequest(icet_request, req);
+  ((IceTMonaCommRequestInternals)icet_request->internals)->registration = registration;
+  start_request_metrics(icet_request, MonaMetrics::SEND, tag, count * typesize);
 
   return icet_request;
 }
@@ -427,34 +1074,36 @@ static IceTCommRequest MonaIsend(
 static IceTCommRequest MonaIrecv(
   IceTCommunicator self, void* buf, int count, IceTEnum datatype, int src, int tag)
 {
-
-  auto comm = MONA_COMM;
   IceTCommRequest icet_request;
   mona_request_t req;
   size_t typesize;
   GET_DATATYPE_SIZE(datatype, typesize);
-  na_return_t ret = mona_comm_irecv(comm, buf, count * typesize, src, tag, NULL, NULL, NULL, &req);
-  if (ret != NA_SUCCESS)
+  if (buf == nullptr)
   {
-    throw std::runtime_error("failed for mona_comm_irecv");
+    throw std::runtime_error("irecv should not be null");
     return icet_request;
   }
-  icet_request = create_request();
-  if (buf == nullptr)
+  IceTMonaRegistration* registration;
+  na_return_t ret =
+    MonaIrecvBuffer(MONA_DATA, buf, count * typesize, src, tag, &req, &registration);
+  if (ret != NA_SUCCESS)
   {
-    throw std::runtime_error("irecv should not be null");
+    throw std::runtime_error("failed for mona_comm_irecv");
     return icet_request;
   }
+  icet_request = create_request(MONA_DATA);
   setMonaRequest(icet_request, req);
+  ((IceTMonaCommRequestInternals)icet_request->internals)->registration = registration;
+  start_request_metrics(icet_request, MonaMetrics::RECEIVE, tag, count * typesize);
 
   return icet_request;
 }
 
 static void MonaWaitone(IceTCommunicator self, IceTCommRequest* icet_request)
 {
+  ICET_MONA_TRACE("waitone");
 
   mona_request_t req;
-  auto comm = MONA_COMM;
 
   if (*icet_request == ICET_COMM_REQUEST_NULL)
     return;
@@ -463,15 +1112,16 @@ static void MonaWaitone(IceTCommunicator self, IceTCommRequest* icet_request)
 
   mona_wait(req);
 
-  destroy_request(*icet_request);
+  release_request(MONA_DATA, *icet_request);
   *icet_request = ICET_COMM_REQUEST_NULL;
 }
 
 static int MonaWaitany(IceTCommunicator self, int count, IceTCommRequest* array_of_requests)
 {
-  std::vector<mona_request_t> reqs(count);
+  ICET_MONA_TRACE("waitany");
+  std::vector<mona_request_t>& reqs = MONA_DATA->waitany_requests;
+  reqs.resize(count);
   int idx;
-  auto comm = MONA_COMM;
 
   for (idx = 0; idx < count; idx++)
   {
@@ -486,7 +1136,7 @@ static int MonaWaitany(IceTCommunicator self, int count, IceTCommRequest* array_
     throw std::runtime_error("not success for wait any");
   }
 
-  destroy_request(array_of_requests[index]);
+  release_request(MONA_DATA, array_of_requests[index]);
   array_of_requests[index] = ICET_COMM_REQUEST_NULL;
 
   return index;
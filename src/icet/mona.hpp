@@ -7,6 +7,15 @@
 
 IceTCommunicator icetCreateMonaCommunicator(const mona_comm_t mona_comm);
 
+// Same, and keep the memory registrations of the IceT state buffers used for
+// large point-to-point messages (the image buffers, which IceT reuses from
+// frame to frame) in a cache of mona handles, so the exchanges of the next
+// frames do not register them again. A registration is used only while its
+// state buffer keeps the address and time stamp it was registered with, and
+// the registrations are dropped when the IceT context using the communicator
+// is destroyed.
+IceTCommunicator icetCreateMonaCommunicator(const mona_comm_t mona_comm, mona_instance_t mona);
+
 void icetDestroyMonaCommunicator(IceTCommunicator comm);
 
 #endif